@@ -8,7 +8,11 @@
 #include <stdint.h>
 #include "unicode.h"
 #include "qsort-r.c"
+#include "json-create-core.c"
 #include "json-create-perl.c"
+#include "json-create-writer.c"
+#include "json-create-encoder.c"
+#include "json-create-api.c"
 
 #define PERLJCCALL(x) {					\
 	json_create_status_t jcs;			\
@@ -20,6 +24,21 @@
     }
 
 typedef json_create_t * JSON__Create;
+typedef json_create_writer_t * JSON__Create__Writer;
+typedef json_create_encoder_t * JSON__Create__Encoder;
+
+/* Call a writer routine, then print the output if it has got
+   big. The output can't be continued after an error, so we croak. */
+
+#define WRITERCALL(x) {						\
+	json_create_status_t jcs;				\
+	jcs = x;						\
+	if (jcs != json_create_ok) {				\
+	    croak ("JSON::Create::Writer: output abandoned "	\
+		   "after error %d", jcs);			\
+	}							\
+	json_create_writer_auto_flush (w);			\
+    }
 
 #define JCSET						\
     if (items > 1) {					\
@@ -39,6 +58,9 @@ MODULE=JSON::Create PACKAGE=JSON::Create
 
 PROTOTYPES: DISABLE
 
+BOOT:
+	json_create_api_install (aTHX);
+
 SV *
 create_json (input, ...)
 	SV * input;
@@ -46,6 +68,7 @@ PREINIT:
 	json_create_t jc_stack = {0};
 	json_create_t * jc = & jc_stack;
 CODE:
+	json_create_find_bool_stashes (jc);
 	JCSET;
 	RETVAL = json_create_create (jc, input);
 OUTPUT:
@@ -58,20 +81,28 @@ PREINIT:
 	json_create_t jc_stack = {0};
 	json_create_t * jc = & jc_stack;
 CODE:
+	json_create_find_bool_stashes (jc);
 	JCSET;
 	jc_stack.strict = 1;
 	RETVAL = json_create_create (jc, input);
 OUTPUT:
 	RETVAL
 
-void
-DESTROY (jc)
-	JSON::Create jc;
+int
+zlib_ok ()
 CODE:
-	PERLJCCALL (json_create_free (jc));
+#ifdef HAVE_ZLIB
+	RETVAL = 1;
+#else
+	RETVAL = 0;
+#endif /* def HAVE_ZLIB */
+OUTPUT:
+	RETVAL
 
 JSON::Create
 jcnew ()
+INIT:
+	RETVAL = 0;
 CODE:
 	PERLJCCALL (json_create_new (& RETVAL));
 OUTPUT:
@@ -91,15 +122,25 @@ sort (jc, onoff)
 	JSON::Create jc;
 	SV * onoff;
 CODE:
+	json_create_clear_cache (jc);
 #ifdef INDENT
 	jc->sort = SvTRUE (onoff) ? 1 : 0;
 #endif
 
+void
+canonical (jc, onoff)
+	JSON::Create jc;
+	SV * onoff;
+CODE:
+	json_create_clear_cache (jc);
+	json_create_set_canonical (jc, onoff);
+
 void
 cmp (jc, cmp)
 	JSON::Create jc;
 	SV * cmp;
 CODE:
+	json_create_clear_cache (jc);
 	PERLJCCALL (json_create_remove_cmp (jc));
 	if (SvTRUE (cmp)) {
 	    jc->cmp = cmp;
@@ -112,6 +153,7 @@ set_fformat_unsafe (jc, fformat)
 	JSON::Create jc;
 	SV * fformat;
 CODE:
+	json_create_clear_cache (jc);
 	PERLJCCALL (json_create_set_fformat (jc, fformat));
 OUTPUT:
 
@@ -120,27 +162,63 @@ escape_slash (jc, onoff)
 	JSON::Create jc;
 	SV * onoff;
 CODE:
-	jc->escape_slash = SvTRUE (onoff) ? 1 : 0;
+	json_create_clear_cache (jc);
+	json_create_set_escape_slash (jc, onoff);
+
+void
+escape_chars (jc, chars = & PL_sv_undef)
+	JSON::Create jc;
+	SV * chars;
+CODE:
+	json_create_clear_cache (jc);
+	json_create_set_escape_chars (jc, chars);
+
+void
+escape_non_bmp (jc, onoff)
+	JSON::Create jc;
+	SV * onoff;
+CODE:
+	json_create_clear_cache (jc);
+	jc->core.escape_non_bmp = SvTRUE (onoff) ? 1 : 0;
 
 void
 unicode_upper (jc, onoff)
 	JSON::Create jc;
 	SV * onoff;
 CODE:
-	jc->unicode_upper = SvTRUE (onoff) ? 1 : 0;
+	json_create_clear_cache (jc);
+	jc->core.unicode_upper = SvTRUE (onoff) ? 1 : 0;
 
 void
 unicode_escape_all (jc, onoff)
 	JSON::Create jc;
 	SV * onoff;
 CODE:
-	jc->unicode_escape_all = SvTRUE (onoff) ? 1 : 0;
+	json_create_clear_cache (jc);
+	jc->core.unicode_escape_all = SvTRUE (onoff) ? 1 : 0;
+
+void
+quote_big_ints (jc, onoff)
+	JSON::Create jc;
+	SV * onoff;
+CODE:
+	json_create_clear_cache (jc);
+	jc->core.quote_big_ints = SvTRUE (onoff) ? 1 : 0;
+
+void
+quote_ints (jc, onoff)
+	JSON::Create jc;
+	SV * onoff;
+CODE:
+	json_create_clear_cache (jc);
+	jc->core.quote_ints = SvTRUE (onoff) ? 1 : 0;
 
 void
 set_validate (jc, onoff)
 	JSON::Create jc;
 	SV * onoff;
 CODE:
+	json_create_clear_cache (jc);
 	jc->validate = SvTRUE (onoff) ? 1 : 0;
 
 void
@@ -148,7 +226,8 @@ no_javascript_safe (jc, onoff)
 	JSON::Create jc;
 	SV * onoff;
 CODE:
-	jc->no_javascript_safe = SvTRUE (onoff) ? 1 : 0;
+	json_create_clear_cache (jc);
+	jc->core.no_javascript_safe = SvTRUE (onoff) ? 1 : 0;
 
 void
 fatal_errors (jc, onoff)
@@ -162,7 +241,15 @@ replace_bad_utf8 (jc, onoff)
 	JSON::Create jc;
 	SV * onoff;
 CODE:
-	jc->replace_bad_utf8 = SvTRUE (onoff) ? 1 : 0;
+	json_create_clear_cache (jc);
+	jc->core.replace_bad_utf8 = SvTRUE (onoff) ? 1 : 0;
+
+void
+memoize_handlers (jc, onoff)
+	JSON::Create jc;
+	SV * onoff;
+CODE:
+	jc->memoize_handlers = SvTRUE (onoff) ? 1 : 0;
 
 void
 downgrade_utf8 (jc, onoff)
@@ -171,22 +258,131 @@ downgrade_utf8 (jc, onoff)
 CODE:
 	jc->downgrade_utf8 = SvTRUE (onoff) ? 1 : 0;
 
+void
+skip_undef (jc, onoff)
+	JSON::Create jc;
+	SV * onoff;
+CODE:
+	json_create_clear_cache (jc);
+	jc->skip_undef = SvTRUE (onoff) ? 1 : 0;
+
 void
 strict (jc, onoff)
 	JSON::Create jc;
 	SV * onoff;
 CODE:
+	json_create_clear_cache (jc);
 	jc->strict = SvTRUE (onoff) ? 1 : 0;
 
+void
+gzip (jc, onoff)
+	JSON::Create jc;
+	SV * onoff;
+CODE:
+	jc->gzip = SvTRUE (onoff) ? 1 : 0;
+
+void
+format (jc, format)
+	JSON::Create jc;
+	SV * format;
+CODE:
+	json_create_clear_cache (jc);
+	json_create_set_format (jc, format);
+
 void
 indent (jc, onoff)
 	JSON::Create jc;
 	SV * onoff;
 CODE:
+	json_create_clear_cache (jc);
 #ifdef INDENT
 	jc->indent = SvTRUE (onoff) ? 1 : 0;
 #endif
 
+void
+cache_readonly (jc, onoff)
+	JSON::Create jc;
+	SV * onoff;
+CODE:
+	json_create_clear_cache (jc);
+	jc->cache_readonly = SvTRUE (onoff) ? 1 : 0;
+
+void
+clear_cache (jc)
+	JSON::Create jc;
+CODE:
+	json_create_clear_cache (jc);
+
+void
+max_depth (jc, max_depth)
+	JSON::Create jc;
+	unsigned int max_depth;
+CODE:
+	jc->max_depth = max_depth;
+
+void
+max_array_items (jc, max_array_items)
+	JSON::Create jc;
+	unsigned int max_array_items;
+CODE:
+	json_create_clear_cache (jc);
+	jc->max_array_items = max_array_items;
+
+void
+max_string_bytes (jc, max_string_bytes)
+	JSON::Create jc;
+	unsigned int max_string_bytes;
+CODE:
+	json_create_clear_cache (jc);
+	jc->max_string_bytes = max_string_bytes;
+
+void
+max_output_bytes (jc, max_output_bytes)
+	JSON::Create jc;
+	UV max_output_bytes;
+CODE:
+	jc->max_output_bytes = max_output_bytes;
+
+void
+truncate (jc, onoff)
+	JSON::Create jc;
+	SV * onoff;
+CODE:
+	json_create_clear_cache (jc);
+	jc->truncate = SvTRUE (onoff) ? 1 : 0;
+
+void
+include_keys (jc, keys = & PL_sv_undef)
+	JSON::Create jc;
+	SV * keys;
+CODE:
+	json_create_clear_cache (jc);
+	json_create_set_include_keys (jc, keys);
+
+void
+exclude_keys (jc, keys = & PL_sv_undef)
+	JSON::Create jc;
+	SV * keys;
+CODE:
+	json_create_clear_cache (jc);
+	json_create_set_exclude_keys (jc, keys);
+
+void
+obj_keys (jc, ...)
+	JSON::Create jc;
+PREINIT:
+	int i;
+CODE:
+	json_create_clear_cache (jc);
+	if ((items - 1) % 2 != 0) {
+	    warn ("odd number of arguments ignored");
+	}
+	else {
+	    for (i = 1; i < items; i += 2) {
+		json_create_set_obj_keys (jc, ST(i), ST(i+1));
+	    }
+	}
+
 HV *
 get_handlers (jc)
 	JSON::Create jc
@@ -204,6 +400,7 @@ obj_handler (jc, oh = & PL_sv_undef)
 	JSON::Create jc;
 	SV * oh;
 CODE:
+	json_create_clear_cache (jc);
 	/* Remove a previous ref handler, if it exists. */
 	PERLJCCALL (json_create_remove_obj_handler (jc));
 	if (SvTRUE (oh)) {
@@ -215,6 +412,7 @@ non_finite_handler (jc, oh = & PL_sv_undef)
 	JSON::Create jc;
 	SV * oh;
 CODE:
+	json_create_clear_cache (jc);
 	/* Remove a previous ref handler, if it exists. */
 	PERLJCCALL (json_create_remove_non_finite_handler (jc));
 	if (SvTRUE (oh)) {
@@ -232,6 +430,7 @@ set_handlers (jc, handlers)
 	JSON::Create jc
 	HV * handlers
 CODE:
+	json_create_clear_cache (jc);
         PERLJCCALL (json_create_remove_handlers (jc));
 	SvREFCNT_inc ((SV*) handlers);
 	jc->n_mallocs++;
@@ -242,9 +441,159 @@ type_handler (jc, crh = & PL_sv_undef)
 	JSON::Create jc;
 	SV * crh;
 CODE:
+	json_create_clear_cache (jc);
 	/* Remove a previous ref handler, if it exists. */
 	PERLJCCALL (json_create_remove_type_handler (jc));
 	if (SvTRUE (crh)) {
 		set_type_handler (jc, crh);
 	}
 
+
+MODULE=JSON::Create PACKAGE=JSON::Create::Writer
+
+JSON::Create::Writer
+wnew ()
+INIT:
+	RETVAL = 0;
+CODE:
+	PERLJCCALL (json_create_writer_new (& RETVAL));
+OUTPUT:
+	RETVAL
+
+void
+DESTROY (w)
+	JSON::Create::Writer w;
+CODE:
+	PERLJCCALL (json_create_writer_free (w));
+
+void
+set (w, ...)
+	JSON::Create::Writer w;
+PREINIT:
+	json_create_t * jc;
+CODE:
+	jc = w->jc;
+	JCSET;
+
+void
+fh (w, fh = & PL_sv_undef)
+	JSON::Create::Writer w;
+	SV * fh;
+CODE:
+	json_create_writer_set_fh (w, fh);
+
+void
+start_object (w)
+	JSON::Create::Writer w;
+CODE:
+	WRITERCALL (json_create_writer_start (w, '{'));
+
+void
+start_array (w)
+	JSON::Create::Writer w;
+CODE:
+	WRITERCALL (json_create_writer_start (w, '['));
+
+void
+end (w)
+	JSON::Create::Writer w;
+CODE:
+	WRITERCALL (json_create_writer_end (w));
+
+void
+key (w, key)
+	JSON::Create::Writer w;
+	SV * key;
+CODE:
+	WRITERCALL (json_create_writer_key (w, key));
+
+void
+string (w, string)
+	JSON::Create::Writer w;
+	SV * string;
+CODE:
+	WRITERCALL (json_create_writer_string (w, string));
+
+void
+number (w, number)
+	JSON::Create::Writer w;
+	SV * number;
+CODE:
+	WRITERCALL (json_create_writer_number (w, number));
+
+void
+bool (w, onoff)
+	JSON::Create::Writer w;
+	SV * onoff;
+CODE:
+	WRITERCALL (json_create_writer_literal (w, SvTRUE (onoff) ? "true" : "false"));
+
+void
+null (w)
+	JSON::Create::Writer w;
+CODE:
+	WRITERCALL (json_create_writer_literal (w, "null"));
+
+void
+value (w, value)
+	JSON::Create::Writer w;
+	SV * value;
+CODE:
+	WRITERCALL (json_create_writer_structure (w, value));
+
+SV *
+output (w)
+	JSON::Create::Writer w;
+CODE:
+	RETVAL = json_create_writer_output (w);
+OUTPUT:
+	RETVAL
+
+void
+flush (w, fh = 0)
+	JSON::Create::Writer w;
+	SV * fh;
+CODE:
+	if (! fh) {
+	    fh = w->fh;
+	}
+	if (! fh) {
+	    croak ("JSON::Create::Writer: no filehandle to flush to");
+	}
+	json_create_writer_print (w, fh);
+	PerlIO_flush (IoOFP (sv_2io (fh)));
+
+
+MODULE=JSON::Create PACKAGE=JSON::Create::Encoder
+
+JSON::Create::Encoder
+enew (jc, input)
+	JSON::Create jc;
+	SV * input;
+INIT:
+	RETVAL = 0;
+CODE:
+	PERLJCCALL (json_create_encoder_new (jc, input, & RETVAL));
+OUTPUT:
+	RETVAL
+
+void
+DESTROY (e)
+	JSON::Create::Encoder e;
+CODE:
+	PERLJCCALL (json_create_encoder_free (e));
+
+SV *
+next_chunk (e, max_bytes = 0)
+	JSON::Create::Encoder e;
+	UV max_bytes;
+PREINIT:
+	json_create_status_t jcs;
+CODE:
+	jcs = json_create_encoder_next_chunk (e, (STRLEN) max_bytes, & RETVAL);
+	if (jcs != json_create_ok) {
+	    croak ("JSON::Create::Encoder: output abandoned after error %d",
+		   jcs);
+	}
+OUTPUT:
+	RETVAL
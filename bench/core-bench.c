@@ -0,0 +1,116 @@
+/* Time the Perl-independent core on an array of objects, without
+   Perl. Compile with
+
+   cc -O2 -o core-bench core-bench.c -lm
+
+   and run with an optional number of objects. */
+
+#include <time.h>
+#include "../json-create-core.c"
+
+/* The user data is an index into a virtual array of objects like
+   {"id":123,"name":"item 123","price":12.3,"ok":true}. The node
+   pointers are the address of "root" for the array, or an encoding of
+   the object number and field. */
+
+static size_t n_objects = 1000000;
+static char root;
+static char names[4][16] = {"id", "name", "price", "ok"};
+
+#define NODE(obj, field) ((void *) (((obj) << 3) | (field) | 0x4))
+#define OBJ(node) (((size_t) (node)) >> 3)
+#define FIELD(node) (((size_t) (node)) & 0x3)
+#define IS_OBJ(node) (! (((size_t) (node)) & 0x4))
+
+static char name_buf[32];
+
+static json_create_status_t
+value (void * user, void * node, json_create_value_t * v)
+{
+    size_t obj;
+    if (node == & root) {
+	v->type = json_create_value_array;
+	v->n = n_objects;
+	return json_create_ok;
+    }
+    obj = OBJ (node);
+    if (IS_OBJ (node)) {
+	v->type = json_create_value_object;
+	v->n = 4;
+	return json_create_ok;
+    }
+    switch (FIELD (node)) {
+    case 0:
+	v->type = json_create_value_uint;
+	v->u = obj;
+	break;
+    case 1:
+	v->type = json_create_value_string;
+	v->n = snprintf (name_buf, sizeof (name_buf), "item %zu", obj);
+	v->s = name_buf;
+	break;
+    case 2:
+	v->type = json_create_value_double;
+	v->d = obj / 10.0;
+	break;
+    case 3:
+	v->type = (obj & 1) ? json_create_value_true : json_create_value_false;
+	break;
+    }
+    return json_create_ok;
+}
+
+static json_create_status_t
+entry (void * user, void * node, size_t i, json_create_value_t * key,
+       void ** child_ptr)
+{
+    if (node == & root) {
+	/* Objects are the nodes with bit 2 clear. */
+	* child_ptr = (void *) (i << 3);
+	return json_create_ok;
+    }
+    key->type = json_create_value_string;
+    key->s = names[i];
+    key->n = strlen (names[i]);
+    * child_ptr = NODE (OBJ (node), i);
+    return json_create_ok;
+}
+
+static size_t total;
+
+static json_create_status_t
+sink (void * user, const char * s, size_t len)
+{
+    total += len;
+    return json_create_ok;
+}
+
+int main (int argc, char ** argv)
+{
+    static unsigned char buffer[BUFSIZE];
+    json_create_core_t core = {0};
+    json_create_visitor_t v = {0};
+    json_create_status_t status;
+    clock_t start;
+    double seconds;
+
+    if (argc > 1) {
+	n_objects = strtoul (argv[1], 0, 10);
+    }
+    json_create_core_init (& core, buffer, sink, 0);
+    v.value = value;
+    v.entry = entry;
+    start = clock ();
+    status = json_create_core_visit (& core, & v, & root);
+    if (status == json_create_ok) {
+	status = json_create_core_fill (& core);
+    }
+    seconds = (double) (clock () - start) / CLOCKS_PER_SEC;
+    if (status != json_create_ok) {
+	fprintf (stderr, "Error %d\n", status);
+	return 1;
+    }
+    printf ("%zu objects, %zu bytes, %.3f s, %.1f MB/s\n", n_objects, total,
+	    seconds, total / seconds / 1e6);
+    return 0;
+}
@@ -0,0 +1,187 @@
+/*
+   This is the C interface of JSON::Create for other XS modules,
+   described in "lib/JSON/Create/json-create-api.h".
+
+   It's kept in a separate file but #included into the main file,
+   Create.xs, after "json-create-writer.c" and "json-create-encoder.c",
+   since it calls into all of them.
+*/
+
+#include "lib/JSON/Create/json-create-api.h"
+
+static struct json_create *
+json_create_api_jc_from_sv (pTHX_ SV * sv)
+{
+    return json_create_from_sv (sv, "sv");
+}
+
+static struct json_create *
+json_create_api_jc_new (pTHX)
+{
+    json_create_t * jc;
+    json_create_new (& jc);
+    return jc;
+}
+
+static void
+json_create_api_jc_free (pTHX_ struct json_create * jc)
+{
+    json_create_free (jc);
+}
+
+static void
+json_create_api_jc_set (pTHX_ struct json_create * jc, SV * key, SV * value)
+{
+    json_create_set (jc, key, value);
+}
+
+static SV *
+json_create_api_encode_sv (pTHX_ struct json_create * jc, SV * input,
+			   unsigned int flags)
+{
+    if (flags != 0) {
+	croak ("JSON::Create: unknown flags 0x%x to encode_sv", flags);
+    }
+    return json_create_create (jc, input);
+}
+
+static int
+json_create_api_escape (pTHX_ struct json_create * jc, SV * out,
+			const char * s, STRLEN len, int utf8)
+{
+    /* A copy of "jc" which writes into "out". */
+    json_create_t copy;
+    unsigned char buffer[BUFSIZE];
+
+    copy = * jc;
+    copy.format = json_create_format_json;
+#ifdef HAVE_ZLIB
+    copy.zstream = 0;
+#endif /* def HAVE_ZLIB */
+    if (! SvOK (out)) {
+	sv_setpvs (out, "");
+    }
+    json_create_buffer_init (& copy, buffer);
+    copy.output = out;
+    CALL (json_create_add_pv (& copy, s, len, utf8));
+    return json_create_buffer_fill (& copy);
+}
+
+static struct json_create_writer *
+json_create_api_writer_from_sv (pTHX_ SV * sv)
+{
+    if (SvROK (sv) && sv_derived_from (sv, "JSON::Create::Writer")) {
+	return INT2PTR (json_create_writer_t *, SvIV (SvRV (sv)));
+    }
+    croak ("sv is not a JSON::Create::Writer object");
+}
+
+/* The return value of a writer routine, after printing the output if
+   it has got big. */
+
+static int
+json_create_api_writer_done (json_create_writer_t * w,
+			     json_create_status_t status)
+{
+    if (status == json_create_ok) {
+	json_create_writer_auto_flush (w);
+    }
+    return status;
+}
+
+static int
+json_create_api_writer_start_array (pTHX_ struct json_create_writer * w)
+{
+    return json_create_api_writer_done (w, json_create_writer_start (w, '['));
+}
+
+static int
+json_create_api_writer_start_object (pTHX_ struct json_create_writer * w)
+{
+    return json_create_api_writer_done (w, json_create_writer_start (w, '{'));
+}
+
+static int
+json_create_api_writer_end (pTHX_ struct json_create_writer * w)
+{
+    return json_create_api_writer_done (w, json_create_writer_end (w));
+}
+
+static int
+json_create_api_writer_key (pTHX_ struct json_create_writer * w,
+			    const char * key, STRLEN len, int utf8)
+{
+    return json_create_api_writer_done
+	(w, json_create_writer_key_pv (w, key, len, utf8));
+}
+
+static int
+json_create_api_writer_string (pTHX_ struct json_create_writer * w,
+			       const char * s, STRLEN len, int utf8)
+{
+    return json_create_api_writer_done
+	(w, json_create_writer_string_pv (w, s, len, utf8));
+}
+
+static int
+json_create_api_writer_number (pTHX_ struct json_create_writer * w,
+			       SV * number)
+{
+    return json_create_api_writer_done
+	(w, json_create_writer_number (w, number));
+}
+
+static int
+json_create_api_writer_bool (pTHX_ struct json_create_writer * w, int onoff)
+{
+    return json_create_api_writer_done
+	(w, json_create_writer_literal (w, onoff ? "true" : "false"));
+}
+
+static int
+json_create_api_writer_null (pTHX_ struct json_create_writer * w)
+{
+    return json_create_api_writer_done
+	(w, json_create_writer_literal (w, "null"));
+}
+
+static int
+json_create_api_writer_value (pTHX_ struct json_create_writer * w,
+			      SV * value)
+{
+    return json_create_api_writer_done
+	(w, json_create_writer_structure (w, value));
+}
+
+/* This is never changed, so it can be shared between threads. */
+
+static const json_create_api_t json_create_api = {
+    JSON_CREATE_API_VERSION,
+    sizeof (json_create_api_t),
+    json_create_api_jc_from_sv,
+    json_create_api_jc_new,
+    json_create_api_jc_free,
+    json_create_api_jc_set,
+    json_create_api_encode_sv,
+    json_create_api_escape,
+    json_create_api_writer_from_sv,
+    json_create_api_writer_start_array,
+    json_create_api_writer_start_object,
+    json_create_api_writer_end,
+    json_create_api_writer_key,
+    json_create_api_writer_string,
+    json_create_api_writer_number,
+    json_create_api_writer_bool,
+    json_create_api_writer_null,
+    json_create_api_writer_value,
+};
+
+/* Put the address of "json_create_api" into PL_modglobal, from the
+   BOOT section of Create.xs. */
+
+static void
+json_create_api_install (pTHX)
+{
+    (void) hv_stores (PL_modglobal, JSON_CREATE_API_KEY,
+		      newSViv (PTR2IV (& json_create_api)));
+}
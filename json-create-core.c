@@ -0,0 +1,1896 @@
+/*
+   This is the part of JSON::Create which doesn't need Perl: the
+   output buffer, the string escaper, the number printers, and a
+   writer for C data structures which uses them.
+
+   It's #included into Create.xs before "json-create-perl.c", which
+   turns Perl values into calls to these routines. It can also be
+   #included into a C program on its own, as "xt/test-core.c" and
+   "bench/core-bench.c" do, to make JSON from C data, or to test,
+   profile or fuzz the escaper without Perl.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <inttypes.h>
+
+#ifdef __GNUC__
+#define INLINE inline
+#else
+#define INLINE
+#endif /* __GNUC__ */
+
+/* These are return statuses for the types of failures which can
+   occur. */
+
+typedef enum {
+    json_create_ok,
+
+    /* The following set of exceptions indicate something went wrong
+       in JSON::Create's code, in other words bugs. */
+
+    /* An error from the unicode.c library. */
+    json_create_unicode_error,
+    /* A printed number turned out to be longer than MARGIN bytes. */
+    json_create_number_too_long,
+    /* Unknown type of floating point number. */
+    json_create_unknown_floating_point,
+    /* Bad format for floating point. */
+    json_create_bad_floating_format,
+    /* An error from zlib. */
+    json_create_compression_error,
+
+    /* The following set of exceptions indicate bad input, in other
+       words these are user-generated exceptions. */
+
+    /* Badly-formatted UTF-8. */
+    json_create_unicode_bad_utf8,
+    /* Unknown Perl svtype within the structure. */
+    json_create_unknown_type,
+    /* User's routine returned invalid stuff. */
+    json_create_invalid_user_json,
+    /* User gave us an undefined value from a user subroutine. */
+    json_create_undefined_return_value,
+    /* Rejected non-ASCII, non-character string in strict mode. */
+    json_create_non_ascii_byte,
+    /* Rejected scalar reference in strict mode. */
+    json_create_scalar_reference,
+    /* Rejected non-finite number in strict mode. */
+    json_create_non_finite_number,
+    /* Input is nested more deeply than "max_depth". */
+    json_create_too_deep,
+    /* Input contains a reference to one of its own containers. */
+    json_create_circular_reference,
+    /* Asked for "gzip" but we were built without zlib. */
+    json_create_no_zlib,
+    /* The C writer couldn't get memory. */
+    json_create_no_memory,
+    /* Input is bigger than "max_array_items", "max_string_bytes" or
+       "max_output_bytes". */
+    json_create_too_big,
+    /* A hash was changed while it was being written out, for example
+       between calls to JSON::Create::Encoder's "next_chunk". */
+    json_create_input_changed,
+}
+json_create_status_t;
+
+#define BUFSIZE 0x4000
+
+/* MARGIN is the size of the "spillover" area where we can print
+   numbers or Unicode UTF-8 whole characters (runes) into the buffer
+   without having to check the printed length after each byte. */
+
+#define MARGIN 0x40
+
+/* Where the buffer goes when it is full. "user" is the "user" field
+   of the json_create_core_t. */
+
+typedef json_create_status_t (* json_create_sink_t)
+    (void * user, const char * s, size_t len);
+
+/* Report a user error, such as invalid UTF-8. */
+
+typedef void (* json_create_message_t)
+    (void * user, json_create_status_t status, const char * format,
+     va_list * ap);
+
+typedef struct json_create_core {
+    /* The buffer being written to, of size BUFSIZE. */
+    unsigned char * buffer;
+    /* The number of bytes in "buffer". */
+    int length;
+    /* Where full buffers go. */
+    json_create_sink_t sink;
+    /* Where user errors go, or zero to not report them. */
+    json_create_message_t message;
+    /* Passed to "sink" and "message". */
+    void * user;
+    /* This object's copy of the jump table of the string escaper,
+       with the user's choice of characters to escape. This is used
+       if "own_jump" is set. */
+    unsigned char jump[0x100];
+
+    /* One-bit flags. */
+
+    /* Do any of the strings have non-ASCII characters? */
+    unsigned int unicode : 1;
+    /* Should we convert / into \/? */
+    unsigned int escape_slash : 1;
+    /* Should Unicode be upper case? */
+    unsigned int unicode_upper : 1;
+    /* Should we escape all non-ascii? */
+    unsigned int unicode_escape_all : 1;
+    /* Escape characters outside the Basic Multilingual Plane. */
+    unsigned int escape_non_bmp : 1;
+    /* Use "jump" rather than the default jump table. */
+    unsigned int own_jump : 1;
+    /* Do not escape U+2028 and U+2029. */
+    unsigned int no_javascript_safe : 1;
+    /* Replace bad UTF-8 with the "replacement character". */
+    unsigned int replace_bad_utf8 : 1;
+    /* Write numbers as RFC 8785 says. */
+    unsigned int canonical : 1;
+    /* Write integers which JavaScript can't hold exactly as strings. */
+    unsigned int quote_big_ints : 1;
+    /* Write all integers as strings. */
+    unsigned int quote_ints : 1;
+
+    /* Floating point numbers. */
+
+    /* The format for snprintf, or zero for "%g". This is set with
+       json_create_core_fformat. */
+    const char * fformat;
+    /* 'f', 'e' or 'g' if "fformat" is one which
+       json_create_core_fast_double can print, or zero. */
+    char fconversion;
+    /* 'e' or 'E'. */
+    char fexponent;
+    /* The number after the "." of "fformat". */
+    unsigned char fprecision;
+}
+json_create_core_t;
+
+/* Return any status other than json_create_ok. */
+
+#define CORECALL(x) {							\
+	json_create_status_t status;					\
+	status = x;							\
+	if (status != json_create_ok) {					\
+	    return status;						\
+	}								\
+    }
+
+/* Start writing into "buffer", which has room for BUFSIZE bytes. */
+
+static void
+json_create_core_init (json_create_core_t * core, unsigned char * buffer,
+		       json_create_sink_t sink, void * user)
+{
+    core->buffer = buffer;
+    core->length = 0;
+    core->sink = sink;
+    core->user = user;
+}
+
+/* Send the contents of the buffer to the sink. */
+
+static json_create_status_t
+json_create_core_fill (json_create_core_t * core)
+{
+    if (core->length > 0) {
+	CORECALL ((* core->sink) (core->user, (const char *) core->buffer,
+				  (size_t) core->length));
+	core->length = 0;
+    }
+    return json_create_ok;
+}
+
+/* Keep MARGIN bytes free at the end of the buffer. */
+
+#define CORE_CHECKLENGTH				\
+    if (core->length >= BUFSIZE - MARGIN) {		\
+	CORECALL (json_create_core_fill (core));	\
+    }
+
+static void
+core_message (json_create_core_t * core, json_create_status_t status,
+	      const char * format, ...)
+{
+    va_list ap;
+    if (core->message) {
+	va_start (ap, format);
+	(* core->message) (core->user, status, format, & ap);
+	va_end (ap);
+    }
+}
+
+/* Add one character to the end of the buffer. */
+
+static INLINE json_create_status_t
+core_add_char (json_create_core_t * core, unsigned char c)
+{
+    core->buffer[core->length] = c;
+    core->length++;
+    CORE_CHECKLENGTH;
+    return json_create_ok;
+}
+
+/* Add a string "s" with length "slen". This does not test for nul
+   bytes, but just copies "slen" bytes of the string. This is not
+   intended to be Unicode-safe, it is only to be used for strings we
+   know do not need to be checked for Unicode validity. */
+
+static INLINE json_create_status_t
+core_add_str_len (json_create_core_t * core, const char * s, size_t slen)
+{
+    /* We know that (BUFSIZE - core->length) is always bigger than
+       MARGIN going into this, but the compiler doesn't. Hopefully,
+       the compiler optimizes the following "if" statement away to a
+       true value for almost all cases when this is inlined and slen
+       is known to be smaller than MARGIN. */
+    if (slen < MARGIN || slen < (size_t) (BUFSIZE - core->length)) {
+	memcpy (core->buffer + core->length, s, slen);
+	core->length += slen;
+	CORE_CHECKLENGTH;
+    }
+    else {
+	/* A very long string which may overflow the buffer, so empty
+	   the buffer and send the string straight to the sink. */
+	CORECALL (json_create_core_fill (core));
+	CORECALL ((* core->sink) (core->user, s, slen));
+    }
+    return json_create_ok;
+}
+
+#define CORE_ADD(x) CORECALL (core_add_str_len (core, x, strlen (x)))
+
+static const char *uc_hex = "0123456789ABCDEF";
+static const char *lc_hex = "0123456789abcdef";
+
+static INLINE json_create_status_t
+core_add_one_u (json_create_core_t * core, unsigned int u)
+{
+    char * spillover;
+    const char * hex;
+    hex = lc_hex;
+    if (core->unicode_upper) {
+	hex = uc_hex;
+    }
+    spillover = (char *) (core->buffer) + core->length;
+    spillover[0] = '\\';
+    spillover[1] = 'u';
+    // Method poached from https://metacpan.org/source/CHANSEN/Unicode-UTF8-0.60/UTF8.xs#L196
+    spillover[5] = hex[u & 0xf];
+    u >>= 4;
+    spillover[4] = hex[u & 0xf];
+    u >>= 4;
+    spillover[3] = hex[u & 0xf];
+    u >>= 4;
+    spillover[2] = hex[u & 0xf];
+    core->length += 6;
+    CORE_CHECKLENGTH;
+    return json_create_ok;
+}
+
+/* Add a "\u3000" or surrogate pair if necessary. */
+
+static INLINE json_create_status_t
+core_add_u (json_create_core_t * core, unsigned int u)
+{
+    if (u > 0xffff) {
+	/* Make a surrogate pair. */
+	u -= 0x10000;
+	CORECALL (core_add_one_u (core, 0xD800 + (u >> 10)));
+	/* Backtrace fallthrough. */
+	return core_add_one_u (core, 0xDC00 + (u & 0x3FF));
+    }
+    else {
+	/* Backtrace fallthrough. */
+	return core_add_one_u (core, u);
+    }
+}
+
+#define BADUTF8								\
+    if (core->replace_bad_utf8) {					\
+	/* We have to switch on Unicode otherwise the replacement */	\
+	/* characters don't work as intended. */			\
+	core->unicode = 1;						\
+	/* This is �, U+FFFD, as UTF-8 bytes. */			\
+	CORECALL (core_add_str_len (core, "\xEF\xBF\xBD", 3));		\
+    }									\
+    else {								\
+	core_message (core, json_create_unicode_bad_utf8,		\
+		      "Invalid UTF-8");					\
+	return json_create_unicode_bad_utf8;				\
+    }
+
+/* Jump table. Doing it this way is not the fastest possible way, but
+   it's also very difficult for a compiler to mess this
+   up. Theoretically, it would be faster to make a jump table by the
+   compiler from the switch statement, but some compilers sometimes
+   cannot do that. */
+
+/* In this enum, I use three letters as a compromise between
+   readability and formatting. The control character names are from
+   "man ascii" with an X tagged on the end. */
+
+typedef enum {
+    CTL,  // control char, escape to \u
+    BSX,  // backslash b
+    HTX,  // Tab character
+    NLX,  // backslash n, new line
+    NPX,  // backslash f
+    CRX,  // backslash r
+    ASC,  // Non-special ASCII
+    QUO,  // double quote
+    BSL,  // backslash
+    FSL,  // forward slash, "/", if escape_slash is on
+    ESC,  // ASCII the user wants escaped to \u
+    BAD,  // Invalid UTF-8 value.
+    UT2,  // UTF-8, two bytes
+    UT3,  // UTF-8, three bytes
+    UT4,  // UTF-8, four bytes
+}
+jump_t;
+
+static const unsigned char jump[0x100] = {
+    CTL,CTL,CTL,CTL,CTL,CTL,CTL,CTL,BSX,HTX,NLX,CTL,NPX,CRX,CTL,CTL,
+    CTL,CTL,CTL,CTL,CTL,CTL,CTL,CTL,CTL,CTL,CTL,CTL,CTL,CTL,CTL,CTL,
+    ASC,ASC,QUO,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,
+    ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,
+    ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,
+    ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,BSL,ASC,ASC,ASC,
+    ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,
+    ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,
+    BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,
+    BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,
+    BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,
+    BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,
+    BAD,BAD,UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,
+    UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,
+    UT3,UT3,UT3,UT3,UT3,UT3,UT3,UT3,UT3,UT3,UT3,UT3,UT3,UT3,UT3,UT3,
+    UT4,UT4,UT4,UT4,UT4,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,
+};
+
+/* The jump table to use for "core". */
+
+#define JUMP(core) ((core)->own_jump ? (core)->jump : jump)
+
+/* Need this twice, once within the ASCII handler and once within the
+   Unicode handler. */
+
+#define ASCII						\
+    case CTL:						\
+    CORECALL (core_add_one_u (core, (unsigned int) c));	\
+    i++;						\
+    break;						\
+							\
+    case BSX:						\
+    CORE_ADD ("\\b");					\
+    i++;						\
+    break;						\
+							\
+    case HTX:						\
+    CORE_ADD ("\\t");					\
+    i++;						\
+    break;						\
+							\
+    case NLX:						\
+    CORE_ADD ("\\n");					\
+    i++;						\
+    break;						\
+							\
+    case NPX:						\
+    CORE_ADD ("\\f");					\
+    i++;						\
+    break;						\
+							\
+    case CRX:						\
+    CORE_ADD ("\\r");					\
+    i++;						\
+    break;						\
+							\
+    case ASC:						\
+    CORECALL (core_add_plain (core, key,		\
+				 & i, keylen,		\
+				 utf8_ok));		\
+    break;						\
+							\
+    case QUO:						\
+    CORE_ADD ("\\\"");					\
+    i++;						\
+    break;						\
+							\
+    case FSL:						\
+    CORE_ADD ("\\/");					\
+    i++;						\
+    break;						\
+							\
+    case ESC:						\
+    CORECALL (core_add_one_u (core, (unsigned int) c));	\
+    i++;						\
+    break;						\
+							\
+    case BSL:						\
+    CORE_ADD ("\\\\");					\
+    i++;						\
+    break;
+
+
+/* Give "core" its own copy of the jump table, so that the characters
+   it escapes can be changed. */
+
+static void
+core_own_jump (json_create_core_t * core)
+{
+    if (! core->own_jump) {
+	memcpy (core->jump, jump, sizeof (jump));
+	core->own_jump = 1;
+    }
+}
+
+static void
+json_create_core_escape_slash (json_create_core_t * core, int onoff)
+{
+    core->escape_slash = onoff ? 1 : 0;
+    core_own_jump (core);
+    /* If "/" is in escape_chars it stays escaped. */
+    if (core->jump['/'] != ESC) {
+	core->jump['/'] = core->escape_slash ? FSL : ASC;
+    }
+}
+
+/* Escape the ASCII characters in "chars" as \u00XX, instead of the
+   ones given last time. The return value is false if "chars"
+   contains non-ASCII bytes, which are ignored. */
+
+static int
+json_create_core_escape_chars (json_create_core_t * core, const char * chars,
+			       size_t chars_len)
+{
+    const unsigned char * c;
+    size_t i;
+
+    core_own_jump (core);
+    for (i = 0; i < 0x80; i++) {
+	if (core->jump[i] == ESC) {
+	    core->jump[i] = (i == '/' && core->escape_slash) ? FSL : ASC;
+	}
+    }
+    c = (const unsigned char *) chars;
+    for (i = 0; i < chars_len; i++) {
+	if (c[i] >= 0x80) {
+	    return 0;
+	}
+	if (jump[c[i]] == ASC) {
+	    core->jump[c[i]] = ESC;
+	}
+    }
+    return 1;
+}
+
+/* Switch RFC 8785 canonical output on or off. When it is on, only
+   the escapes which RFC 8785 allows are used, and numbers are written
+   like ECMAScript does. Switching it off leaves the escapes as they
+   are. */
+
+static void
+json_create_core_canonical (json_create_core_t * core, int onoff)
+{
+    core->canonical = onoff ? 1 : 0;
+    if (! core->canonical) {
+	return;
+    }
+    json_create_core_escape_slash (core, 0);
+    (void) json_create_core_escape_chars (core, "", 0);
+    core->unicode_upper = 0;
+    core->unicode_escape_all = 0;
+    core->escape_non_bmp = 0;
+    core->no_javascript_safe = 1;
+}
+
+/* Get one character from the UTF-8 in "s", which has "len" bytes, and
+   return its length. Invalid UTF-8 gives the first byte. */
+
+static INLINE int
+json_create_core_utf8_char (const unsigned char * s, size_t len,
+			    uint32_t * c_ptr)
+{
+    int n;
+    int i;
+    uint32_t c;
+
+    c = s[0];
+    if (c < 0xC0) {
+	n = 1;
+    }
+    else if (c < 0xE0) {
+	n = 2;
+	c &= 0x1F;
+    }
+    else if (c < 0xF0) {
+	n = 3;
+	c &= 0x0F;
+    }
+    else {
+	n = 4;
+	c &= 0x07;
+    }
+    if ((size_t) n > len) {
+	n = 1;
+    }
+    for (i = 1; i < n; i++) {
+	if ((s[i] & 0xC0) != 0x80) {
+	    * c_ptr = s[0];
+	    return 1;
+	}
+	c = (c << 6) | (s[i] & 0x3F);
+    }
+    * c_ptr = n == 1 ? s[0] : c;
+    return n;
+}
+
+/* The first UTF-16 code unit of the character "c". */
+
+#define UTF16_FIRST(c) ((c) < 0x10000 ? (c) : 0xD800 + (((c) - 0x10000) >> 10))
+
+/* Compare the UTF-8 strings "a" and "b" in the order of their UTF-16
+   code units, which is how RFC 8785 sorts keys. This is the same as
+   the order of the bytes except that characters above U+FFFF come
+   before U+E000 to U+FFFF. */
+
+static int
+json_create_core_utf16_cmp (const unsigned char * a, size_t alen,
+			    const unsigned char * b, size_t blen)
+{
+    size_t d;
+    size_t i;
+    size_t len;
+    uint32_t ca;
+    uint32_t cb;
+
+    len = alen < blen ? alen : blen;
+    for (d = 0; d < len; d++) {
+	if (a[d] != b[d]) {
+	    break;
+	}
+    }
+    if (d == len) {
+	return (alen > blen) - (alen < blen);
+    }
+    if (a[d] < 0x80 && b[d] < 0x80) {
+	return a[d] < b[d] ? -1 : 1;
+    }
+    i = d;
+    /* Go back to the start of the character, which is the same in
+       both since everything before "i" is the same. */
+    while (i > 0 && (a[i] & 0xC0) == 0x80) {
+	i--;
+    }
+    json_create_core_utf8_char (a + i, alen - i, & ca);
+    json_create_core_utf8_char (b + i, blen - i, & cb);
+    if (UTF16_FIRST (ca) != UTF16_FIRST (cb)) {
+	return UTF16_FIRST (ca) < UTF16_FIRST (cb) ? -1 : 1;
+    }
+    /* Both are above U+FFFF, or the UTF-8 is invalid. */
+    if (ca != cb) {
+	return ca < cb ? -1 : 1;
+    }
+    return a[d] < b[d] ? -1 : 1;
+}
+
+/* Find the end of the bytes from "key + i" onwards which go into the
+   output without any change. Copying these with one "core_add_str_len"
+   rather than a byte at a time means that a long string without
+   escapes is copied straight from its SV into the output. If "utf8"
+   is false, only ASCII bytes are accepted. */
+
+static INLINE size_t
+core_plain_run (json_create_core_t * core, const unsigned char * key,
+		       size_t i, size_t keylen, int utf8)
+{
+    const unsigned char * table;
+
+    table = JUMP (core);
+    if (core->unicode_escape_all) {
+	utf8 = 0;
+    }
+    while (i < keylen) {
+	unsigned char c, d, e, f;
+	/* Most bytes are ASCII, so skip these without the switch. */
+	while (table[key[i]] == ASC) {
+	    i++;
+	    if (i >= keylen) {
+		return i;
+	    }
+	}
+	c = key[i];
+	switch (table[c]) {
+
+	case UT2:
+	    d = key[i + 1];
+	    if (! utf8 || d < 0x80 || d > 0xBF) {
+		return i;
+	    }
+	    i += 2;
+	    break;
+
+	case UT3:
+	    d = key[i + 1];
+	    e = key[i + 2];
+	    if (! utf8 || d < 0x80 || d > 0xBF || e < 0x80 || e > 0xBF) {
+		return i;
+	    }
+	    if (! core->no_javascript_safe &&
+		c == 0xe2 && d == 0x80 && (e == 0xa8 || e == 0xa9)) {
+		return i;
+	    }
+	    i += 3;
+	    break;
+
+	case UT4:
+	    d = key[i + 1];
+	    e = key[i + 2];
+	    f = key[i + 3];
+	    if (! utf8 || core->escape_non_bmp ||
+		d < 0x80 || d > (c == 0xf4 ? 0x8F : 0xBF) ||
+		e < 0x80 || e > 0xBF ||
+		f < 0x80 || f > 0xBF) {
+		return i;
+	    }
+	    i += 4;
+	    break;
+
+	default:
+	    return i;
+	}
+    }
+    return i;
+}
+
+/* Add the bytes from "key + * i_ptr" onwards which need no escaping,
+   and move "* i_ptr" past them. Short runs, the usual case in text
+   with escapes, are copied byte by byte into the buffer. Long runs
+   are copied in one go by "core_add_str_len", which sends them straight
+   to the output if they don't fit in the buffer. */
+
+static INLINE json_create_status_t
+core_add_plain (json_create_core_t * core, const unsigned char * key,
+		       size_t * i_ptr, size_t keylen, int utf8_ok)
+{
+    size_t i;
+    size_t end;
+    const unsigned char * table;
+
+    i = * i_ptr;
+    end = i + 1;
+    table = JUMP (core);
+    while (end < keylen && end - i < MARGIN && table[key[end]] == ASC) {
+	end++;
+    }
+    if (end - i < MARGIN) {
+	/* There is always room for MARGIN bytes in the buffer. */
+	while (i < end) {
+	    core->buffer[core->length] = key[i];
+	    core->length++;
+	    i++;
+	}
+	CORE_CHECKLENGTH;
+    }
+    else {
+	end = core_plain_run (core, key, end, keylen, utf8_ok);
+	CORECALL (core_add_str_len (core, (const char *) key + i, end - i));
+    }
+    * i_ptr = end;
+    return json_create_ok;
+}
+
+static INLINE json_create_status_t
+json_create_core_ascii_string (json_create_core_t * core, const unsigned char * key, size_t keylen)
+{
+    size_t i;
+    /* Runs of bytes copied as they are may only contain ASCII. */
+    const int utf8_ok = 0;
+    const unsigned char * table;
+
+    table = JUMP (core);
+
+    CORECALL (core_add_char (core, '"'));
+    for (i = 0; i < keylen; ) {
+	unsigned char c;
+
+	c = key[i];
+	switch (table[c]) {
+
+	ASCII;
+
+	default:
+	    core_message (core, json_create_non_ascii_byte,
+			  "Non-ASCII byte in non-utf8 string: %X",
+			  key[i]);
+	    return json_create_non_ascii_byte;
+	}
+    }
+    CORECALL (core_add_char (core, '"'));
+    return json_create_ok;
+}
+
+
+/* Add a string to the buffer with quotes around it and escapes for
+   the escapables. */
+
+static INLINE json_create_status_t
+json_create_core_string (json_create_core_t * core, const unsigned char * key, size_t keylen)
+{
+    size_t i;
+    const int utf8_ok = 1;
+    const unsigned char * table;
+
+    table = JUMP (core);
+
+    CORECALL (core_add_char (core, '"'));
+    for (i = 0; i < keylen; ) {
+	unsigned char c, d, e, f;
+
+	c = key[i];
+
+	switch (table[c]) {
+
+	ASCII;
+
+	case BAD:
+	    BADUTF8;
+	    i++;
+	    break;
+
+	case UT2:
+	    d = key[i + 1];
+	    if (d < 0x80 || d > 0xBF) {
+		BADUTF8;
+		i++;
+		break;
+	    }
+	    if (core->unicode_escape_all) {
+		unsigned int u;
+		u = (c & 0x1F)<<6
+		  | (d & 0x3F);
+		CORECALL (core_add_u (core, u));
+	    }
+	    else {
+		CORECALL (core_add_str_len (core, (const char *) key + i, 2));
+	    }
+	    // Increment i
+	    i += 2;
+	    break;
+
+	case UT3:
+	    d = key[i + 1];
+	    e = key[i + 2];
+	    if (d < 0x80 || d > 0xBF ||
+		e < 0x80 || e > 0xBF) {
+		BADUTF8;
+		i++;
+		break;
+	    }
+	    if (! core->no_javascript_safe &&
+		c == 0xe2 && d == 0x80 && 
+		(e == 0xa8 || e == 0xa9)) {
+		CORECALL (core_add_one_u (core, 0x2028 + e - 0xa8));
+	    }
+	    else {
+		if (core->unicode_escape_all) {
+		    unsigned int u;
+		    u = (c & 0x0F)<<12
+		      | (d & 0x3F)<<6
+		      | (e & 0x3F);
+		    CORECALL (core_add_u (core, u));
+		}
+		else {
+		    CORECALL (core_add_str_len (core, (const char *) key + i, 3));
+		}
+	    }
+	    // Increment i
+	    i += 3;
+	    break;
+
+	case UT4:
+           d = key[i + 1];
+           e = key[i + 2];
+           f = key[i + 3];
+           if (
+               // These byte values are copied from
+               // https://github.com/htacg/tidy-html5/blob/768ad46968b43e29167f4d1394a451b8c6f40b7d/src/utf8.c
+
+               // 0x40000 - 0xfffff
+               (c < 0xf4 &&
+                (d < 0x80 || d > 0xBF ||
+                 e < 0x80 || e > 0xBF ||
+                 f < 0x80 || f > 0xBF))
+               ||
+               // 0x100000 - 0x10ffff
+               (c == 0xf4 && 
+                (d < 0x80 || d > 0x8F ||
+                 e < 0x80 || e > 0xBF ||
+                 f < 0x80 || f > 0xBF))
+               ) {
+               BADUTF8;
+               i++;
+               break;
+           }
+	    if (core->unicode_escape_all || core->escape_non_bmp) {
+		unsigned int u;
+		u = (c & 0x07) << 18
+		  | (d & 0x3F) << 12
+                  | (e & 0x3F) <<  6
+                  | (f & 0x3F);
+		core_add_u (core, u);
+	    }
+	    else {
+		CORECALL (core_add_str_len (core, (const char *) key + i, 4));
+	    }
+	    // Increment i
+	    i += 4;
+	    break;
+	}
+    }
+    CORECALL (core_add_char (core, '"'));
+    return json_create_ok;
+}
+
+/* Is "key[i]" followed by "n" UTF-8 continuation bytes? */
+
+#define CONTINUED(n) (keylen - i > (n) && (key[i + (n)] & 0xC0) == 0x80)
+
+/* The number of bytes at the start of the "keylen" bytes of "key"
+   which "json_create_core_string" writes in at most "room" bytes, not
+   counting the quotes. Each character is counted as its longest
+   possible escape, and the string is only cut between characters. */
+
+static size_t
+json_create_core_string_fit (json_create_core_t * core,
+			     const unsigned char * key, size_t keylen,
+			     size_t room)
+{
+    size_t i;
+    size_t used;
+    const unsigned char * table;
+
+    table = JUMP (core);
+    used = 0;
+    i = 0;
+    while (i < keylen) {
+	/* The number of bytes in the character. */
+	size_t bytes;
+	/* The most bytes it can take in the output. */
+	size_t most;
+
+	bytes = 1;
+	switch (table[key[i]]) {
+	case ASC:
+	    most = 1;
+	    break;
+	case BSX:
+	case HTX:
+	case NLX:
+	case NPX:
+	case CRX:
+	case QUO:
+	case BSL:
+	case FSL:
+	    most = 2;
+	    break;
+	case UT2:
+	    if (CONTINUED (1)) {
+		bytes = 2;
+	    }
+	    most = 6;
+	    if (bytes == 2 && ! core->unicode_escape_all) {
+		most = 2;
+	    }
+	    break;
+	case UT3:
+	    if (CONTINUED (1) && CONTINUED (2)) {
+		bytes = 3;
+	    }
+	    most = 6;
+	    if (bytes == 3 && ! core->unicode_escape_all &&
+		core->no_javascript_safe) {
+		most = 3;
+	    }
+	    break;
+	case UT4:
+	    if (CONTINUED (1) && CONTINUED (2) && CONTINUED (3)) {
+		bytes = 4;
+		most = 12;
+		if (! core->unicode_escape_all && ! core->escape_non_bmp) {
+		    most = 4;
+		}
+	    }
+	    else {
+		most = 6;
+	    }
+	    break;
+	default:
+	    /* Control characters, ones the user wants escaped, and
+	       invalid UTF-8, which may become the replacement
+	       character. */
+	    most = 6;
+	}
+	if (used + most > room) {
+	    break;
+	}
+	used += most;
+	i += bytes;
+    }
+    return i;
+}
+
+#undef CONTINUED
+
+/* Extract the remainder of x when divided by ten and then turn it
+   into the equivalent ASCII digit. '0' in ASCII is 0x30, and (x)%10
+   is guaranteed not to have any of the high bits set. */
+
+#define DIGIT(x) (((x)%10)|0x30)
+
+/* The largest integer below which all integers can be held by a
+   double, 2^53. */
+
+#define JCMAXSAFE 9007199254740992ULL
+
+static json_create_status_t
+json_create_core_es6 (json_create_core_t * core, double fv);
+
+/* Should an integer whose absolute value is "u" be written as a
+   string? JavaScript's Number.MAX_SAFE_INTEGER is 2^53 - 1. */
+
+#define QUOTE_INT(u) \
+    (core->quote_ints || (core->quote_big_ints && (u) >= JCMAXSAFE))
+
+/* Write the digits of "uv". */
+
+static json_create_status_t
+json_create_core_digits (json_create_core_t * core, uint64_t uv)
+{
+    int uvlen;
+    char * spillover;
+
+    uvlen = 0;
+
+    /* Pointer arithmetic. */
+
+    spillover = ((char *) core->buffer) + core->length;
+
+    /* Souped-up integer printing for small integers. The following is
+       all just souped up versions of snprintf ("%d", uv);. */
+
+    if (uv < 10) {
+	/* uv has exactly one digit. The first digit may be zero. */
+	spillover[uvlen] = DIGIT (uv);
+	uvlen++;
+    }
+    else if (uv < 100) {
+	/* uv has exactly two digits. The first digit is not zero. */
+	spillover[uvlen] = DIGIT (uv/10);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv);
+	uvlen++;
+    }
+    else if (uv < 1000) {
+	/* uv has exactly three digits. The first digit is not
+	   zero. */
+	spillover[uvlen] = DIGIT (uv/100);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv/10);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv);
+	uvlen++;
+    }
+    else if (uv < 10000) {
+	/* etc. */
+	spillover[uvlen] = DIGIT (uv/1000);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv/100);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv/10);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv);
+	uvlen++;
+    }
+    else if (uv < 100000) {
+	spillover[uvlen] = DIGIT (uv/10000);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv/1000);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv/100);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv/10);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv);
+	uvlen++;
+    }
+    else if (uv < 1000000) {
+	spillover[uvlen] = DIGIT (uv/100000);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv/10000);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv/1000);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv/100);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv/10);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv);
+	uvlen++;
+    }
+    else if (uv < 10000000) {
+	spillover[uvlen] = DIGIT (uv/1000000);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv/100000);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv/10000);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv/1000);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv/100);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv/10);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv);
+	uvlen++;
+    }
+    else if (uv < 100000000) {
+	spillover[uvlen] = DIGIT (uv/10000000);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv/1000000);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv/100000);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv/10000);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv/1000);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv/100);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv/10);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv);
+	uvlen++;
+    }
+    else if (uv < 1000000000) {
+	spillover[uvlen] = DIGIT (uv/100000000);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv/10000000);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv/1000000);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv/100000);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv/10000);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv/1000);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv/100);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv/10);
+	uvlen++;
+	spillover[uvlen] = DIGIT (uv);
+	uvlen++;
+    }
+    else {
+	/* The number is one billion (1000,000,000) or more, so we're
+	   just going to print it into "core->buffer" with snprintf. */
+	uvlen += snprintf (spillover + uvlen, MARGIN - uvlen, "%" PRIu64, uv);
+	if (uvlen >= MARGIN) {
+	    return json_create_number_too_long;
+	}
+    }
+    core->length += uvlen;
+    CORE_CHECKLENGTH;
+    return json_create_ok;
+}
+
+static json_create_status_t
+json_create_core_uint (json_create_core_t * core, uint64_t uv)
+{
+    if (QUOTE_INT (uv)) {
+	CORECALL (core_add_char (core, '"'));
+	CORECALL (json_create_core_digits (core, uv));
+	return core_add_char (core, '"');
+    }
+    if (core->canonical && uv > JCMAXSAFE) {
+	/* RFC 8785 numbers are doubles. */
+	return json_create_core_es6 (core, (double) uv);
+    }
+    return json_create_core_digits (core, uv);
+}
+
+static json_create_status_t
+json_create_core_int (json_create_core_t * core, int64_t iv)
+{
+    uint64_t uv;
+
+    if (iv >= 0) {
+	return json_create_core_uint (core, (uint64_t) iv);
+    }
+    /* Going via unsigned avoids overflow for the most negative
+       number. */
+    uv = (uint64_t) 0 - (uint64_t) iv;
+    if (QUOTE_INT (uv)) {
+	CORECALL (core_add_char (core, '"'));
+	CORECALL (core_add_char (core, '-'));
+	CORECALL (json_create_core_digits (core, uv));
+	return core_add_char (core, '"');
+    }
+    if (core->canonical && uv > JCMAXSAFE) {
+	return json_create_core_es6 (core, (double) iv);
+    }
+    /* There is always room for the minus sign. */
+    core->buffer[core->length] = '-';
+    core->length++;
+    return json_create_core_digits (core, uv);
+}
+
+/* Exact powers of ten. Doubles can hold up to 10^22 exactly. */
+
+#define JCMAXPOW10 22
+
+static const double json_create_pow10[JCMAXPOW10 + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static const uint64_t json_create_upow10[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+    10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+    100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL, 1000000000000000000ULL,
+};
+
+/* Beyond this, "double" can't hold halves, so the rounding below
+   doesn't work. */
+
+#define JCMAXSCALED 4503599627370496.0 /* 2^52 */
+
+/* The largest precision for 'e' and 'g', so that the digits fit
+   under JCMAXSCALED, and for 'f', so that the digits after the
+   decimal point fit in "json_create_upow10". */
+
+#define JCMAXEPRECISION 14
+#define JCMAXFPRECISION 18
+
+/* Round the exact value of "a * 10^k", where "a" is not negative, to
+   an integer in "* r_ptr", with halves going to the even number, the
+   same as printf does. The return value is false if the result is
+   out of range and snprintf needs to be used.
+
+   The product is rounded when it is calculated, so fma gets the part
+   which was lost. The part which was lost is less than half a unit in
+   the last place of "scaled", so it can only change the rounding
+   when the fraction of "scaled" is exactly one half. */
+
+static int
+json_create_core_round (double a, int k, uint64_t * r_ptr)
+{
+    double scaled;
+    double lost;
+    double whole;
+    double fraction;
+    uint64_t r;
+
+    if (k > JCMAXPOW10 || k < - JCMAXPOW10) {
+	return 0;
+    }
+    if (k >= 0) {
+	scaled = a * json_create_pow10[k];
+	lost = fma (a, json_create_pow10[k], - scaled);
+    }
+    else {
+	scaled = a / json_create_pow10[-k];
+	/* The sign of this is the sign of what was lost. */
+	lost = - fma (scaled, json_create_pow10[-k], - a);
+    }
+    if (! (scaled < JCMAXSCALED)) {
+	return 0;
+    }
+    whole = floor (scaled);
+    fraction = scaled - whole;
+    r = (uint64_t) whole;
+    if (fraction > 0.5 ||
+	(fraction == 0.5 && (lost > 0.0 || (lost == 0.0 && (r & 1))))) {
+	r++;
+    }
+    * r_ptr = r;
+    return 1;
+}
+
+/* Find the digits "* r_ptr" and the exponent "* x_ptr" of "a" with
+   "precision" digits after the decimal point, as in "%.<precision>e",
+   so that "a" is about "* r_ptr * 10^(* x_ptr - precision)". "a" is
+   positive. */
+
+static int
+json_create_core_exponent (double a, int precision, uint64_t * r_ptr,
+			   int * x_ptr)
+{
+    int x;
+    int tries;
+    uint64_t r;
+
+    /* log10 may be one out near powers of ten, and rounding may
+       carry into a new digit, so correct it by looking at the
+       digits. */
+    x = (int) floor (log10 (a));
+    for (tries = 0; tries < 3; tries++) {
+	if (! json_create_core_round (a, precision - x, & r)) {
+	    return 0;
+	}
+	if (r >= json_create_upow10[precision + 1]) {
+	    x++;
+	}
+	else if (r < json_create_upow10[precision]) {
+	    x--;
+	}
+	else {
+	    * r_ptr = r;
+	    * x_ptr = x;
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+/* Print "r / 10^decimals" into "p", with "decimals" digits after the
+   decimal point. If "trim" is set, remove trailing zeros and the
+   decimal point, as "%g" does. Return the end of the output. */
+
+static char *
+json_create_core_fixed (char * p, uint64_t r, int decimals, int trim)
+{
+    uint64_t whole;
+    uint64_t fraction;
+    int digits;
+    int i;
+
+    whole = r / json_create_upow10[decimals];
+    fraction = r % json_create_upow10[decimals];
+    if (trim) {
+	while (decimals > 0 && fraction % 10 == 0) {
+	    fraction /= 10;
+	    decimals--;
+	}
+    }
+    digits = 1;
+    while (digits <= JCMAXFPRECISION &&
+	   whole >= json_create_upow10[digits]) {
+	digits++;
+    }
+    for (i = digits - 1; i >= 0; i--) {
+	p[i] = DIGIT (whole);
+	whole /= 10;
+    }
+    p += digits;
+    if (decimals > 0) {
+	* p = '.';
+	p++;
+	for (i = decimals - 1; i >= 0; i--) {
+	    p[i] = DIGIT (fraction);
+	    fraction /= 10;
+	}
+	p += decimals;
+    }
+    return p;
+}
+
+/* Print the exponent "x" of "%e" into "p", with at least two digits
+   like printf. */
+
+static char *
+json_create_core_exp (char * p, char e, int x)
+{
+    * p++ = e;
+    if (x < 0) {
+	* p++ = '-';
+	x = -x;
+    }
+    else {
+	* p++ = '+';
+    }
+    if (x >= 100) {
+	* p++ = DIGIT (x / 100);
+    }
+    * p++ = DIGIT (x / 10);
+    * p++ = DIGIT (x);
+    return p;
+}
+
+/* Print "fv", which is finite, into "buf" in the way that
+   "%.<precision>f", "%.<precision>e" or "%.<precision>g" would, but
+   without snprintf for the floating point part, and always with a
+   "." whatever the locale is. The return value is the length, or zero
+   if "fv" is out of the range that this can do. */
+
+static int
+json_create_core_fast_double (char * buf, double fv, char conversion,
+			      int precision, char e)
+{
+    char * p;
+    double a;
+    uint64_t r;
+    int x;
+    int digits;
+
+    p = buf;
+    a = fv;
+    if (signbit (fv)) {
+	* p++ = '-';
+	a = -fv;
+    }
+    switch (conversion) {
+    case 'f':
+	if (! json_create_core_round (a, precision, & r)) {
+	    return 0;
+	}
+	p = json_create_core_fixed (p, r, precision, 0);
+	break;
+    case 'e':
+	if (a == 0.0) {
+	    r = 0;
+	    x = 0;
+	}
+	else if (! json_create_core_exponent (a, precision, & r, & x)) {
+	    return 0;
+	}
+	p = json_create_core_fixed (p, r, precision, 0);
+	p = json_create_core_exp (p, e, x);
+	break;
+    case 'g':
+	digits = precision ? precision : 1;
+	if (a == 0.0) {
+	    * p++ = '0';
+	    break;
+	}
+	if (! json_create_core_exponent (a, digits - 1, & r, & x)) {
+	    return 0;
+	}
+	if (x < digits && x >= -4) {
+	    /* The digits are the same as "%.<digits - 1 - x>f". */
+	    p = json_create_core_fixed (p, r, digits - 1 - x, 1);
+	}
+	else {
+	    p = json_create_core_fixed (p, r, digits - 1, 1);
+	    p = json_create_core_exp (p, e, x);
+	}
+	break;
+    default:
+	return 0;
+    }
+    return p - buf;
+}
+
+/* Use "fformat" to print floating point numbers. If it is one of
+   "%f", "%e" or "%g", with or without a precision, such as "%.2f",
+   then the numbers are printed by json_create_core_fast_double rather
+   than snprintf. "fformat" is not copied. The return value is true if
+   "fformat" can be printed without snprintf. */
+
+static int
+json_create_core_fformat (json_create_core_t * core, const char * fformat)
+{
+    const char * f;
+    int precision;
+
+    core->fformat = fformat;
+    core->fconversion = 0;
+    if (! fformat) {
+	fformat = "%g";
+    }
+    f = fformat;
+    if (* f != '%') {
+	return 0;
+    }
+    f++;
+    precision = 6;
+    if (* f == '.') {
+	f++;
+	precision = 0;
+	while (* f >= '0' && * f <= '9') {
+	    precision = precision * 10 + (* f - '0');
+	    if (precision > JCMAXPOW10) {
+		return 0;
+	    }
+	    f++;
+	}
+    }
+    switch (* f) {
+    case 'f':
+    case 'F':
+	core->fconversion = 'f';
+	break;
+    case 'e':
+    case 'g':
+	core->fconversion = * f;
+	core->fexponent = 'e';
+	break;
+    case 'E':
+    case 'G':
+	core->fconversion = * f - 'A' + 'a';
+	core->fexponent = 'E';
+	break;
+    default:
+	return 0;
+    }
+    if (f[1] != '\0' ||
+	(core->fconversion == 'f' && precision > JCMAXFPRECISION) ||
+	(core->fconversion == 'e' && precision > JCMAXEPRECISION) ||
+	(core->fconversion == 'g' && precision > JCMAXEPRECISION + 1)) {
+	core->fconversion = 0;
+	return 0;
+    }
+    core->fprecision = precision;
+    return 1;
+}
+
+/* Put the shortest digits which give back "a", which is positive and
+   finite, when read in, into "digits", and return how many there
+   are. "* point_ptr" is where the decimal point goes, counting from
+   the start of "digits", so "a" is "0.<digits> * 10^(* point_ptr)".
+   Where there is more than one, the closest to "a" is chosen, and
+   the even one of two equally close ones. This is the algorithm of
+   ECMAScript's Number.prototype.toString. */
+
+/* Does "c * 10^e" give back "a" when read in? */
+
+static int
+json_create_core_reads_back (uint64_t c, int e, double a)
+{
+    double back;
+    char buf[0x20];
+
+    /* If "c" and "10^e" are exact, one multiplication or division
+       reads it back in the same way as strtod. */
+    if (c < JCMAXSAFE && e <= JCMAXPOW10 && e >= - JCMAXPOW10) {
+	if (e >= 0) {
+	    back = (double) c * json_create_pow10[e];
+	}
+	else {
+	    back = (double) c / json_create_pow10[-e];
+	}
+	return back == a;
+    }
+    snprintf (buf, sizeof (buf), "%" PRIu64 "e%d", c, e);
+    return strtod (buf, 0) == a;
+}
+
+static int
+json_create_core_shortest (double a, char * digits, int * point_ptr)
+{
+    /* The nearest digits, and the ones next to them. When the nearest
+       digits don't give back "a", the ones on the other side of "a"
+       sometimes do, and nothing else with as few digits can. */
+    static const int steps[3] = {0, 1, -1};
+    int p;
+    int x;
+    int e;
+    int j;
+    int k;
+    int i;
+    uint64_t r;
+    uint64_t c;
+    char buf[0x20];
+
+    /* Seventeen digits always give back the same double, so this
+       stops with "p" at sixteen at the latest. */
+    for (p = 0; p <= 16; p++) {
+	if (p > JCMAXEPRECISION ||
+	    ! json_create_core_exponent (a, p, & r, & x)) {
+	    /* "buf" is "d.ddde+xx", or "de+xx" if "p" is zero. */
+	    snprintf (buf, sizeof (buf), "%.*e", p, a);
+	    r = 0;
+	    for (i = 0; buf[i] != 'e'; i++) {
+		if (buf[i] != '.') {
+		    r = r * 10 + (buf[i] - '0');
+		}
+	    }
+	    x = (int) strtol (buf + i + 1, 0, 10);
+	}
+	/* "c * 10^e" is a number with about p + 1 digits. */
+	e = x - p;
+	for (j = 0; j < 3; j++) {
+	    c = r + steps[j];
+	    if (c == 0 ||
+		(p < 16 && ! json_create_core_reads_back (c, e, a))) {
+		continue;
+	    }
+	    /* Carrying or borrowing may have changed the number of
+	       digits. */
+	    k = 1;
+	    while (k < 19 && c >= json_create_upow10[k]) {
+		k++;
+	    }
+	    for (i = k - 1; i >= 0; i--) {
+		digits[i] = DIGIT (c);
+		c /= 10;
+	    }
+	    * point_ptr = e + k;
+	    while (k > 1 && digits[k - 1] == '0') {
+		k--;
+	    }
+	    return k;
+	}
+    }
+    /* Not reached, since "p" at sixteen always stops. */
+    * point_ptr = 0;
+    return 0;
+}
+
+/* Print "fv", which is finite, in the way that ECMAScript's
+   Number.prototype.toString does, as RFC 8785 requires. */
+
+static json_create_status_t
+json_create_core_es6 (json_create_core_t * core, double fv)
+{
+    char digits[0x20];
+    char * p;
+    int k;
+    int n;
+    int i;
+
+    p = (char *) core->buffer + core->length;
+    if (fv == 0.0) {
+	/* This includes minus zero. */
+	* p = '0';
+	core->length++;
+	CORE_CHECKLENGTH;
+	return json_create_ok;
+    }
+    if (fv < 0.0) {
+	* p++ = '-';
+	fv = -fv;
+    }
+    k = json_create_core_shortest (fv, digits, & n);
+    if (k <= n && n <= 21) {
+	/* An integer, with zeros added. */
+	memcpy (p, digits, k);
+	p += k;
+	for (i = k; i < n; i++) {
+	    * p++ = '0';
+	}
+    }
+    else if (0 < n && n <= 21) {
+	memcpy (p, digits, n);
+	p += n;
+	* p++ = '.';
+	memcpy (p, digits + n, k - n);
+	p += k - n;
+    }
+    else if (-6 < n && n <= 0) {
+	* p++ = '0';
+	* p++ = '.';
+	for (i = n; i < 0; i++) {
+	    * p++ = '0';
+	}
+	memcpy (p, digits, k);
+	p += k;
+    }
+    else {
+	* p++ = digits[0];
+	if (k > 1) {
+	    * p++ = '.';
+	    memcpy (p, digits + 1, k - 1);
+	    p += k - 1;
+	}
+	/* Unlike printf, the exponent has no leading zeros. */
+	* p++ = 'e';
+	* p++ = n - 1 < 0 ? '-' : '+';
+	n = abs (n - 1);
+	if (n >= 100) {
+	    * p++ = DIGIT (n / 100);
+	}
+	if (n >= 10) {
+	    * p++ = DIGIT (n / 10);
+	}
+	* p++ = DIGIT (n);
+    }
+    core->length = p - (char *) core->buffer;
+    CORE_CHECKLENGTH;
+    return json_create_ok;
+}
+
+/* Print a floating point number using "core->fformat". Infinities
+   and NaNs become the strings "inf", "-inf" and "nan". */
+
+static json_create_status_t
+json_create_core_double (json_create_core_t * core, double fv)
+{
+    int fvlen;
+    const char * fformat;
+
+    if (core->canonical) {
+	if (! isfinite (fv)) {
+	    core_message (core, json_create_non_finite_number,
+			  "Non-finite number in input");
+	    return json_create_non_finite_number;
+	}
+	return json_create_core_es6 (core, fv);
+    }
+    if (isfinite (fv)) {
+	fformat = core->fformat;
+	if (! fformat) {
+	    /* This is what json_create_core_fformat gives for zero. */
+	    fvlen = json_create_core_fast_double
+		((char *) core->buffer + core->length, fv, 'g', 6, 'e');
+	    fformat = "%g";
+	}
+	else if (core->fconversion) {
+	    fvlen = json_create_core_fast_double
+		((char *) core->buffer + core->length, fv, core->fconversion,
+		 core->fprecision, core->fexponent);
+	}
+	else {
+	    fvlen = 0;
+	}
+	if (fvlen == 0) {
+	    fvlen = snprintf ((char *) core->buffer + core->length, MARGIN,
+			      fformat, fv);
+	    if (fvlen < 0 || fvlen >= MARGIN) {
+		return json_create_number_too_long;
+	    }
+	}
+	core->length += fvlen;
+	CORE_CHECKLENGTH;
+    }
+    else if (isnan (fv)) {
+	CORE_ADD ("\"nan\"");
+    }
+    else if (isinf (fv)) {
+	if (fv < 0.0) {
+	    CORE_ADD ("\"-inf\"");
+	}
+	else {
+	    CORE_ADD ("\"inf\"");
+	}
+    }
+    else {
+	return json_create_unknown_floating_point;
+    }
+    return json_create_ok;
+}
+
+/* __     ___     _ _             
+   \ \   / (_)___(_) |_ ___  _ __ 
+    \ \ / /| / __| | __/ _ \| '__|
+     \ V / | \__ \ | || (_) | |   
+      \_/  |_|___/_|\__\___/|_|    */
+
+/* The visitor is for C programs which use the core without Perl. The
+   XS module walks Perl's data itself in "json-create-perl.c", so it
+   leaves this out. */
+
+#ifndef PERL_VERSION
+
+/* The types of value which a visitor can give. */
+
+typedef enum {
+    json_create_value_null,
+    json_create_value_true,
+    json_create_value_false,
+    json_create_value_int,
+    json_create_value_uint,
+    json_create_value_double,
+    json_create_value_string,
+    json_create_value_array,
+    json_create_value_object,
+}
+json_create_value_type_t;
+
+/* A visitor's description of one value. */
+
+typedef struct json_create_value {
+    json_create_value_type_t type;
+    /* The number, for json_create_value_int, _uint and _double. */
+    int64_t i;
+    uint64_t u;
+    double d;
+    /* The UTF-8 bytes of a json_create_value_string. */
+    const char * s;
+    /* The length of "s", or the number of entries of an array or
+       object. */
+    size_t n;
+}
+json_create_value_t;
+
+/* How "json_create_core_visit" finds its way around the user's
+   data. The nodes are whatever the user wants them to be. */
+
+typedef struct json_create_visitor {
+    /* Describe "node" in "* value". */
+    json_create_status_t (* value) (void * user, void * node,
+				    json_create_value_t * value);
+    /* Put entry "i" of the array or object "node" into "* child_ptr",
+       and for an object, describe its key, which must be a string, in
+       "* key". */
+    json_create_status_t (* entry) (void * user, void * node, size_t i,
+				    json_create_value_t * key,
+				    void ** child_ptr);
+    /* Passed to "value" and "entry". */
+    void * user;
+    /* Maximum nesting of arrays and objects, or zero for no limit. */
+    unsigned int max_depth;
+}
+json_create_visitor_t;
+
+/* One array or object which is in the middle of being written. */
+
+typedef struct json_create_core_frame {
+    void * node;
+    /* The number of entries. */
+    size_t n;
+    /* The next entry to write. */
+    size_t i;
+    /* Is this an object? */
+    int object;
+}
+json_create_core_frame_t;
+
+/* The number of frames which fit on the C stack before we need to
+   allocate memory. */
+
+#define JCCFRAMES 0x40
+
+typedef struct json_create_core_stack {
+    json_create_core_frame_t * frames;
+    size_t n_frames;
+    size_t max_frames;
+    /* The frames on the C stack. */
+    json_create_core_frame_t local[JCCFRAMES];
+}
+json_create_core_stack_t;
+
+/* Write the value "node", or if it is an array or object, write the
+   opening bracket and push it on to "stack". */
+
+static json_create_status_t
+core_visit_node (json_create_core_t * core, const json_create_visitor_t * v,
+		 json_create_core_stack_t * stack, void * node)
+{
+    json_create_value_t value = {0};
+    json_create_core_frame_t * frame;
+
+    CORECALL ((* v->value) (v->user, node, & value));
+    switch (value.type) {
+    case json_create_value_null:
+	CORE_ADD ("null");
+	break;
+    case json_create_value_true:
+	CORE_ADD ("true");
+	break;
+    case json_create_value_false:
+	CORE_ADD ("false");
+	break;
+    case json_create_value_int:
+	CORECALL (json_create_core_int (core, value.i));
+	break;
+    case json_create_value_uint:
+	CORECALL (json_create_core_uint (core, value.u));
+	break;
+    case json_create_value_double:
+	CORECALL (json_create_core_double (core, value.d));
+	break;
+    case json_create_value_string:
+	CORECALL (json_create_core_string (core,
+					   (const unsigned char *) value.s,
+					   value.n));
+	break;
+    case json_create_value_array:
+    case json_create_value_object:
+	if (value.n == 0) {
+	    CORE_ADD (value.type == json_create_value_array ? "[]" : "{}");
+	    break;
+	}
+	if (v->max_depth > 0 && stack->n_frames >= v->max_depth) {
+	    core_message (core, json_create_too_deep,
+			  "Input is nested more deeply than max_depth=%u",
+			  v->max_depth);
+	    return json_create_too_deep;
+	}
+	if (stack->n_frames >= stack->max_frames) {
+	    json_create_core_frame_t * more;
+	    size_t max_frames;
+	    max_frames = 2 * stack->max_frames;
+	    if (stack->frames == stack->local) {
+		more = malloc (max_frames * sizeof (* more));
+		if (more) {
+		    memcpy (more, stack->local, sizeof (stack->local));
+		}
+	    }
+	    else {
+		more = realloc (stack->frames, max_frames * sizeof (* more));
+	    }
+	    if (! more) {
+		return json_create_no_memory;
+	    }
+	    stack->frames = more;
+	    stack->max_frames = max_frames;
+	}
+	frame = stack->frames + stack->n_frames;
+	stack->n_frames++;
+	frame->node = node;
+	frame->n = value.n;
+	frame->i = 0;
+	frame->object = (value.type == json_create_value_object);
+	CORECALL (core_add_char (core, frame->object ? '{' : '['));
+	break;
+    default:
+	return json_create_unknown_type;
+    }
+    return json_create_ok;
+}
+
+/* Write the next part of the array or object at the top of
+   "stack". */
+
+static json_create_status_t
+core_visit_next (json_create_core_t * core, const json_create_visitor_t * v,
+		 json_create_core_stack_t * stack)
+{
+    json_create_core_frame_t * frame;
+    json_create_value_t key = {0};
+    void * child;
+
+    frame = stack->frames + stack->n_frames - 1;
+    if (frame->i == frame->n) {
+	stack->n_frames--;
+	return core_add_char (core, frame->object ? '}' : ']');
+    }
+    if (frame->i > 0) {
+	CORECALL (core_add_char (core, ','));
+    }
+    child = 0;
+    CORECALL ((* v->entry) (v->user, frame->node, frame->i, & key, & child));
+    frame->i++;
+    if (frame->object) {
+	if (key.type != json_create_value_string) {
+	    return json_create_unknown_type;
+	}
+	CORECALL (json_create_core_string (core,
+					   (const unsigned char *) key.s,
+					   key.n));
+	CORECALL (core_add_char (core, ':'));
+    }
+    return core_visit_node (core, v, stack, child);
+}
+
+/* Write the user's data starting from "root" as JSON, using "v" to
+   find out what it is. This doesn't recurse on the C stack, so the
+   nesting depth is only limited by memory, or by "v->max_depth". The
+   last part of the output is still in the buffer, so call
+   "json_create_core_fill" afterwards. */
+
+static json_create_status_t
+json_create_core_visit (json_create_core_t * core,
+			const json_create_visitor_t * v, void * root)
+{
+    json_create_core_stack_t stack;
+    json_create_status_t status;
+
+    stack.frames = stack.local;
+    stack.n_frames = 0;
+    stack.max_frames = JCCFRAMES;
+    status = core_visit_node (core, v, & stack, root);
+    while (status == json_create_ok && stack.n_frames > 0) {
+	status = core_visit_next (core, v, & stack);
+    }
+    if (stack.frames != stack.local) {
+	free (stack.frames);
+    }
+    return status;
+}
+
+#endif /* ndef PERL_VERSION */
@@ -0,0 +1,236 @@
+/*
+   This is the chunk-at-a-time encoder of JSON::Create,
+   JSON::Create::Encoder.
+
+   It's kept in a separate file but #included into the main file,
+   Create.xs, after "json-create-perl.c". It writes out the input
+   using the same stack of frames as "json_create_traverse", but the
+   frames are kept between calls, so that the traversal can stop
+   whenever enough output has been made and carry on later.
+*/
+
+typedef struct json_create_encoder {
+    /* A copy of the options of the JSON::Create object which made
+       this, with its own buffer and output. */
+    json_create_t * jc;
+    /* The buffer of "jc". */
+    unsigned char * buffer;
+    /* The input, which we hold a reference to. */
+    SV * input;
+    /* Output which was made but didn't fit into the last chunk. */
+    SV * pending;
+    /* The top-level value has been started. */
+    unsigned int started : 1;
+    /* All of the output has been given to the user. */
+    unsigned int done : 1;
+    /* We are in the middle of "next_chunk". If this is set at the
+       start of "next_chunk", the previous call croaked. */
+    unsigned int busy : 1;
+}
+json_create_encoder_t;
+
+#define ENCODER_ERROR(msg) croak ("JSON::Create::Encoder: %s", msg)
+
+/* Make "* copy_ptr" a copy of the options of "jc", with its own
+   references to the handlers, so that changing "jc" doesn't affect
+   an encoder which is part of the way through. */
+
+static json_create_status_t
+json_create_copy_options (json_create_t * jc, json_create_t ** copy_ptr)
+{
+    json_create_t * copy;
+
+    Newx (copy, 1, json_create_t);
+    * copy = * jc;
+    copy->n_mallocs = 1;
+    copy->fformat = 0;
+    copy->handlers = 0;
+    copy->type_handler = 0;
+    copy->obj_handler = 0;
+    copy->non_finite_handler = 0;
+    copy->cmp = 0;
+    copy->include_keys = 0;
+    copy->exclude_keys = 0;
+    copy->obj_keys = 0;
+    copy->cache = 0;
+    copy->memo = 0;
+    if (jc->fformat) {
+	copy->fformat = savepv (jc->fformat);
+	copy->n_mallocs++;
+    }
+    json_create_core_fformat (& copy->core, copy->fformat);
+    if (jc->handlers) {
+	copy->handlers = newHVhv (jc->handlers);
+	copy->n_mallocs++;
+    }
+    if (jc->type_handler) {
+	set_type_handler (copy, jc->type_handler);
+    }
+    if (jc->obj_handler) {
+	set_object_handler (copy, jc->obj_handler);
+    }
+    if (jc->non_finite_handler) {
+	set_non_finite_handler (copy, jc->non_finite_handler);
+    }
+    if (jc->cmp) {
+	copy->cmp = jc->cmp;
+	bump (copy, jc->cmp);
+    }
+    /* These are replaced rather than changed, so the copy can share
+       them. */
+    if (jc->include_keys) {
+	copy->include_keys = jc->include_keys;
+	bump (copy, (SV *) jc->include_keys);
+    }
+    if (jc->exclude_keys) {
+	copy->exclude_keys = jc->exclude_keys;
+	bump (copy, (SV *) jc->exclude_keys);
+    }
+    if (jc->obj_keys) {
+	copy->obj_keys = newHVhv (jc->obj_keys);
+	copy->n_mallocs++;
+    }
+    if (jc->cache) {
+	copy->cache = jc->cache;
+	bump (copy, (SV *) jc->cache);
+    }
+    * copy_ptr = copy;
+    return json_create_ok;
+}
+
+static json_create_status_t
+json_create_encoder_new (json_create_t * parent, SV * input,
+			 json_create_encoder_t ** e_ptr)
+{
+    json_create_encoder_t * e;
+    json_create_t * jc;
+
+    Newxz (e, 1, json_create_encoder_t);
+    CALL (json_create_copy_options (parent, & e->jc));
+    jc = e->jc;
+    Newx (e->buffer, BUFSIZE, unsigned char);
+    jc->n_mallocs++;
+    json_create_buffer_init (jc, e->buffer);
+    jc->output = 0;
+    jc->core.unicode = 0;
+    jc->utf8_dangerous = 0;
+    jc->in_cache = 0;
+    jc->n_output = 0;
+    jc->output_full = 0;
+    /* As with JSON::Create::Writer, we can't carry on after errors,
+       so they are always fatal. */
+    jc->fatal_errors = 1;
+#ifdef INDENT
+    jc->depth = 0;
+#endif /* def INDENT */
+#ifdef HAVE_ZLIB
+    jc->zstream = 0;
+#endif /* def HAVE_ZLIB */
+    jc->frames_sv = newSV (JCFRAMES * sizeof (json_create_frame_t));
+    jc->n_mallocs++;
+    jc->frames = (json_create_frame_t *) SvPVX (jc->frames_sv);
+    jc->n_frames = 0;
+    jc->max_frames = JCFRAMES;
+    jc->active = 0;
+    e->input = input;
+    bump (jc, input);
+    * e_ptr = e;
+    return json_create_ok;
+}
+
+static json_create_status_t
+json_create_encoder_free (json_create_encoder_t * e)
+{
+    json_create_t * jc;
+
+    jc = e->jc;
+    json_create_unwind (jc);
+    if (jc->active) {
+	SvREFCNT_dec ((SV *) jc->active);
+	jc->active = 0;
+	jc->n_mallocs--;
+    }
+    SvREFCNT_dec (jc->frames_sv);
+    jc->frames_sv = 0;
+    jc->frames = 0;
+    jc->n_mallocs--;
+    if (jc->output && jc->output != & PL_sv_undef) {
+	SvREFCNT_dec (jc->output);
+    }
+    jc->output = 0;
+    if (e->pending) {
+	SvREFCNT_dec (e->pending);
+	e->pending = 0;
+    }
+    SvREFCNT_dec (e->input);
+    jc->n_mallocs--;
+    Safefree (e->buffer);
+    jc->n_mallocs--;
+    CALL (json_create_free (jc));
+    Safefree (e);
+    return json_create_ok;
+}
+
+/* Write until there are "max_bytes" of output, or the input is
+   finished, and put the output into "* chunk_ptr". The chunk is never
+   longer than "max_bytes"; anything over that is kept in
+   "e->pending" and goes into the next chunk. At the end, "*
+   chunk_ptr" is the undefined value. */
+
+static json_create_status_t
+json_create_encoder_next_chunk (json_create_encoder_t * e, STRLEN max_bytes,
+				SV ** chunk_ptr)
+{
+    json_create_t * jc;
+    SV * chunk;
+
+    jc = e->jc;
+    if (e->busy) {
+	ENCODER_ERROR ("output abandoned after error");
+    }
+    if (e->done) {
+	* chunk_ptr = & PL_sv_undef;
+	return json_create_ok;
+    }
+    if (max_bytes == 0) {
+	max_bytes = BUFSIZE;
+    }
+    e->busy = 1;
+    if (e->pending) {
+	jc->output = e->pending;
+	e->pending = 0;
+    }
+    if (! e->started) {
+	e->started = 1;
+	CALL (json_create_value (jc, e->input));
+    }
+    while (jc->n_frames > 0) {
+	STRLEN so_far;
+	so_far = (STRLEN) jc->core.length;
+	if (jc->output && jc->output != & PL_sv_undef) {
+	    so_far += SvCUR (jc->output);
+	}
+	if (so_far >= max_bytes) {
+	    break;
+	}
+	CALL (json_create_next (jc));
+    }
+    CALL (json_create_buffer_fill (jc));
+    chunk = jc->output;
+    jc->output = 0;
+    if (! chunk || chunk == & PL_sv_undef) {
+	chunk = newSVpvs ("");
+    }
+    if (SvCUR (chunk) > max_bytes) {
+	e->pending = newSVpvn (SvPVX (chunk) + max_bytes,
+			       SvCUR (chunk) - max_bytes);
+	SvCUR_set (chunk, max_bytes);
+	* SvEND (chunk) = '\0';
+    }
+    if (jc->n_frames == 0 && ! e->pending) {
+	e->done = 1;
+    }
+    * chunk_ptr = chunk;
+    e->busy = 0;
+    return json_create_ok;
+}
@@ -5,64 +5,109 @@
    Create.xs.
 */
 
-#ifdef __GNUC__
-#define INLINE inline
+/* HAVE_ZLIB is defined by Makefile.PL if it finds zlib. */
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif /* def HAVE_ZLIB */
+
+/* HAVE_SDT is defined by Makefile.PL if it finds <sys/sdt.h>. The
+   probes are a single "nop" instruction each until a tracer such as
+   bpftrace attaches to them, for example
+
+   bpftrace -e 'usdt:.../Create.so:json_create:create__done {...}'
+
+   The probes and their arguments are
+
+   create__start (input SV) and create__done (output length),
+   around each call to "json_create_create",
+   flush (length), when the buffer is copied to the output,
+   handler__start (class name) and handler__done (class name),
+   around each call of a user routine, where the class name is zero
+   if the argument is not an object,
+   sort__start (number of keys) and sort__done (number of keys),
+   around the sorting of the keys of a hash, and
+   error (status), when "json_create_create" fails. */
+
+#ifdef HAVE_SDT
+#include <sys/sdt.h>
+#define JCPROBE1(name, a) DTRACE_PROBE1 (json_create, name, a)
 #else
-#define INLINE
-#endif /* __GNUC__ */
+#define JCPROBE1(name, a)
+#endif /* def HAVE_SDT */
+
+#include <float.h>
+
+#define INDENT
 
-/* These are return statuses for the types of failures which can
-   occur. */
+/* The kinds of container which can be on the stack of frames. */
 
 typedef enum {
-    json_create_ok,
-
-    /* The following set of exceptions indicate something went wrong
-       in JSON::Create's code, in other words bugs. */
-
-    /* An error from the unicode.c library. */
-    json_create_unicode_error,
-    /* A printed number turned out to be longer than MARGIN bytes. */
-    json_create_number_too_long,
-    /* Unknown type of floating point number. */
-    json_create_unknown_floating_point,
-    /* Bad format for floating point. */
-    json_create_bad_floating_format,
-
-    /* The following set of exceptions indicate bad input, in other
-       words these are user-generated exceptions. */
-
-    /* Badly-formatted UTF-8. */
-    json_create_unicode_bad_utf8,
-    /* Unknown Perl svtype within the structure. */
-    json_create_unknown_type,
-    /* User's routine returned invalid stuff. */
-    json_create_invalid_user_json,
-    /* User gave us an undefined value from a user subroutine. */
-    json_create_undefined_return_value,
-    /* Rejected non-ASCII, non-character string in strict mode. */
-    json_create_non_ascii_byte,
-    /* Rejected scalar reference in strict mode. */
-    json_create_scalar_reference,
-    /* Rejected non-finite number in strict mode. */
-    json_create_non_finite_number,
-}
-json_create_status_t;
-
-#define BUFSIZE 0x4000
-
-/* MARGIN is the size of the "spillover" area where we can print
-   numbers or Unicode UTF-8 whole characters (runes) into the buffer
-   without having to check the printed length after each byte. */
-
-#define MARGIN 0x40
+    json_create_frame_array,
+    json_create_frame_object,
+    json_create_frame_sorted,
+}
+json_create_frame_type_t;
 
-#define INDENT
+/* The kinds of output. */
+
+typedef enum {
+    json_create_format_json,
+    /* RFC 8949 Concise Binary Object Representation. */
+    json_create_format_cbor,
+    /* MessagePack. */
+    json_create_format_msgpack,
+    json_create_n_formats,
+}
+json_create_format_t;
+
+/* The names of the formats for the "format" option. */
+
+static const char * json_create_formats[json_create_n_formats] = {
+    "json",
+    "cbor",
+    "msgpack",
+};
+
+/* One array or hash which is in the middle of being written out. */
+
+typedef struct json_create_frame {
+    /* The AV or HV. */
+    SV * sv;
+    /* The keys of a hash in the order to write them, for "sort" and
+       the key filters. */
+    SV ** keys;
+    /* The number of entries in "sv". This is not an I32, since
+       arrays can have more entries than that. */
+    SSize_t n_keys;
+    /* The next entry of "sv" to write. */
+    SSize_t i;
+    /* The number of entries written, which is less than "i" if
+       "skip_undef" has left some out. */
+    SSize_t n_written;
+    json_create_frame_type_t type;
+    /* The last entry is the marker for "truncate" rather than an
+       entry of "sv". */
+    unsigned int truncated : 1;
+    /* The opening brace of a hash hasn't been written yet, because
+       "skip_undef" may leave out all of its entries. */
+    unsigned int unopened : 1;
+}
+json_create_frame_t;
+
+/* The number of frames which fit on the C stack before we need to
+   allocate memory. */
+
+#define JCFRAMES 0x40
+
+/* The number of classes of booleans from other modules which we
+   recognise, in "json_create_bool_classes". */
+
+#define JCBOOLCLASSES 4
 
 typedef struct json_create {
-    /* The length of the input string. */
-    int length;
-    unsigned char * buffer;
+    /* The output buffer and the string escaping options. */
+    json_create_core_t core;
     /* Place to write the buffer to. */
     SV * output;
     /* Format for floating point numbers. */
@@ -81,6 +126,72 @@ typedef struct json_create {
     SV * non_finite_handler;
     /* User's sorter for entries. */
     SV * cmp;
+    /* If this is not zero, only these keys of hashes are written, in
+       this order. They are shared hash key scalars, so looking them
+       up doesn't need to hash them again. */
+    AV * include_keys;
+    /* Keys of hashes which are never written, or zero. */
+    HV * exclude_keys;
+    /* Arrays like "include_keys" for hashes blessed into particular
+       classes, keyed by class name, or zero. */
+    HV * obj_keys;
+    /* The stack of arrays and hashes being written, so that we don't
+       need to recurse on the C stack. */
+    json_create_frame_t * frames;
+    /* The number of frames in use. */
+    int n_frames;
+    /* The number of frames which "frames" has room for. */
+    int max_frames;
+    /* If this is not zero, it holds "frames", and the frames last
+       between calls, so they hold references to their arrays, hashes
+       and keys. This is used by JSON::Create::Encoder. */
+    SV * frames_sv;
+    /* The arrays and hashes of the frames past JCCIRCLEDEPTH, keyed
+       by address, for finding circular references, or zero. This is
+       a mortal, except when "frames_sv" is set. */
+    HV * active;
+    /* Maximum nesting of arrays and hashes, or zero for no limit. */
+    unsigned int max_depth;
+    /* Maximum number of entries of an array, or zero. */
+    unsigned int max_array_items;
+    /* Maximum length of a string in bytes, or zero. */
+    unsigned int max_string_bytes;
+    /* Maximum length of the output in bytes, or zero. */
+    size_t max_output_bytes;
+    /* The number of bytes given to "json_create_sink" in this call. */
+    size_t n_output;
+    /* What kind of output to make. */
+    json_create_format_t format;
+    /* Encoded arrays and hashes kept between calls, keyed by
+       address. */
+    HV * cache;
+    /* The number of entries in "cache" at which the entries of
+       arrays and hashes which no longer exist are thrown away. */
+    I32 cache_sweep;
+    /* The stashes of "json_create_bool_classes". */
+    HV * bool_stashes[JCBOOLCLASSES];
+    /* The "iso8601" method of the last class which the "iso8601"
+       built-in handler looked at, or zero if it has none, and the
+       method cache generation when it was looked up. */
+    HV * iso8601_stash;
+    CV * iso8601_cv;
+    U32 iso8601_gen;
+    /* The return values of handlers for objects during one call to
+       "json_create_create", keyed by address, if "memoize_handlers"
+       is on. */
+    HV * memo;
+#ifdef HAVE_ZLIB
+    /* If this is not zero, the output is compressed by this as it
+       leaves the buffer. */
+    z_stream * zstream;
+    /* The start of a character split across two pieces of the
+       compressed output, which is checked for valid UTF-8 as it
+       goes. */
+    U8 utf8_partial[4];
+    unsigned int n_utf8_partial;
+    /* The compressed output contains invalid UTF-8. */
+    unsigned int zstream_bad_utf8 : 1;
+#endif /* def HAVE_ZLIB */
 #ifdef INDENT
     /* Indentation depth (no. of tabs). */
     unsigned int depth;
@@ -88,22 +199,10 @@ typedef struct json_create {
 
     /* One-bit flags. */
 
-    /* Do any of the SVs have a Unicode flag? */
-    unsigned int unicode : 1;
-    /* Should we convert / into \/? */
-    unsigned int escape_slash : 1;
-    /* Should Unicode be upper case? */
-    unsigned int unicode_upper : 1;
-    /* Should we escape all non-ascii? */
-    unsigned int unicode_escape_all : 1;
     /* Should we validate user-defined JSON? */
     unsigned int validate : 1;
-    /* Do not escape U+2028 and U+2029. */
-    unsigned int no_javascript_safe : 1;
     /* Make errors fatal. */
     unsigned int fatal_errors : 1;
-    /* Replace bad UTF-8 with the "replacement character". */
-    unsigned int replace_bad_utf8 : 1;
     /* Never upgrade the output to "utf8". */
     unsigned int downgrade_utf8 : 1;
     /* Output may contain invalid UTF-8. */
@@ -116,19 +215,39 @@ typedef struct json_create {
     /* Sort the keys of objects. */
     unsigned int sort : 1;
 #endif /* INDENT */
+    /* This object lasts between calls, so it can have a cache. */
+    unsigned int cache_ok : 1;
+    /* Cache the encoded form of read-only arrays and hashes. */
+    unsigned int cache_readonly : 1;
+    /* We are encoding something to go in the cache. */
+    unsigned int in_cache : 1;
+    /* A value was cut short or left out because of
+       "max_output_bytes", so nothing more goes in the output apart
+       from what closes the open arrays and hashes. */
+    unsigned int output_full : 1;
+    /* Compress the output of "json_create_create" with gzip. */
+    unsigned int gzip : 1;
+    /* Call the handler only once for each object in one call to
+       "json_create_create". */
+    unsigned int memoize_handlers : 1;
+    /* Leave out the keys of hashes whose values are undefined. */
+    unsigned int skip_undef : 1;
+    /* Cut the input short with a marker, rather than failing, at
+       the "max_" limits. */
+    unsigned int truncate : 1;
 }
 json_create_t;
 
 /* Check the length of the buffer, and if we don't have more than
-   MARGIN bytes left to write into, then we put "jc->buffer" into the
+   MARGIN bytes left to write into, then we put "jc->core.buffer" into the
    Perl scalar "jc->output" via "json_create_buffer_fill". We always
-   want to be at least MARGIN bytes from the end of "jc->buffer" after
+   want to be at least MARGIN bytes from the end of "jc->core.buffer" after
    every write operation, so that we always have room to put a number
    or a UTF-8 "rune" in the buffer without checking the length
    excessively. */
 
 #define CHECKLENGTH				\
-    if (jc->length >= BUFSIZE - MARGIN) {	\
+    if (jc->core.length >= BUFSIZE - MARGIN) {	\
 	CALL (json_create_buffer_fill (jc));	\
     }
 
@@ -160,7 +279,9 @@ json_create_error_handler_default (const char * file, int line_number, const cha
     return printed;
 }
 
-static int (* json_create_error_handler) (const char * file, int line_number, const char * msg, ...) = json_create_error_handler_default;
+/* This is never changed, so it is safe to share between threads. */
+
+static int (* const json_create_error_handler) (const char * file, int line_number, const char * msg, ...) = json_create_error_handler_default;
 
 #define JCEH json_create_error_handler
 
@@ -174,6 +295,11 @@ static int (* json_create_error_handler) (const char * file, int line_number, co
 	case json_create_non_ascii_byte:			\
 	case json_create_scalar_reference:			\
 	case json_create_non_finite_number:			\
+	case json_create_too_deep:				\
+	case json_create_circular_reference:			\
+	case json_create_no_zlib:				\
+	case json_create_too_big:				\
+	case json_create_input_changed:				\
 	    break;						\
 	    							\
 	    /* All other exceptions are our bugs. */		\
@@ -209,13 +335,171 @@ json_create_user_message (json_create_t * jc, json_create_status_t status, const
     }
 }
 
-/* Everything else in this file is ordered from callee at the top to
-   caller at the bottom, but because of the recursion as we look at
-   JSON values within arrays or hashes, we need to forward-declare
-   "json_create_recursively". */
+#ifdef HAVE_ZLIB
+
+/* The most bytes zlib can take in or give out in one call to
+   "deflate", since its lengths are "uInt"s. */
+
+#define JCZMAX ((uInt) -1)
+
+/* Compress "len" bytes from "s" onto the end of the output. "flush"
+   is Z_NO_FLUSH, or Z_FINISH for the end of the output. Strings
+   longer than JCZMAX go to zlib in pieces. */
+
+static json_create_status_t
+json_create_deflate (json_create_t * jc, const char * s, STRLEN len,
+		     int flush)
+{
+    z_stream * zs;
+    STRLEN left;
+
+    zs = jc->zstream;
+    if (! jc->output || jc->output == & PL_sv_undef) {
+	jc->output = newSV (BUFSIZE);
+	SvPOK_on (jc->output);
+	SvCUR_set (jc->output, 0);
+    }
+    zs->next_in = (Bytef *) s;
+    zs->avail_in = 0;
+    left = len;
+    while (1) {
+	STRLEN cur;
+	STRLEN room;
+	int zflush;
+	int zret;
+
+	if (zs->avail_in == 0 && left > 0) {
+	    zs->avail_in = left > JCZMAX ? JCZMAX : (uInt) left;
+	    left -= zs->avail_in;
+	}
+	/* Z_FINISH goes with the last piece. */
+	zflush = left > 0 ? Z_NO_FLUSH : flush;
+	cur = SvCUR (jc->output);
+	/* Compressed JSON is usually a lot smaller than the input. */
+	SvGROW (jc->output, cur + zs->avail_in / 4 + BUFSIZE);
+	room = SvLEN (jc->output) - cur - 1;
+	if (room > JCZMAX) {
+	    room = JCZMAX;
+	}
+	zs->next_out = (Bytef *) SvPVX (jc->output) + cur;
+	zs->avail_out = (uInt) room;
+	zret = deflate (zs, zflush);
+	if (zret == Z_STREAM_ERROR) {
+	    return json_create_compression_error;
+	}
+	SvCUR_set (jc->output, cur + room - zs->avail_out);
+	if (zflush == Z_FINISH) {
+	    if (zret == Z_STREAM_END) {
+		break;
+	    }
+	}
+	else if (zs->avail_out != 0 && left == 0) {
+	    break;
+	}
+    }
+    * SvEND (jc->output) = '\0';
+    return json_create_ok;
+}
+
+/* Free the zlib stream. This is called via the save stack, so that
+   it also happens if a user routine or "fatal_errors" croaks. */
+
+static void
+json_create_zstream_free (pTHX_ void * ptr)
+{
+    z_stream * zs;
+    zs = (z_stream *) ptr;
+    deflateEnd (zs);
+    Safefree (zs);
+}
+
+/* Check the "len" bytes "s" going into the compressed output for
+   valid UTF-8, since the output can't be checked after it is
+   compressed. A character split at the end is kept until the next
+   call. */
+
+static void
+json_create_zstream_utf8 (json_create_t * jc, const U8 * s, STRLEN len)
+{
+    const U8 * end;
+    const U8 * last;
+    STRLEN n;
+
+    if (jc->zstream_bad_utf8) {
+	return;
+    }
+    end = s + len;
+    if (jc->n_utf8_partial > 0) {
+	n = UTF8SKIP (jc->utf8_partial);
+	while (jc->n_utf8_partial < n && s < end) {
+	    jc->utf8_partial[jc->n_utf8_partial++] = * s++;
+	}
+	if (jc->n_utf8_partial < n) {
+	    return;
+	}
+	if (! is_utf8_string (jc->utf8_partial, n)) {
+	    jc->zstream_bad_utf8 = 1;
+	    return;
+	}
+	jc->n_utf8_partial = 0;
+    }
+    /* Find the start of the last character. */
+    last = end;
+    while (last > s && end - last < 4 && UTF8_IS_CONTINUATION (last[-1])) {
+	last--;
+    }
+    if (last > s && UTF8_IS_START (last[-1])) {
+	last--;
+	n = UTF8SKIP (last);
+	if (n > 4) {
+	    jc->zstream_bad_utf8 = 1;
+	    return;
+	}
+	if ((STRLEN) (end - last) < n) {
+	    /* It is not finished yet. */
+	    memcpy (jc->utf8_partial, last, end - last);
+	    jc->n_utf8_partial = end - last;
+	    end = last;
+	}
+    }
+    if (! is_utf8_string ((U8 *) s, end - s)) {
+	jc->zstream_bad_utf8 = 1;
+    }
+}
 
 static json_create_status_t
-json_create_recursively (json_create_t * jc, SV * input);
+json_create_zstream_bad_utf8 (json_create_t * jc)
+{
+    json_create_user_message (jc, json_create_unicode_bad_utf8,
+			      "Invalid UTF-8 from user routine");
+    return json_create_unicode_bad_utf8;
+}
+
+#endif /* def HAVE_ZLIB */
+
+/* Send "len" bytes from "s" to the output. */
+
+static INLINE json_create_status_t
+json_create_sink (json_create_t * jc, const char * s, STRLEN len)
+{
+    JCPROBE1 (flush, len);
+    jc->n_output += len;
+#ifdef HAVE_ZLIB
+    if (jc->zstream) {
+	if (jc->format == json_create_format_json) {
+	    json_create_zstream_utf8 (jc, (const U8 *) s, len);
+	}
+	return json_create_deflate (jc, s, len, Z_NO_FLUSH);
+    }
+#endif /* def HAVE_ZLIB */
+    if (! jc->output || jc->output == & PL_sv_undef) {
+	jc->output = newSVpvn (s, len);
+    }
+    else {
+	sv_catpvn (jc->output, s, len);
+    }
+    return json_create_ok;
+}
 
 /* Copy the jc buffer into its SV. */
 
@@ -223,7 +507,7 @@ static INLINE json_create_status_t
 json_create_buffer_fill (json_create_t * jc)
 {
     /* There is nothing to put in the output. */
-    if (jc->length == 0) {
+    if (jc->core.length == 0) {
 	if (jc->output == 0) {
 	    /* And there was not anything before either. */
 	    jc->output = & PL_sv_undef;
@@ -231,48 +515,49 @@ json_create_buffer_fill (json_create_t * jc)
 	/* Either way, we don't need to do anything more. */
 	return json_create_ok;
     }
-    if (! jc->output) {
-	jc->output = newSVpvn ((char *) jc->buffer, (STRLEN) jc->length);
+    /* Backtrace fall through. */
+    return json_create_core_fill (& jc->core);
+}
+
+/* The core's way to "json_create_sink". */
+
+static json_create_status_t
+json_create_core_sink (void * user, const char * s, size_t len)
+{
+    return json_create_sink ((json_create_t *) user, s, (STRLEN) len);
+}
+
+/* The core's way to "json_create_user_message". */
+
+static void
+json_create_core_message (void * user, json_create_status_t status,
+			  const char * format, va_list * ap)
+{
+    json_create_t * jc;
+    jc = (json_create_t *) user;
+    if (jc->fatal_errors) {
+	vcroak (format, ap);
     }
     else {
-	sv_catpvn (jc->output, (char *) jc->buffer, (STRLEN) jc->length);
+	vwarn (format, ap);
     }
-    /* "Empty" the buffer, we don't bother cleaning out the old
-       values, so "jc->length" is our only clue as to the clean/dirty
-       state of the buffer. */
-    jc->length = 0;
-    return json_create_ok;
 }
 
-/* Add one character to the end of jc. */
+/* Start writing into "buffer", which has room for BUFSIZE bytes. */
 
-static INLINE json_create_status_t
-add_char (json_create_t * jc, unsigned char c)
+static void
+json_create_buffer_init (json_create_t * jc, unsigned char * buffer)
 {
-    jc->buffer[jc->length] = c;
-    jc->length++;
-    /* The size we have to use before we write the buffer out. */
-    CHECKLENGTH;
-    return json_create_ok;
+    json_create_core_init (& jc->core, buffer, json_create_core_sink, jc);
+    jc->core.message = json_create_core_message;
 }
 
-/* Add a nul-terminated string to "jc", up to the nul byte. This
-   should not be used unless it's strictly necessary, prefer to use
-   "add_str_len" instead. Basically, don't use this. This is not
-   intended to be Unicode-safe, it is only to be used for strings
-   which we know do not need to be checked for Unicode validity (for
-   example sprintf'd numbers or something). */
+/* Add one character to the end of jc. */
 
 static INLINE json_create_status_t
-add_str (json_create_t * jc, const char * s)
+add_char (json_create_t * jc, unsigned char c)
 {
-    int i;
-    for (i = 0; s[i]; i++) {
-	unsigned char c;
-	c = (unsigned char) s[i];
-	CALL (add_char (jc, c));
-    }
-    return json_create_ok;
+    return core_add_char (& jc->core, c);
 }
 
 /* Add a string "s" with length "slen" to "jc". This does not test for
@@ -281,29 +566,9 @@ add_str (json_create_t * jc, const char * s)
    know do not need to be checked for Unicode validity. */
 
 static INLINE json_create_status_t
-add_str_len (json_create_t * jc, const char * s, unsigned int slen)
+add_str_len (json_create_t * jc, const char * s, STRLEN slen)
 {
-    int i;
-    /* We know that (BUFSIZE - jc->length) is always bigger than
-       MARGIN going into this, but the compiler doesn't. Hopefully,
-       the compiler optimizes the following "if" statement away to a
-       true value for almost all cases when this is inlined and slen
-       is known to be smaller than MARGIN. */
-    if (slen < MARGIN || slen < BUFSIZE - jc->length) {
-	for (i = 0; i < slen; i++) {
-	    jc->buffer[jc->length + i] = s[i];
-	}
-	jc->length += slen;
-	CHECKLENGTH;
-    }
-    else {
-	/* A very long string which may overflow the buffer, so use
-	   checking routines. */
-	for (i = 0; i < slen; i++) {
-	    CALL (add_char (jc, (unsigned char) s[i]));
-	}
-    }
-    return json_create_ok;
+    return core_add_str_len (& jc->core, s, slen);
 }
 
 #ifdef INDENT
@@ -347,534 +612,683 @@ add_str_len_indent (json_create_t * jc, const char * s, unsigned int slen)
 
 #define ADD(x) CALL (add_str_len (jc, x, strlen (x)));
 
-static const char *uc_hex = "0123456789ABCDEF";
-static const char *lc_hex = "0123456789abcdef";
+/*  ____  _                        
+   | __ )(_)_ __   __ _ _ __ _   _ 
+   |  _ \| | '_ \ / _` | '__| | | |
+   | |_) | | | | | (_| | |  | |_| |
+   |____/|_|_| |_|\__,_|_|   \__, |
+                             |___/  */
+
+/* Are we making something other than JSON? The traversal is shared,
+   but the leaves and the brackets are written differently. */
+
+#define BINARY (jc->format != json_create_format_json)
+
+/* Add the lowest "n_bytes" bytes of "u" in big-endian order. */
 
 static INLINE json_create_status_t
-add_one_u (json_create_t * jc, unsigned int u)
-{
-    char * spillover;
-    const char * hex;
-    hex = lc_hex;
-    if (jc->unicode_upper) {
-	hex = uc_hex;
-    }
-    spillover = (char *) (jc->buffer) + jc->length;
-    spillover[0] = '\\';
-    spillover[1] = 'u';
-    // Method poached from https://metacpan.org/source/CHANSEN/Unicode-UTF8-0.60/UTF8.xs#L196
-    spillover[5] = hex[u & 0xf];
-    u >>= 4;
-    spillover[4] = hex[u & 0xf];
-    u >>= 4;
-    spillover[3] = hex[u & 0xf];
-    u >>= 4;
-    spillover[2] = hex[u & 0xf];
-    jc->length += 6;
+add_big_endian (json_create_t * jc, uint64_t u, int n_bytes)
+{
+    int i;
+    for (i = n_bytes - 1; i >= 0; i--) {
+	jc->core.buffer[jc->core.length] = (unsigned char) (u >> (8 * i));
+	jc->core.length++;
+    }
     CHECKLENGTH;
     return json_create_ok;
 }
 
-/* Add a "\u3000" or surrogate pair if necessary. */
+/* Add the initial byte of a CBOR data item of major type "major",
+   followed by "n" using as few bytes as possible. */
 
 static INLINE json_create_status_t
-add_u (json_create_t * jc, unsigned int u)
+cbor_head (json_create_t * jc, unsigned char major, uint64_t n)
 {
-    if (u > 0xffff) {
-	int hi;
-	int lo;
-	int status = unicode_to_surrogates (u, & hi, & lo);
-	if (status != UNICODE_OK) {
-	    if (JCEH) {
-		(*JCEH) (__FILE__, __LINE__,
-			 "Error %d making surrogate pairs from %X",
-			 status, u);
-	    }
-	    return json_create_unicode_error;
-	}
-	CALL (add_one_u (jc, hi));
-	/* Backtrace fallthrough. */
-	return add_one_u (jc, lo);
+    major <<= 5;
+    if (n < 24) {
+	return add_char (jc, major | (unsigned char) n);
     }
-    else {
-	/* Backtrace fallthrough. */
-	return add_one_u (jc, u);
+    if (n <= 0xFF) {
+	CALL (add_char (jc, major | 24));
+	return add_big_endian (jc, n, 1);
     }
-}
-
-#define BADUTF8								\
-    if (jc->replace_bad_utf8) {						\
-	/* We have to switch on Unicode otherwise the replacement */	\
-	/* characters don't work as intended. */			\
-	jc->unicode = 1;						\
-	/* This is �, U+FFFD, as UTF-8 bytes. */			\
-	CALL (add_str_len (jc, "\xEF\xBF\xBD", 3));			\
-    }									\
-    else {								\
-	json_create_user_message (jc, json_create_unicode_bad_utf8,	\
-				  "Invalid UTF-8");			\
-	return json_create_unicode_bad_utf8;				\
+    if (n <= 0xFFFF) {
+	CALL (add_char (jc, major | 25));
+	return add_big_endian (jc, n, 2);
+    }
+    if (n <= 0xFFFFFFFF) {
+	CALL (add_char (jc, major | 26));
+	return add_big_endian (jc, n, 4);
     }
+    CALL (add_char (jc, major | 27));
+    return add_big_endian (jc, n, 8);
+}
 
-/* Jump table. Doing it this way is not the fastest possible way, but
-   it's also very difficult for a compiler to mess this
-   up. Theoretically, it would be faster to make a jump table by the
-   compiler from the switch statement, but some compilers sometimes
-   cannot do that. */
+#define CBOR_UNSIGNED 0
+#define CBOR_NEGATIVE 1
+#define CBOR_BYTES 2
+#define CBOR_TEXT 3
+#define CBOR_ARRAY 4
+#define CBOR_MAP 5
+#define CBOR_TAG 6
 
-/* In this enum, I use three letters as a compromise between
-   readability and formatting. The control character names are from
-   "man ascii" with an X tagged on the end. */
+/* The tags of RFC 8949 for integers too big for 64 bits. */
 
-typedef enum {
-    CTL,  // control char, escape to \u
-    BSX,  // backslash b
-    HTX,  // Tab character
-    NLX,  // backslash n, new line
-    NPX,  // backslash f
-    CRX,  // backslash r
-    ASC,  // Non-special ASCII
-    QUO,  // double quote
-    BSL,  // backslash
-    FSL,  // forward slash, "/" 
-    BAD,  // Invalid UTF-8 value.
-    UT2,  // UTF-8, two bytes
-    UT3,  // UTF-8, three bytes
-    UT4,  // UTF-8, four bytes
-}
-jump_t;
-
-static jump_t jump[0x100] = {
-    CTL,CTL,CTL,CTL,CTL,CTL,CTL,CTL,BSX,HTX,NLX,CTL,NPX,CRX,CTL,CTL,
-    CTL,CTL,CTL,CTL,CTL,CTL,CTL,CTL,CTL,CTL,CTL,CTL,CTL,CTL,CTL,CTL,
-    ASC,ASC,QUO,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,FSL,
-    ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,
-    ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,
-    ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,BSL,ASC,ASC,ASC,
-    ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,
-    ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,ASC,
-    BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,
-    BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,
-    BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,
-    BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,
-    BAD,BAD,UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,
-    UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,UT2,
-    UT3,UT3,UT3,UT3,UT3,UT3,UT3,UT3,UT3,UT3,UT3,UT3,UT3,UT3,UT3,UT3,
-    UT4,UT4,UT4,UT4,UT4,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,BAD,
-};
+#define CBOR_POSITIVE_BIGNUM 2
+#define CBOR_NEGATIVE_BIGNUM 3
 
-/* Need this twice, once within the ASCII handler and once within the
-   Unicode handler. */
-
-#define ASCII					\
-    case CTL:					\
-    CALL (add_one_u (jc, (unsigned int) c));	\
-    i++;					\
-    break;					\
-						\
-    case BSX:					\
-    ADD ("\\b");				\
-    i++;					\
-    break;					\
-						\
-    case HTX:					\
-    ADD ("\\t");				\
-    i++;					\
-    break;					\
-						\
-    case NLX:					\
-    ADD ("\\n");				\
-    i++;					\
-    break;					\
-						\
-    case NPX:					\
-    ADD ("\\f");				\
-    i++;					\
-    break;					\
-						\
-    case CRX:					\
-    ADD ("\\r");				\
-    i++;					\
-    break;					\
-						\
-    case ASC:					\
-    CALL (add_char (jc, c));			\
-    i++;					\
-    break;					\
-						\
-    case QUO:					\
-    ADD ("\\\"");				\
-    i++;					\
-    break;					\
-						\
-    case FSL:					\
-    if (jc->escape_slash) {			\
-	ADD ("\\/");				\
-    }						\
-    else {					\
-	CALL (add_char (jc, c));		\
-    }						\
-    i++;					\
-    break;					\
-						\
-    case BSL:					\
-    ADD ("\\\\");				\
-    i++;					\
-    break;
+/* Major type 7 with an additional value of 25, 26, or 27. */
 
+#define CBOR_HALF 0xF9
+#define CBOR_SINGLE 0xFA
+#define CBOR_DOUBLE 0xFB
 
-static INLINE json_create_status_t
-json_create_add_ascii_key_len (json_create_t * jc, const unsigned char * key, STRLEN keylen)
+static json_create_status_t
+cbor_string (json_create_t * jc, const char * s, STRLEN len, int text)
 {
-    int i;
+    CALL (cbor_head (jc, text ? CBOR_TEXT : CBOR_BYTES, (uint64_t) len));
+    return add_str_len (jc, s, len);
+}
 
-    CALL (add_char (jc, '"'));
-    for (i = 0; i < keylen; ) {
-	unsigned char c;
+static json_create_status_t
+cbor_signed (json_create_t * jc, int64_t iv)
+{
+    if (iv >= 0) {
+	return cbor_head (jc, CBOR_UNSIGNED, (uint64_t) iv);
+    }
+    /* This can't overflow, unlike "-iv". */
+    return cbor_head (jc, CBOR_NEGATIVE, (uint64_t) (-1 - iv));
+}
 
-	c = key[i];
-	switch (jump[c]) {
+static json_create_status_t
+cbor_integer (json_create_t * jc, SV * sv)
+{
+    if (SvIOK_UV (sv)) {
+	return cbor_head (jc, CBOR_UNSIGNED, (uint64_t) SvUV (sv));
+    }
+    return cbor_signed (jc, (int64_t) SvIV (sv));
+}
 
-	ASCII;
+/* If "d" can be written as a half-precision float without losing
+   anything, put the bits into "* half_ptr" and return true. */
 
-	default:
-	    json_create_user_message (jc, json_create_non_ascii_byte,
-				      "Non-ASCII byte in non-utf8 string: %X",
-				      key[i]);
-	    return json_create_non_ascii_byte;
+static int
+json_create_half (double d, uint16_t * half_ptr)
+{
+    float f;
+    uint32_t u;
+    uint32_t sign;
+    int exponent;
+    uint32_t mantissa;
+
+    if (d < - 65504.0 || d > 65504.0) {
+	return 0;
+    }
+    f = (float) d;
+    if ((double) f != d) {
+	return 0;
+    }
+    memcpy (& u, & f, sizeof (u));
+    sign = (u >> 16) & 0x8000;
+    exponent = (int) ((u >> 23) & 0xFF) - 127;
+    mantissa = u & 0x7FFFFF;
+    if (exponent == -127 && mantissa == 0) {
+	/* Zero or minus zero. */
+	* half_ptr = sign;
+	return 1;
+    }
+    if (exponent >= -14) {
+	/* A normal half, which has ten bits of mantissa. */
+	if (mantissa & 0x1FFF) {
+	    return 0;
 	}
+	* half_ptr = sign | ((exponent + 15) << 10) | (mantissa >> 13);
+	return 1;
     }
-    CALL (add_char (jc, '"'));
-    return json_create_ok;
+    if (exponent >= -24) {
+	/* A subnormal half, where the implicit one becomes part of
+	   the mantissa. */
+	int shift;
+	mantissa |= 0x800000;
+	shift = 13 + (-14 - exponent);
+	if (mantissa & ((1 << shift) - 1)) {
+	    return 0;
+	}
+	* half_ptr = sign | (mantissa >> shift);
+	return 1;
+    }
+    return 0;
 }
 
+/* Add a floating point number in the shortest form which doesn't
+   lose anything. */
 
-/* Add a string to the buffer with quotes around it and escapes for
-   the escapables. */
-
-static INLINE json_create_status_t
-json_create_add_key_len (json_create_t * jc, const unsigned char * key, STRLEN keylen)
+static json_create_status_t
+cbor_float (json_create_t * jc, double d)
 {
-    int i;
-
-    CALL (add_char (jc, '"'));
-    for (i = 0; i < keylen; ) {
-	unsigned char c, d, e, f;
-	c = key[i];
+    uint16_t half;
+    float f;
+    uint32_t single;
+    uint64_t dbl;
+
+    if (isnan (d)) {
+	CALL (add_char (jc, CBOR_HALF));
+	return add_big_endian (jc, 0x7E00, 2);
+    }
+    if (isinf (d)) {
+	CALL (add_char (jc, CBOR_HALF));
+	return add_big_endian (jc, d < 0.0 ? 0xFC00 : 0x7C00, 2);
+    }
+    if (json_create_half (d, & half)) {
+	CALL (add_char (jc, CBOR_HALF));
+	return add_big_endian (jc, half, 2);
+    }
+    if (d >= - FLT_MAX && d <= FLT_MAX) {
+	f = (float) d;
+	if ((double) f == d) {
+	    memcpy (& single, & f, sizeof (single));
+	    CALL (add_char (jc, CBOR_SINGLE));
+	    return add_big_endian (jc, single, 4);
+	}
+    }
+    memcpy (& dbl, & d, sizeof (dbl));
+    CALL (add_char (jc, CBOR_DOUBLE));
+    return add_big_endian (jc, dbl, 8);
+}
 
-	switch (jump[c]) {
+/* Add a MessagePack length "n", either inside the byte "fix" if it is
+   no more than "max_fix", or after one of the bytes "code8", "code16"
+   or "code32", for lengths which fit into that many bits. A zero
+   "fix" or "code8" means there is no such form. */
 
-	ASCII;
+static INLINE json_create_status_t
+msgpack_length (json_create_t * jc, unsigned char fix, uint64_t max_fix,
+		unsigned char code8, unsigned char code16,
+		unsigned char code32, uint64_t n)
+{
+    if (fix && n <= max_fix) {
+	return add_char (jc, fix | (unsigned char) n);
+    }
+    if (code8 && n <= 0xFF) {
+	CALL (add_char (jc, code8));
+	return add_big_endian (jc, n, 1);
+    }
+    if (n <= 0xFFFF) {
+	CALL (add_char (jc, code16));
+	return add_big_endian (jc, n, 2);
+    }
+    CALL (add_char (jc, code32));
+    return add_big_endian (jc, n, 4);
+}
 
-	case BAD:
-	    BADUTF8;
-	    i++;
-	    break;
+/* The bytes for each kind of MessagePack data which has them. */
+
+#define MSGPACK_FIXMAP 0x80
+#define MSGPACK_FIXARRAY 0x90
+#define MSGPACK_FIXSTR 0xA0
+#define MSGPACK_BIN8 0xC4
+#define MSGPACK_BIN16 0xC5
+#define MSGPACK_BIN32 0xC6
+#define MSGPACK_FLOAT32 0xCA
+#define MSGPACK_FLOAT64 0xCB
+#define MSGPACK_UINT8 0xCC
+#define MSGPACK_UINT16 0xCD
+#define MSGPACK_UINT32 0xCE
+#define MSGPACK_UINT64 0xCF
+#define MSGPACK_INT8 0xD0
+#define MSGPACK_INT16 0xD1
+#define MSGPACK_INT32 0xD2
+#define MSGPACK_INT64 0xD3
+#define MSGPACK_STR8 0xD9
+#define MSGPACK_STR16 0xDA
+#define MSGPACK_STR32 0xDB
+#define MSGPACK_ARRAY16 0xDC
+#define MSGPACK_ARRAY32 0xDD
+#define MSGPACK_MAP16 0xDE
+#define MSGPACK_MAP32 0xDF
 
-	case UT2:
-	    d = key[i + 1];
-	    if (d < 0x80 || d > 0xBF) {
-		BADUTF8;
-		i++;
-		break;
-	    }
-	    if (jc->unicode_escape_all) {
-		unsigned int u;
-		u = (c & 0x1F)<<6
-		  | (d & 0x3F);
-		CALL (add_u (jc, u));
-	    }
-	    else {
-		CALL (add_str_len (jc, (const char *) key + i, 2));
-	    }
-	    // Increment i
-	    i += 2;
-	    break;
+static json_create_status_t
+msgpack_string (json_create_t * jc, const char * s, STRLEN len, int text)
+{
+    if (text) {
+	CALL (msgpack_length (jc, MSGPACK_FIXSTR, 31, MSGPACK_STR8,
+			      MSGPACK_STR16, MSGPACK_STR32, (uint64_t) len));
+    }
+    else {
+	CALL (msgpack_length (jc, 0, 0, MSGPACK_BIN8,
+			      MSGPACK_BIN16, MSGPACK_BIN32, (uint64_t) len));
+    }
+    return add_str_len (jc, s, len);
+}
 
-	case UT3:
-	    d = key[i + 1];
-	    e = key[i + 2];
-	    if (d < 0x80 || d > 0xBF ||
-		e < 0x80 || e > 0xBF) {
-		BADUTF8;
-		i++;
-		break;
-	    }
-	    if (! jc->no_javascript_safe &&
-		c == 0xe2 && d == 0x80 && 
-		(e == 0xa8 || e == 0xa9)) {
-		CALL (add_one_u (jc, 0x2028 + e - 0xa8));
-	    }
-	    else {
-		if (jc->unicode_escape_all) {
-		    unsigned int u;
-		    u = (c & 0x0F)<<12
-		      | (d & 0x3F)<<6
-		      | (e & 0x3F);
-		    CALL (add_u (jc, u));
-		}
-		else {
-		    CALL (add_str_len (jc, (const char *) key + i, 3));
-		}
-	    }
-	    // Increment i
-	    i += 3;
-	    break;
+/* Add a non-negative integer using the smallest form. */
 
-	case UT4:
-           d = key[i + 1];
-           e = key[i + 2];
-           f = key[i + 3];
-           if (
-               // These byte values are copied from
-               // https://github.com/htacg/tidy-html5/blob/768ad46968b43e29167f4d1394a451b8c6f40b7d/src/utf8.c
-
-               // 0x40000 - 0xfffff
-               (c < 0xf4 &&
-                (d < 0x80 || d > 0xBF ||
-                 e < 0x80 || e > 0xBF ||
-                 f < 0x80 || f > 0xBF))
-               ||
-               // 0x100000 - 0x10ffff
-               (c == 0xf4 && 
-                (d < 0x80 || d > 0x8F ||
-                 e < 0x80 || e > 0xBF ||
-                 f < 0x80 || f > 0xBF))
-               ) {
-               BADUTF8;
-               i++;
-               break;
-           }
-	    if (jc->unicode_escape_all) {
-		unsigned int u;
-		const unsigned char * input;
-		input = key + i;
-		u = (c & 0x07) << 18
-		  | (d & 0x3F) << 12
-                  | (e & 0x3F) <<  6
-                  | (f & 0x3F);
-		add_u (jc, u);
-	    }
-	    else {
-		CALL (add_str_len (jc, (const char *) key + i, 4));
-	    }
-	    // Increment i
-	    i += 4;
-	    break;
-	}
+static json_create_status_t
+msgpack_unsigned (json_create_t * jc, uint64_t u)
+{
+    if (u <= 0x7F) {
+	/* Positive fixint. */
+	return add_char (jc, (unsigned char) u);
     }
-    CALL (add_char (jc, '"'));
-    return json_create_ok;
+    if (u <= 0xFF) {
+	CALL (add_char (jc, MSGPACK_UINT8));
+	return add_big_endian (jc, u, 1);
+    }
+    if (u <= 0xFFFF) {
+	CALL (add_char (jc, MSGPACK_UINT16));
+	return add_big_endian (jc, u, 2);
+    }
+    if (u <= 0xFFFFFFFF) {
+	CALL (add_char (jc, MSGPACK_UINT32));
+	return add_big_endian (jc, u, 4);
+    }
+    CALL (add_char (jc, MSGPACK_UINT64));
+    return add_big_endian (jc, u, 8);
 }
 
-static INLINE json_create_status_t
-json_create_add_string (json_create_t * jc, SV * input)
+static json_create_status_t
+msgpack_signed (json_create_t * jc, int64_t iv)
 {
-    char * istring;
-    STRLEN ilength;
-
-    istring = SvPV (input, ilength);
-    if (SvUTF8 (input)) {
-	/* "jc->unicode" is true if Perl says that anything in the
-	   whole of the input to "json_create" is a "SvUTF8"
-	   scalar. We have to force everything in the whole output to
-	   Unicode. */
-	jc->unicode = 1;
+    if (iv >= 0) {
+	return msgpack_unsigned (jc, (uint64_t) iv);
     }
-    else if (jc->strict) {
-	/* Backtrace fall through, remember to check the caller's line. */
-	return json_create_add_ascii_key_len (jc, (unsigned char *) istring,
-					      (STRLEN) ilength);
+    /* The lowest bytes of the two's complement "iv" are the signed
+       integer in fewer bytes. */
+    if (iv >= -32) {
+	/* Negative fixint. */
+	return add_char (jc, (unsigned char) (iv & 0xFF));
     }
-    /* Backtrace fall through, remember to check the caller's line. */
-    return json_create_add_key_len (jc, (unsigned char *) istring,
-				    (STRLEN) ilength);
+    if (iv >= -0x80) {
+	CALL (add_char (jc, MSGPACK_INT8));
+	return add_big_endian (jc, (uint64_t) iv, 1);
+    }
+    if (iv >= -0x8000) {
+	CALL (add_char (jc, MSGPACK_INT16));
+	return add_big_endian (jc, (uint64_t) iv, 2);
+    }
+    if (iv >= - (int64_t) 0x80000000) {
+	CALL (add_char (jc, MSGPACK_INT32));
+	return add_big_endian (jc, (uint64_t) iv, 4);
+    }
+    CALL (add_char (jc, MSGPACK_INT64));
+    return add_big_endian (jc, (uint64_t) iv, 8);
 }
 
-/* Extract the remainder of x when divided by ten and then turn it
-   into the equivalent ASCII digit. '0' in ASCII is 0x30, and (x)%10
-   is guaranteed not to have any of the high bits set. */
+static json_create_status_t
+msgpack_integer (json_create_t * jc, SV * sv)
+{
+    if (SvIOK_UV (sv)) {
+	return msgpack_unsigned (jc, (uint64_t) SvUV (sv));
+    }
+    return msgpack_signed (jc, (int64_t) SvIV (sv));
+}
 
-#define DIGIT(x) (((x)%10)|0x30)
+/* Add a floating point number as a float 32 if that holds the exact
+   value, otherwise as a float 64. */
 
-static INLINE json_create_status_t
-json_create_add_unsigned(json_create_t * jc, SV * sv) {
-    long unsigned int uv;
-    int uvlen;
-    char * spillover;
-    uv = SvUV (sv);
-    uvlen = 0;
-    spillover = ((char *) jc->buffer) + jc->length;
-    uvlen += snprintf (spillover + uvlen, MARGIN - uvlen, "%lu", uv);
-    if (uvlen >= MARGIN) {
-	if (JCEH) {
-	    (*JCEH) (__FILE__, __LINE__,
-		     "A printed integer number %ld was "
-		     "longer than MARGIN=%d bytes",
-		     SvIV (sv), MARGIN);
+static json_create_status_t
+msgpack_float (json_create_t * jc, double d)
+{
+    float f;
+    uint32_t single;
+    uint64_t dbl;
+
+    if (! isfinite (d) || (d >= - FLT_MAX && d <= FLT_MAX)) {
+	f = (float) d;
+	if ((double) f == d || isnan (d)) {
+	    memcpy (& single, & f, sizeof (single));
+	    CALL (add_char (jc, MSGPACK_FLOAT32));
+	    return add_big_endian (jc, single, 4);
 	}
-	return json_create_number_too_long;
     }
-    jc->length += uvlen;
-    CHECKLENGTH;
-    return json_create_ok;
+    memcpy (& dbl, & d, sizeof (dbl));
+    CALL (add_char (jc, MSGPACK_FLOAT64));
+    return add_big_endian (jc, dbl, 8);
 }
 
-static INLINE json_create_status_t
-json_create_add_integer (json_create_t * jc, SV * sv)
+/* The following send each kind of data to the routine for the
+   format. */
+
+/* Add a string. Perl's character strings, and byte strings which are
+   valid UTF-8, become text, and other byte strings become bytes. */
+
+static json_create_status_t
+json_create_binary_string (json_create_t * jc, const char * s, STRLEN len,
+			   int utf8)
 {
-    long int iv;
-    int ivlen;
-    char * spillover;
+    int text;
 
-    if (SvIOK_UV(sv)) {
-	return json_create_add_unsigned (jc, sv);
+    text = utf8 || is_utf8_string ((U8 *) s, len);
+    if (jc->format == json_create_format_msgpack) {
+	return msgpack_string (jc, s, len, text);
     }
-    iv = SvIV (sv);
-    ivlen = 0;
-
-    /* Pointer arithmetic. */
+    return cbor_string (jc, s, len, text);
+}
 
-    spillover = ((char *) jc->buffer) + jc->length;
+static json_create_status_t
+json_create_binary_integer (json_create_t * jc, SV * sv)
+{
+    if (jc->format == json_create_format_msgpack) {
+	return msgpack_integer (jc, sv);
+    }
+    return cbor_integer (jc, sv);
+}
 
-    /* Souped-up integer printing for small integers. The following is
-       all just souped up versions of snprintf ("%d", iv);. */
+/* Add integers which are not in SVs, from JSON::Create::Packed
+   objects. */
 
-    if (iv < 0) {
-	spillover[ivlen] = '-';
-	ivlen++;
-	iv = -iv;
-    }
-    if (iv < 10) {
-	/* iv has exactly one digit. The first digit may be zero. */
-	spillover[ivlen] = DIGIT (iv);
-	ivlen++;
-    }
-    else if (iv < 100) {
-	/* iv has exactly two digits. The first digit is not zero. */
-	spillover[ivlen] = DIGIT (iv/10);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv);
-	ivlen++;
-    }
-    else if (iv < 1000) {
-	/* iv has exactly three digits. The first digit is not
-	   zero. */
-	spillover[ivlen] = DIGIT (iv/100);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv/10);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv);
-	ivlen++;
-    }
-    else if (iv < 10000) {
-	/* etc. */
-	spillover[ivlen] = DIGIT (iv/1000);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv/100);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv/10);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv);
-	ivlen++;
-    }
-    else if (iv < 100000) {
-	spillover[ivlen] = DIGIT (iv/10000);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv/1000);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv/100);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv/10);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv);
-	ivlen++;
-    }
-    else if (iv < 1000000) {
-	spillover[ivlen] = DIGIT (iv/100000);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv/10000);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv/1000);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv/100);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv/10);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv);
-	ivlen++;
-    }
-    else if (iv < 10000000) {
-	spillover[ivlen] = DIGIT (iv/1000000);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv/100000);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv/10000);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv/1000);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv/100);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv/10);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv);
-	ivlen++;
-    }
-    else if (iv < 100000000) {
-	spillover[ivlen] = DIGIT (iv/10000000);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv/1000000);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv/100000);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv/10000);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv/1000);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv/100);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv/10);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv);
-	ivlen++;
-    }
-    else if (iv < 1000000000) {
-	spillover[ivlen] = DIGIT (iv/100000000);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv/10000000);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv/1000000);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv/100000);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv/10000);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv/1000);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv/100);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv/10);
-	ivlen++;
-	spillover[ivlen] = DIGIT (iv);
-	ivlen++;
+static json_create_status_t
+json_create_binary_signed (json_create_t * jc, int64_t iv)
+{
+    if (jc->format == json_create_format_msgpack) {
+	return msgpack_signed (jc, iv);
     }
-    else {
-	/* The number is one billion (1000,000,000) or more, so we're
-	   just going to print it into "jc->buffer" with snprintf. */
-	ivlen += snprintf (spillover + ivlen, MARGIN - ivlen, "%ld", iv);
-	if (ivlen >= MARGIN) {
-	    if (JCEH) {
-		(*JCEH) (__FILE__, __LINE__,
-			 "A printed integer number %ld was "
-			 "longer than MARGIN=%d bytes",
-			 SvIV (sv), MARGIN);
-	    }
-	    return json_create_number_too_long;
-	}
+    return cbor_signed (jc, iv);
+}
+
+static json_create_status_t
+json_create_binary_unsigned (json_create_t * jc, uint64_t u)
+{
+    if (jc->format == json_create_format_msgpack) {
+	return msgpack_unsigned (jc, u);
     }
-    jc->length += ivlen;
-    CHECKLENGTH;
-    return json_create_ok;
+    return cbor_head (jc, CBOR_UNSIGNED, u);
+}
+
+static json_create_status_t
+json_create_binary_float (json_create_t * jc, double d)
+{
+    if (jc->format == json_create_format_msgpack) {
+	return msgpack_float (jc, d);
+    }
+    return cbor_float (jc, d);
+}
+
+/* Start an array if "c" is '[', or a map if "c" is '{', which has "n"
+   entries. */
+
+static json_create_status_t
+json_create_binary_open (json_create_t * jc, unsigned char c, SSize_t n)
+{
+    if (jc->format == json_create_format_msgpack) {
+	if (c == '[') {
+	    return msgpack_length (jc, MSGPACK_FIXARRAY, 15, 0,
+				   MSGPACK_ARRAY16, MSGPACK_ARRAY32,
+				   (uint64_t) n);
+	}
+	return msgpack_length (jc, MSGPACK_FIXMAP, 15, 0, MSGPACK_MAP16,
+			       MSGPACK_MAP32, (uint64_t) n);
+    }
+    return cbor_head (jc, c == '[' ? CBOR_ARRAY : CBOR_MAP, (uint64_t) n);
+}
+
+typedef enum {
+    json_create_null,
+    json_create_true,
+    json_create_false,
+    json_create_n_literals,
+}
+json_create_literal_t;
+
+static const char * json_literals[json_create_n_literals] = {
+    "null",
+    "true",
+    "false",
+};
+
+/* The bytes of null, true, and false in each binary format. */
+
+static const unsigned char
+binary_literals[json_create_n_formats][json_create_n_literals] = {
+    /* JSON, which is not binary. */
+    {0, 0, 0},
+    /* CBOR */
+    {0xF6, 0xF5, 0xF4},
+    /* MessagePack */
+    {0xC0, 0xC3, 0xC2},
+};
+
+/* Add null, true, or false. */
+
+static INLINE json_create_status_t
+json_create_add_literal (json_create_t * jc, json_create_literal_t literal)
+{
+    if (BINARY) {
+	return add_char (jc, binary_literals[jc->format][literal]);
+    }
+    return add_str_len (jc, json_literals[literal],
+			strlen (json_literals[literal]));
+}
+
+#define LITERAL(x) CALL (json_create_add_literal (jc, json_create_ ## x))
+
+/* Add a string to the buffer with quotes around it and escapes for
+   the escapables. The escaping is done by "json-create-core.c". */
+
+static INLINE json_create_status_t
+json_create_add_key_len (json_create_t * jc, const unsigned char * key, STRLEN keylen)
+{
+    return json_create_core_string (& jc->core, key, keylen);
+}
+
+/* The same as "json_create_add_key_len" but rejecting non-ASCII
+   bytes, for byte strings in strict mode. */
+
+static INLINE json_create_status_t
+json_create_add_ascii_key_len (json_create_t * jc, const unsigned char * key, STRLEN keylen)
+{
+    return json_create_core_ascii_string (& jc->core, key, keylen);
+}
+
+/* Add the string "istring" of length "ilength", which is UTF-8 if
+   "utf8" is true. */
+
+static INLINE json_create_status_t
+json_create_add_pv (json_create_t * jc, const char * istring, STRLEN ilength,
+		    int utf8)
+{
+    if (BINARY) {
+	return json_create_binary_string (jc, istring, ilength, utf8);
+    }
+    if (utf8) {
+	/* "jc->core.unicode" is true if Perl says that anything in the
+	   whole of the input to "json_create" is a "SvUTF8"
+	   scalar. We have to force everything in the whole output to
+	   Unicode. */
+	jc->core.unicode = 1;
+    }
+    else if (jc->strict) {
+	/* Backtrace fall through, remember to check the caller's line. */
+	return json_create_add_ascii_key_len (jc, (unsigned char *) istring,
+					      ilength);
+    }
+    /* Backtrace fall through, remember to check the caller's line. */
+    return json_create_add_key_len (jc, (unsigned char *) istring, ilength);
+}
+
+/* What goes in place of the things which "truncate" leaves out. */
+
+#define JCMARKER "..."
+
+/* Write the marker as a string. */
+
+static json_create_status_t
+json_create_add_marker (json_create_t * jc)
+{
+    return json_create_add_pv (jc, JCMARKER, strlen (JCMARKER), 0);
+}
+
+/* Would adding "len" more bytes take the output past
+   "max_output_bytes"? */
+
+#define OVER_LIMIT(len)						\
+    (jc->max_output_bytes > 0 &&				\
+     jc->n_output + jc->core.length + (len) > jc->max_output_bytes)
+
+static json_create_status_t
+json_create_truncate_output (json_create_t * jc);
+
+/* The value just written is the marker, which stands for the rest of
+   the entries of the array or hash it is in too. */
+
+static void
+json_create_marker_ends_frame (json_create_t * jc)
+{
+    if (jc->n_frames > 0) {
+	json_create_frame_t * frame;
+	frame = jc->frames + jc->n_frames - 1;
+	frame->i = frame->n_keys;
+    }
+}
+
+/* Put the marker in place of a value which would take the output past
+   "max_output_bytes", or fail if "truncate" is off. The open arrays
+   and hashes are closed by "json_create_next". */
+
+static json_create_status_t
+json_create_cut_value (json_create_t * jc)
+{
+    if (! jc->truncate || BINARY) {
+	return json_create_truncate_output (jc);
+    }
+    CALL (json_create_add_marker (jc));
+    json_create_marker_ends_frame (jc);
+    jc->output_full = 1;
+    return json_create_ok;
+}
+
+/* Does the string "istring" of length "ilength" fit into the output
+   without going past "max_output_bytes"? */
+
+static int
+json_create_string_fits (json_create_t * jc, const char * istring,
+			 STRLEN ilength)
+{
+    size_t used;
+    size_t room;
+
+    /* The quotes. */
+    used = jc->n_output + jc->core.length + 2;
+    if (used > jc->max_output_bytes) {
+	return 0;
+    }
+    room = jc->max_output_bytes - used;
+    if (ilength > room) {
+	return 0;
+    }
+    if (BINARY || ilength * 6 <= room) {
+	/* It fits however many escapes it has. */
+	return 1;
+    }
+    return json_create_core_string_fit (& jc->core,
+					(const unsigned char *) istring,
+					ilength, room) == ilength;
+}
+
+/* Write as much of "istring" as fits into "max_output_bytes", cut
+   short at a character boundary and followed by the marker, or fail
+   if "truncate" is off. */
+
+static json_create_status_t
+json_create_add_last_string (json_create_t * jc, const char * istring,
+			     STRLEN ilength, int utf8)
+{
+    size_t used;
+    STRLEN cut;
+    SV * shorter;
+
+    if (! jc->truncate || BINARY) {
+	return json_create_truncate_output (jc);
+    }
+    /* The quotes and the marker. */
+    used = jc->n_output + jc->core.length + 2 + strlen (JCMARKER);
+    cut = 0;
+    if (used < jc->max_output_bytes) {
+	cut = json_create_core_string_fit (& jc->core,
+					   (const unsigned char *) istring,
+					   ilength,
+					   jc->max_output_bytes - used);
+    }
+    shorter = sv_2mortal (newSVpvn (istring, cut));
+    sv_catpvs (shorter, JCMARKER);
+    CALL (json_create_add_pv (jc, SvPVX (shorter), SvCUR (shorter), utf8));
+    if (cut == 0) {
+	json_create_marker_ends_frame (jc);
+    }
+    jc->output_full = 1;
+    return json_create_ok;
+}
+
+/* Write "istring", which is longer than "max_string_bytes", cut short
+   at a character boundary and followed by the marker, or fail if
+   "truncate" is off. */
+
+static json_create_status_t
+json_create_add_long_string (json_create_t * jc, const char * istring,
+			     STRLEN ilength, int utf8)
+{
+    STRLEN cut;
+    SV * shorter;
+
+    if (! jc->truncate) {
+	json_create_user_message (jc, json_create_too_big,
+				  "String is longer than "
+				  "max_string_bytes=%u",
+				  jc->max_string_bytes);
+	return json_create_too_big;
+    }
+    cut = jc->max_string_bytes;
+    /* Non-utf8 strings are also UTF-8 as far as we are concerned. */
+    while (cut > 0 && (((unsigned char) istring[cut]) & 0xC0) == 0x80) {
+	cut--;
+    }
+    if (jc->max_output_bytes > 0 &&
+	! json_create_string_fits (jc, istring, cut + strlen (JCMARKER))) {
+	return json_create_add_last_string (jc, istring, cut, utf8);
+    }
+    shorter = sv_2mortal (newSVpvn (istring, cut));
+    sv_catpvs (shorter, JCMARKER);
+    return json_create_add_pv (jc, SvPVX (shorter), SvCUR (shorter), utf8);
+}
+
+/* Add the string "istring" of length "ilength", which is a value in
+   the input rather than a key, applying "max_string_bytes" and
+   "max_output_bytes". */
+
+static INLINE json_create_status_t
+json_create_add_value_pv (json_create_t * jc, const char * istring,
+			  STRLEN ilength, int utf8)
+{
+    if (jc->max_string_bytes > 0 && ilength > jc->max_string_bytes) {
+	return json_create_add_long_string (jc, istring, ilength, utf8);
+    }
+    if (jc->max_output_bytes > 0 &&
+	! json_create_string_fits (jc, istring, ilength)) {
+	return json_create_add_last_string (jc, istring, ilength, utf8);
+    }
+    return json_create_add_pv (jc, istring, ilength, utf8);
+}
+
+static INLINE json_create_status_t
+json_create_add_string (json_create_t * jc, SV * input)
+{
+    char * istring;
+    STRLEN ilength;
+
+    istring = SvPV (input, ilength);
+    return json_create_add_value_pv (jc, istring, ilength, SvUTF8 (input));
+}
+
+static INLINE json_create_status_t
+json_create_add_integer (json_create_t * jc, SV * sv)
+{
+    if (BINARY) {
+	return json_create_binary_integer (jc, sv);
+    }
+    if (SvIOK_UV(sv)) {
+	return json_create_core_uint (& jc->core, (uint64_t) SvUV (sv));
+    }
+    return json_create_core_int (& jc->core, (int64_t) SvIV (sv));
 }
 
 #define UNKNOWN_TYPE_FAIL(t)				\
@@ -913,42 +1327,37 @@ json_create_validate_user_json (json_create_t * jc, SV * json)
     return json_create_ok;
 }
 
+/* Add JSON from the user, either returned from a user routine or
+   from a JSON::Create::Raw object, to the output. If "trusted" is
+   true, it is not validated. */
+
 static json_create_status_t
-json_create_call_to_json (json_create_t * jc, SV * cv, SV * r)
+json_create_add_user_json (json_create_t * jc, SV * json, int trusted)
 {
-    SV * json;
     char * jsonc;
     STRLEN jsonl;
-    // https://metacpan.org/source/AMBS/Math-GSL-0.35/swig/gsl_typemaps.i#L438
-    dSP;
-    
-    ENTER;
-    SAVETMPS;
-    
-    PUSHMARK (SP);
-    //https://metacpan.org/source/AMBS/Math-GSL-0.35/swig/gsl_typemaps.i#L482
-    XPUSHs (sv_2mortal (newRV (r)));
-    PUTBACK;
-    call_sv (cv, 0);
-    json = POPs;
-    SvREFCNT_inc (json);
-    FREETMPS;
-    LEAVE;  
 
-    if (! SvOK (json)) {
-	/* User returned an undefined value. */
-	SvREFCNT_dec (json);
-	json_create_user_message (jc, json_create_undefined_return_value,
-				  "Undefined value from user routine");
-	return json_create_undefined_return_value;
+    if (BINARY) {
+	/* Already-encoded data in the same format, which we can't
+	   check. */
+	jsonc = SvPV (json, jsonl);
+	if (OVER_LIMIT (jsonl)) {
+	    return json_create_cut_value (jc);
+	}
+	return add_str_len (jc, jsonc, jsonl);
     }
     if (SvUTF8 (json)) {
 	/* We have to force everything in the whole output to
 	   Unicode. */
-	jc->unicode = 1;
+	jc->core.unicode = 1;
     }
     jsonc = SvPV (json, jsonl);
-    if (jc->validate) {
+    /* JSON can't be cut short, so it is left out if it doesn't
+       fit. */
+    if (OVER_LIMIT (jsonl)) {
+	return json_create_cut_value (jc);
+    }
+    if (jc->validate && ! trusted) {
 	CALL (json_create_validate_user_json (jc, json));
     }
     else {
@@ -965,57 +1374,136 @@ json_create_call_to_json (json_create_t * jc, SV * cv, SV * r)
 #ifdef INDENT
     }
 #endif
-    SvREFCNT_dec (json);
     return json_create_ok;
 }
 
+static json_create_status_t
+json_create_value (json_create_t * jc, SV * input);
+
+/* Call the user's routine "cv" with a reference to "r", and return
+   its return value, which the caller must decrement. */
+
+static SV *
+json_create_call_user (SV * cv, SV * r)
+{
+    SV * json;
+#ifdef HAVE_SDT
+    const char * classname;
+#endif /* def HAVE_SDT */
+    // https://metacpan.org/source/AMBS/Math-GSL-0.35/swig/gsl_typemaps.i#L438
+    dSP;
+
+#ifdef HAVE_SDT
+    classname = SvOBJECT (r) ? HvNAME_get (SvSTASH (r)) : 0;
+#endif /* def HAVE_SDT */
+    JCPROBE1 (handler__start, classname);
+    ENTER;
+    SAVETMPS;
+    
+    PUSHMARK (SP);
+    //https://metacpan.org/source/AMBS/Math-GSL-0.35/swig/gsl_typemaps.i#L482
+    XPUSHs (sv_2mortal (newRV (r)));
+    PUTBACK;
+    call_sv (cv, G_SCALAR);
+    /* The stack may have been moved by the user's routine. */
+    SPAGAIN;
+    json = POPs;
+    SvREFCNT_inc (json);
+    FREETMPS;
+    LEAVE;  
+    JCPROBE1 (handler__done, classname);
+    return json;
+}
+
+/* Add "json", which a user routine returned for "r", to the output,
+   and decrement it. If "trusted" is true, it is not validated. */
+
+static json_create_status_t
+json_create_add_returned (json_create_t * jc, SV * json, SV * r, int trusted)
+{
+    json_create_status_t status;
+
+    if (BINARY) {
+	/* There is no text to copy, so the user's routine gives us a
+	   Perl value to write out instead. "json" may go on the stack
+	   of frames, so it has to last until the end of the call. */
+	sv_2mortal (json);
+	if (SvROK (json) && SvRV (json) == r) {
+	    json_create_user_message (jc, json_create_invalid_user_json,
+				      "User routine returned its input");
+	    return json_create_invalid_user_json;
+	}
+	return json_create_value (jc, json);
+    }
+    if (! SvOK (json)) {
+	/* User returned an undefined value. */
+	SvREFCNT_dec (json);
+	json_create_user_message (jc, json_create_undefined_return_value,
+				  "Undefined value from user routine");
+	return json_create_undefined_return_value;
+    }
+    /* The status has already been handled inside
+       "json_create_add_user_json", so just pass it back. */
+    status = json_create_add_user_json (jc, json, trusted);
+    SvREFCNT_dec (json);
+    return status;
+}
+
+static json_create_status_t
+json_create_call_to_json (json_create_t * jc, SV * cv, SV * r)
+{
+    return json_create_add_returned (jc, json_create_call_user (cv, r),
+				     r, 0);
+}
+
+/* Call the handler "cv" for the object "r", or if "memoize_handlers"
+   is on and it has already been called for "r" in this call to
+   "json_create_create", use what it returned last time. */
+
+static json_create_status_t
+json_create_call_object_handler (json_create_t * jc, SV * cv, SV * r)
+{
+    SV ** json_ptr;
+    SV * json;
+
+    if (! jc->memo) {
+	return json_create_call_to_json (jc, cv, r);
+    }
+    json_ptr = hv_fetch (jc->memo, (char *) & r, sizeof (r), 0);
+    if (json_ptr) {
+	/* If it had failed validation, we would have stopped, so it
+	   doesn't need to be validated again. */
+	return json_create_add_returned (jc, SvREFCNT_inc (* json_ptr), r, 1);
+    }
+    json = json_create_call_user (cv, r);
+    (void) hv_store (jc->memo, (char *) & r, sizeof (r),
+		     SvREFCNT_inc (json), 0);
+    return json_create_add_returned (jc, json, r, 0);
+}
+
 static INLINE json_create_status_t
 json_create_add_float (json_create_t * jc, SV * sv)
 {
     double fv;
-    STRLEN fvlen;
     fv = SvNV (sv);
-    if (isfinite (fv)) {
-	if (jc->fformat) {
-	    fvlen = snprintf ((char *) jc->buffer + jc->length, MARGIN, jc->fformat, fv);
-	}
-	else {
-	    fvlen = snprintf ((char *) jc->buffer + jc->length, MARGIN,
-			      "%g", fv);
-	}
-	if (fvlen >= MARGIN) {
-	    return json_create_number_too_long;
+    if (BINARY) {
+	if (! isfinite (fv) && jc->non_finite_handler) {
+	    return json_create_call_to_json (jc, jc->non_finite_handler, sv);
 	}
-	jc->length += fvlen;
-	CHECKLENGTH;
+	return json_create_binary_float (jc, fv);
     }
-    else {
+    if (! isfinite (fv)) {
 	if (jc->non_finite_handler) {
-	    CALL (json_create_call_to_json (jc, jc->non_finite_handler, sv));
+	    return json_create_call_to_json (jc, jc->non_finite_handler, sv);
 	}
-	else {
-	    if (jc->strict) {
-		json_create_user_message (jc, json_create_non_finite_number,
-					  "Non-finite number in input");
-		return json_create_non_finite_number;
-	    }
-	    if (isnan (fv)) {
-		ADD ("\"nan\"");
-	    }
-	    else if (isinf (fv)) {
-		if (fv < 0.0) {
-		    ADD ("\"-inf\"");
-		}
-		else {
-		    ADD ("\"inf\"");
-		}
-	    }
-	    else {
-		return json_create_unknown_floating_point;
-	    }
+	if (jc->strict) {
+	    json_create_user_message (jc, json_create_non_finite_number,
+				      "Non-finite number in input");
+	    return json_create_non_finite_number;
 	}
     }
-    return json_create_ok;
+    /* Backtrace fall through. */
+    return json_create_core_double (& jc->core, fv);
 }
 
 static INLINE json_create_status_t
@@ -1070,7 +1558,7 @@ json_create_add_stringified (json_create_t * jc, SV *r)
 
      if (notdigits) {
 	 CALL (add_char (jc, '"'));
-	 CALL (add_str_len (jc, s, (unsigned int) rlen));
+	 CALL (add_str_len (jc, s, rlen));
 	 CALL (add_char (jc, '"'));
 	 return json_create_ok;
      }
@@ -1078,7 +1566,7 @@ json_create_add_stringified (json_create_t * jc, SV *r)
        should print out that it was calling "add_stringified", so as
        long as we're careful not to ignore the caller line, it
        shouldn't matter. */
-    return add_str_len (jc, s, (unsigned int) rlen);
+    return add_str_len (jc, s, rlen);
 }
 
 #ifdef INDENT
@@ -1086,24 +1574,26 @@ json_create_add_stringified (json_create_t * jc, SV *r)
 #define DDEC if (jc->indent) { jc->depth--; }
 #endif /* def INDENT */
 
-/* Add a comma where necessary. This is shared between objects and
-   arrays. */
+/* Add a comma where necessary, after "n" entries. This is shared
+   between objects and arrays. */
 
 #ifdef INDENT
-#define COMMA					\
-    if (i > 0) {				\
+#define COMMA_AFTER(n)				\
+    if ((n) > 0) {				\
 	CALL (add_char (jc, ','));		\
 	if (jc->indent) {			\
 	    CALL (newline_indent (jc));		\
 	}					\
     }
 #else /* INDENT */
-#define COMMA					\
-    if (i > 0) {				\
+#define COMMA_AFTER(n)				\
+    if ((n) > 0) {				\
 	CALL (add_char (jc, ','));		\
     }
 #endif /* INDENT */
 
+#define COMMA COMMA_AFTER (i)
+
 static INLINE json_create_status_t
 add_open (json_create_t * jc, unsigned char c)
 {
@@ -1139,6 +1629,34 @@ add_close (json_create_t * jc, unsigned char c)
     return json_create_ok;
 }
 
+/* Open an array if "c" is '[', or an object if "c" is '{', which has
+   "n" entries. */
+
+static INLINE json_create_status_t
+json_create_open (json_create_t * jc, unsigned char c, SSize_t n)
+{
+    if (BINARY) {
+	return json_create_binary_open (jc, c, n);
+    }
+    return add_open (jc, c);
+}
+
+/* Open the hash on top of the stack of frames, which has "n_keys"
+   keys. With "skip_undef", the brace is written with the first entry
+   whose value is defined, so that a hash with only undefined values
+   comes out as "{}". The binary formats need the number of entries
+   first, so they use "json_create_add_object_filtered" instead. */
+
+static INLINE json_create_status_t
+json_create_open_object (json_create_t * jc, SSize_t n_keys)
+{
+    if (jc->skip_undef && ! BINARY) {
+	jc->frames[jc->n_frames - 1].unopened = 1;
+	return json_create_ok;
+    }
+    return json_create_open (jc, '{', n_keys);
+}
+
 //#define JCDEBUGTYPES
 
 static int
@@ -1175,77 +1693,370 @@ json_create_user_compare (void * thunk, const void * va, const void * vb)
     return c;
 }
 
-static INLINE json_create_status_t
-json_create_add_object_sorted (json_create_t * jc, HV * input_hv)
+/* The depth up to which circular references are looked for by going
+   through the stack of frames. Past this, the arrays and hashes are
+   also put into "jc->active", so that finding one costs the same
+   however deep the stack is. */
+
+#define JCCIRCLEDEPTH 0x10
+
+/* Return a true value if "sv", which is about to be pushed, is
+   already on the stack of frames, in which case we have gone round in
+   a circle and we would never finish. */
+
+static int
+json_create_circular (json_create_t * jc, SV * sv)
 {
-    I32 n_keys;
-    int i;
-    SV ** keys;
+    int f;
 
-    n_keys = hv_iterinit (input_hv);
-    if (n_keys == 0) {
-	CALL (add_str_len (jc, "{}", strlen ("{}")));
-	return json_create_ok;
-    }
-    CALL (add_open (jc, '{'));
-    Newxz (keys, n_keys, SV *);
-    jc->n_mallocs++;
-    for (i = 0; i < n_keys; i++) {
-	HE * he;
-	he = hv_iternext (input_hv);
-	keys[i] = hv_iterkeysv (he);
-	if (HeUTF8 (he)) {
-	    jc->unicode = 1;
+    for (f = 0; f < jc->n_frames && f < JCCIRCLEDEPTH; f++) {
+	if (jc->frames[f].sv == sv) {
+	    return 1;
 	}
     }
+    if (jc->n_frames < JCCIRCLEDEPTH) {
+	return 0;
+    }
+    if (! jc->active) {
+	jc->active = newHV ();
+	if (jc->frames_sv) {
+	    jc->n_mallocs++;
+	}
+	else {
+	    /* This is freed even if a user routine or "fatal_errors"
+	       croaks halfway through, like the frames. */
+	    sv_2mortal ((SV *) jc->active);
+	}
+    }
+    if (hv_exists (jc->active, (char *) & sv, sizeof (sv))) {
+	return 1;
+    }
+    (void) hv_store (jc->active, (char *) & sv, sizeof (sv),
+		     SvREFCNT_inc_simple_NN (& PL_sv_yes), 0);
+    return 0;
+}
+
+/* Take "frame", which is past JCCIRCLEDEPTH, out of "jc->active". */
+
+static INLINE void
+json_create_inactive (json_create_t * jc, json_create_frame_t * frame)
+{
+    if (jc->active && frame - jc->frames >= JCCIRCLEDEPTH) {
+	(void) hv_delete (jc->active, (char *) & frame->sv,
+			  sizeof (frame->sv), G_DISCARD);
+    }
+}
+
+/* Put the array or hash "sv" on top of the stack of frames. The
+   entries of "sv" are then written out one at a time by
+   "json_create_next". */
+
+static INLINE json_create_status_t
+json_create_push (json_create_t * jc, SV * sv, json_create_frame_type_t type,
+		  SSize_t n_keys)
+{
+    json_create_frame_t * frame;
+
+    if (jc->max_depth > 0 && (unsigned int) jc->n_frames >= jc->max_depth) {
+	json_create_user_message (jc, json_create_too_deep,
+				  "Input is nested more deeply than "
+				  "max_depth=%u", jc->max_depth);
+	return json_create_too_deep;
+    }
+    if (json_create_circular (jc, sv)) {
+	json_create_user_message (jc, json_create_circular_reference,
+				  "Circular reference in input");
+	return json_create_circular_reference;
+    }
+    if (jc->n_frames >= jc->max_frames) {
+	int max_frames;
+	max_frames = 2 * jc->max_frames;
+	if (jc->frames_sv) {
+	    SvGROW (jc->frames_sv, max_frames * sizeof (json_create_frame_t));
+	    jc->frames = (json_create_frame_t *) SvPVX (jc->frames_sv);
+	}
+	else {
+	    SV * storage;
+	    /* The new frames are put into a mortal so that they are
+	       freed even if a user routine or "fatal_errors" croaks
+	       halfway through. */
+	    storage = sv_2mortal (newSV (max_frames *
+					 sizeof (json_create_frame_t)));
+	    Copy (jc->frames, SvPVX (storage), jc->n_frames,
+		  json_create_frame_t);
+	    jc->frames = (json_create_frame_t *) SvPVX (storage);
+	}
+	jc->max_frames = max_frames;
+    }
+    if (jc->frames_sv) {
+	SvREFCNT_inc (sv);
+    }
+    frame = jc->frames + jc->n_frames;
+    frame->sv = sv;
+    frame->keys = 0;
+    frame->n_keys = n_keys;
+    frame->i = 0;
+    frame->n_written = 0;
+    frame->type = type;
+    frame->truncated = 0;
+    frame->unopened = 0;
+    jc->n_frames++;
+    return json_create_ok;
+}
+
+/* Free the keys of a sorted hash. */
+
+static INLINE void
+json_create_free_keys (json_create_t * jc, json_create_frame_t * frame)
+{
+    if (frame->keys) {
+	if (jc->frames_sv) {
+	    SSize_t i;
+	    for (i = 0; i < frame->n_keys; i++) {
+		SvREFCNT_dec (frame->keys[i]);
+	    }
+	}
+	Safefree (frame->keys);
+	frame->keys = 0;
+	jc->n_mallocs--;
+    }
+}
+
+/* Take the top frame off the stack and close its brackets. */
+
+static INLINE json_create_status_t
+json_create_pop (json_create_t * jc)
+{
+    json_create_frame_t * frame;
+
+    jc->n_frames--;
+    frame = jc->frames + jc->n_frames;
+    json_create_free_keys (jc, frame);
+    json_create_inactive (jc, frame);
+    if (jc->frames_sv) {
+	SvREFCNT_dec (frame->sv);
+    }
+    if (BINARY) {
+	/* The length went at the start. */
+	return json_create_ok;
+    }
+    if (frame->unopened) {
+	/* "skip_undef" left out all of the entries. */
+	return add_str_len (jc, "{}", strlen ("{}"));
+    }
+    if (frame->type == json_create_frame_array) {
+	CALL (add_close (jc, ']'));
+    }
+    else {
+	CALL (add_close (jc, '}'));
+    }
+    return json_create_ok;
+}
+
+/* Throw away all of the frames after an error. */
 
+static void
+json_create_unwind (json_create_t * jc)
+{
+    while (jc->n_frames > 0) {
+	jc->n_frames--;
+	json_create_free_keys (jc, jc->frames + jc->n_frames);
+	json_create_inactive (jc, jc->frames + jc->n_frames);
+	if (jc->frames_sv) {
+	    SvREFCNT_dec (jc->frames[jc->n_frames].sv);
+	}
+    }
+}
+
+/* Compare the hash keys "a" and "b" in the order of RFC 8785. */
+
+static I32
+json_create_utf16_sv_cmp (pTHX_ SV * const a, SV * const b)
+{
+    const char * as;
+    const char * bs;
+    STRLEN alen;
+    STRLEN blen;
+
+    as = SvPV (a, alen);
+    bs = SvPV (b, blen);
+    return json_create_core_utf16_cmp ((const unsigned char *) as, alen,
+				       (const unsigned char *) bs, blen);
+}
+
+/* Sort the "n_keys" hash keys in "keys". */
+
+static INLINE void
+json_create_sort_keys (json_create_t * jc, SV ** keys, I32 n_keys)
+{
+    JCPROBE1 (sort__start, n_keys);
     if (jc->cmp) {
 	json_create_qsort_r (keys, n_keys, sizeof (SV **), jc,
 			     json_create_user_compare);
     }
+    else if (jc->core.canonical) {
+	sortsv_flags (keys, (size_t) n_keys, json_create_utf16_sv_cmp, 0);
+    }
     else {
 	sortsv_flags (keys, (size_t) n_keys, Perl_sv_cmp, /* flags */ 0);
     }
+    JCPROBE1 (sort__done, n_keys);
+}
+
+static INLINE json_create_status_t
+json_create_add_object_sorted (json_create_t * jc, HV * input_hv)
+{
+    I32 n_keys;
+    int i;
+    SV ** keys;
 
+    n_keys = hv_iterinit (input_hv);
+    if (n_keys == 0) {
+	if (BINARY) {
+	    return json_create_open (jc, '{', 0);
+	}
+	CALL (add_str_len (jc, "{}", strlen ("{}")));
+	return json_create_ok;
+    }
+    CALL (json_create_push (jc, (SV *) input_hv, json_create_frame_sorted,
+			    n_keys));
+    CALL (json_create_open_object (jc, n_keys));
+    Newxz (keys, n_keys, SV *);
+    jc->n_mallocs++;
+    jc->frames[jc->n_frames - 1].keys = keys;
     for (i = 0; i < n_keys; i++) {
-	SV * key_sv;
-	char * key;
-	STRLEN keylen;
 	HE * he;
-
-	COMMA;
-	key_sv = keys[i];
-	key = SvPV (key_sv, keylen);
-	CALL (json_create_add_key_len (jc, (const unsigned char *) key,
-				       keylen));
-	he = hv_fetch_ent (input_hv, key_sv, 0, 0);
-	if (! he) {
-	    croak ("%s:%d: invalid sv_ptr for '%s' at offset %d",
-		   __FILE__, __LINE__, key, i);
+	he = hv_iternext (input_hv);
+	keys[i] = hv_iterkeysv (he);
+	if (jc->frames_sv) {
+	    /* "hv_iterkeysv" gives us a mortal. */
+	    SvREFCNT_inc (keys[i]);
+	}
+	if (HeUTF8 (he)) {
+	    jc->core.unicode = 1;
 	}
-	CALL (add_char (jc, ':'));
-	CALL (json_create_recursively (jc, HeVAL(he)));
     }
-    Safefree (keys);
-    jc->n_mallocs--;
 
-    CALL (add_close (jc, '}'));
+    json_create_sort_keys (jc, keys, n_keys);
+    return json_create_ok;
+}
+
+/* Write the keys of "input_hv" which are in "include", or all of them
+   if "include" is zero, except for the ones in "exclude_keys", and
+   the ones with undefined values if "skip_undef" is on. The keys are
+   counted before anything is written, so that empty hashes and the
+   lengths of CBOR and MessagePack maps come out right. For JSON,
+   "skip_undef" on its own is dealt with by "json_create_next". */
+
+static json_create_status_t
+json_create_add_object_filtered (json_create_t * jc, HV * input_hv,
+				 AV * include)
+{
+    I32 max_keys;
+    I32 n_keys;
+    I32 i;
+    SV ** keys;
+    json_create_status_t status;
 
+    if (include) {
+	max_keys = av_len (include) + 1;
+    }
+    else {
+	max_keys = hv_iterinit (input_hv);
+    }
+    n_keys = 0;
+    keys = 0;
+    if (max_keys > 0) {
+	Newx (keys, max_keys, SV *);
+    }
+    for (i = 0; i < max_keys; i++) {
+	SV * key;
+	HE * he;
+	if (include) {
+	    key = AvARRAY (include)[i];
+	    he = hv_fetch_ent (input_hv, key, 0, 0);
+	    if (! he) {
+		continue;
+	    }
+	    if (jc->skip_undef && ! SvOK (HeVAL (he))) {
+		continue;
+	    }
+	    if (jc->exclude_keys && hv_exists_ent (jc->exclude_keys, key, 0)) {
+		continue;
+	    }
+	}
+	else {
+	    he = hv_iternext (input_hv);
+	    if (jc->skip_undef && ! SvOK (hv_iterval (input_hv, he))) {
+		continue;
+	    }
+	    key = hv_iterkeysv (he);
+	    if (jc->exclude_keys &&
+		hv_exists_ent (jc->exclude_keys, key, HeHASH (he))) {
+		continue;
+	    }
+	}
+	if (SvUTF8 (key)) {
+	    jc->core.unicode = 1;
+	}
+	keys[n_keys] = key;
+	n_keys++;
+    }
+    if (n_keys == 0) {
+	Safefree (keys);
+	if (BINARY) {
+	    return json_create_open (jc, '{', 0);
+	}
+	CALL (add_str_len (jc, "{}", strlen ("{}")));
+	return json_create_ok;
+    }
+    status = json_create_push (jc, (SV *) input_hv, json_create_frame_sorted,
+			       n_keys);
+    if (status != json_create_ok) {
+	Safefree (keys);
+	return status;
+    }
+    jc->frames[jc->n_frames - 1].keys = keys;
+    jc->n_mallocs++;
+    if (jc->frames_sv) {
+	for (i = 0; i < n_keys; i++) {
+	    SvREFCNT_inc (keys[i]);
+	}
+    }
+    CALL (json_create_open (jc, '{', n_keys));
+#ifdef INDENT
+    if (jc->sort) {
+	json_create_sort_keys (jc, keys, n_keys);
+    }
+#endif /* INDENT */
     return json_create_ok;
 }
 
-/* Given a reference to a hash in "input_hv", recursively process it
-   into JSON. "object" here means "JSON object", not "Perl object". */
+/* Given a reference to a hash in "input_hv", start processing it into
+   JSON. "object" here means "JSON object", not "Perl object". */
 
 static INLINE json_create_status_t
 json_create_add_object (json_create_t * jc, HV * input_hv)
 {
     I32 n_keys;
-    int i;
-    SV * value;
-    char * key;
-    /* I32 is correct, not STRLEN; see hv.c. */
-    I32 keylen;
+    if (jc->include_keys || jc->exclude_keys || jc->obj_keys ||
+	jc->skip_undef) {
+	AV * include;
+	include = jc->include_keys;
+	if (jc->obj_keys && SvOBJECT (input_hv)) {
+	    HV * stash;
+	    SV ** svp;
+	    stash = SvSTASH (input_hv);
+	    svp = hv_fetch (jc->obj_keys, HvNAME_get (stash),
+			    HvNAMELEN_get (stash), 0);
+	    if (svp) {
+		include = (AV *) SvRV (* svp);
+	    }
+	}
+	if (include || jc->exclude_keys || (jc->skip_undef && BINARY)) {
+	    return json_create_add_object_filtered (jc, input_hv, include);
+	}
+    }
 #ifdef INDENT
     if (jc->sort) {
        	return json_create_add_object_sorted (jc, input_hv);
@@ -1253,79 +2064,63 @@ json_create_add_object (json_create_t * jc, HV * input_hv)
 #endif /* INDENT */
     n_keys = hv_iterinit (input_hv);
     if (n_keys == 0) {
+	if (BINARY) {
+	    return json_create_open (jc, '{', 0);
+	}
 	CALL (add_str_len (jc, "{}", strlen ("{}")));
 	return json_create_ok;
     }
-    CALL (add_open (jc, '{'));
-    for (i = 0; i < n_keys; i++) {
-	HE * he;
+    CALL (json_create_push (jc, (SV *) input_hv, json_create_frame_object,
+			    n_keys));
+    CALL (json_create_open_object (jc, n_keys));
+    return json_create_ok;
+}
 
-	/* Get the information from the hash. */
-	/* The following is necessary because "hv_iternextsv" doesn't
-	   tell us whether the key is "SvUTF8" or not. */
-	he = hv_iternext (input_hv);
-	key = hv_iterkey (he, & keylen);
-	value = hv_iterval (input_hv, he);
+/* Given an array reference in "av", start processing it into
+   JSON. */
 
-	/* Write the information into the buffer. */
+/* Apply "max_array_items" to an array of "* n_ptr" items. If it is
+   too long, "* n_ptr" becomes the number of items to write and
+   "* truncated_ptr" becomes true, or it fails if "truncate" is
+   off. */
 
-	COMMA;
-	if (HeUTF8 (he)) {
-	    jc->unicode = 1;
-	    CALL (json_create_add_key_len (jc, (const unsigned char *) key,
-					   (STRLEN) keylen));
-	}
-	else if (jc->strict) {
-	    CALL (json_create_add_ascii_key_len (jc, (unsigned char *) key,
-						 (STRLEN) keylen));
-	}
-	else {
-	    CALL (json_create_add_key_len (jc, (const unsigned char *) key,
-					   (STRLEN) keylen));
+static json_create_status_t
+json_create_array_items (json_create_t * jc, SSize_t * n_ptr,
+			 int * truncated_ptr)
+{
+    * truncated_ptr = 0;
+    if (jc->max_array_items > 0 && (UV) * n_ptr > jc->max_array_items) {
+	if (! jc->truncate) {
+	    json_create_user_message (jc, json_create_too_big,
+				      "Array has more than "
+				      "max_array_items=%u items",
+				      jc->max_array_items);
+	    return json_create_too_big;
 	}
-	CALL (add_char (jc, ':'));
-	MSG ("Creating value of hash");
-	CALL (json_create_recursively (jc, value));
+	* n_ptr = (SSize_t) jc->max_array_items;
+	* truncated_ptr = 1;
     }
-    CALL (add_close (jc, '}'));
     return json_create_ok;
 }
 
-/* Given an array reference in "av", recursively process it into
-   JSON. */
-
 static INLINE json_create_status_t
 json_create_add_array (json_create_t * jc, AV * av)
 {
-    I32 n_keys;
-    int i;
-    SV * value;
-    SV ** avv;
-
-    MSG ("Adding first char [");
-    CALL (add_open (jc, '['));
-    n_keys = av_len (av) + 1;
-    MSG ("n_keys = %ld", n_keys);
+    SSize_t n;
+    int truncated;
 
     /* This deals correctly with empty arrays, since av_len is -1 if
-       the array is empty, so we do not test for a valid n_keys value
-       before entering the loop. */
-    for (i = 0; i < n_keys; i++) {
-	MSG ("i = %d", i);
-	COMMA;
-
-	avv = av_fetch (av, i, 0 /* don't delete the array value */);
-	if (avv) {
-	    value = * avv;
-	}
-	else {
-	    MSG ("null value returned by av_fetch");
-	    value = & PL_sv_undef;
-	}
-	CALL (json_create_recursively (jc, value));
+       the array is empty. */
+    n = av_len (av) + 1;
+    CALL (json_create_array_items (jc, & n, & truncated));
+    if (truncated) {
+	/* The last entry is the marker. */
+	n++;
     }
-    MSG ("Adding last char ]");
-    CALL (add_close (jc, ']'));
+    CALL (json_create_push (jc, (SV *) av, json_create_frame_array, n));
+    jc->frames[jc->n_frames - 1].truncated = truncated;
+    MSG ("Adding first char [");
+    CALL (json_create_open (jc, '[', n));
     return json_create_ok;
 }
 
@@ -1347,6 +2142,49 @@ json_create_handle_unknown_type (json_create_t * jc, SV * r)
 	goto handle_type;						\
     }
 
+static json_create_status_t
+json_create_cached (json_create_t * jc, SV * r, SV * version, int readonly);
+
+/* Is the array or hash "r" tied, or otherwise magical? The weak
+   reference to "r" kept in the cache gives arrays "backref" magic,
+   which doesn't count. */
+
+static int
+json_create_magical (SV * r)
+{
+    MAGIC * mg;
+
+    if (! SvRMAGICAL (r)) {
+	return 0;
+    }
+    for (mg = SvMAGIC (r); mg; mg = mg->mg_moremagic) {
+	if (mg->mg_type != PERL_MAGIC_backref) {
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+/* Should the array or hash "r" be looked for in the cache? Only
+   arrays and hashes which are read-only all the way down are cached,
+   since "lock_keys" and other restricted hashes are read-only but
+   their values can still change, but that is only checked when "r"
+   is put into the cache. */
+
+#define USE_CACHE(r)							\
+    (jc->cache_readonly && jc->cache_ok && ! jc->in_cache &&		\
+     SvREADONLY (r) && ! json_create_magical (r))
+
+/* With "truncate", put the marker in place of arrays and hashes
+   nested more deeply than "max_depth". */
+
+#define DEPTH_MARKER							\
+    if (jc->truncate && jc->max_depth > 0 &&				\
+	(unsigned int) jc->n_frames >= jc->max_depth) {			\
+	CALL (json_create_add_marker (jc));				\
+	break;								\
+    }
+
 static INLINE json_create_status_t
 json_create_handle_ref (json_create_t * jc, SV * r)
 {
@@ -1356,11 +2194,21 @@ json_create_handle_ref (json_create_t * jc, SV * r)
     switch (t) {
     case SVt_PVAV:
 	MSG("Array");
+	DEPTH_MARKER;
+	if (USE_CACHE (r)) {
+	    CALL (json_create_cached (jc, r, 0, 1));
+	    break;
+	}
 	CALL (json_create_add_array (jc, (AV *) r));
 	break;
 
     case SVt_PVHV:
 	MSG("Hash");
+	DEPTH_MARKER;
+	if (USE_CACHE (r)) {
+	    CALL (json_create_cached (jc, r, 0, 1));
+	    break;
+	}
 	CALL (json_create_add_object (jc, (HV *) r));
 	break;
 
@@ -1408,69 +2256,424 @@ json_create_handle_ref (json_create_t * jc, SV * r)
     return json_create_unknown_type;
 
 
-static INLINE json_create_status_t
-json_create_handle_object (json_create_t * jc, SV * r,
-			   const char * objtype, I32 olen)
+/* Is "s" of length "len" a JSON number? */
+
+static int
+json_create_is_json_number (const char * s, STRLEN len)
 {
-    SV ** sv_ptr;
-#ifdef DEBUGOBJ
-    fprintf (stderr, "Have found an object of type %s.\n", objtype);
-#endif
-    sv_ptr = hv_fetch (jc->handlers, objtype, olen, 0);
-    if (sv_ptr) {
-	char * pv;
-	STRLEN pvlen;
-	pv = SvPV (*sv_ptr, pvlen);
-#ifdef DEBUGOBJ
-	fprintf (stderr, "Have found a handler %s for %s.\n", pv, objtype);
-#endif
-	if (pvlen == strlen ("bool") &&
-	    strncmp (pv, "bool", 4) == 0) {
-	    if (SvTRUE (r)) {
-		ADD ("true");
-	    }
-	    else {
-		ADD ("false");
-	    }
+    STRLEN i;
+
+    i = 0;
+    if (i < len && s[i] == '-') {
+	i++;
+    }
+    if (i < len && s[i] == '0') {
+	i++;
+    }
+    else if (i < len && s[i] >= '1' && s[i] <= '9') {
+	while (i < len && isDIGIT (s[i])) {
+	    i++;
 	}
-	else if (SvROK (*sv_ptr)) {
-	    SV * what;
-	    what = SvRV (*sv_ptr);
-	    switch (SvTYPE (what)) {
-	    case SVt_PVCV:
-		CALL (json_create_call_to_json (jc, what, r));
-		break;
-	    default:
-		/* Weird handler, not a code reference. */
-		goto nothandled;
-	    }
+    }
+    else {
+	return 0;
+    }
+    if (i < len && s[i] == '.') {
+	i++;
+	if (i == len || ! isDIGIT (s[i])) {
+	    return 0;
 	}
-	else {
-	    /* It's an object, it's in our handlers, but we don't
-	       have any code to deal with it, so we'll print an
-	       error and then stringify it. */
-	    if (JCEH) {
-		(*JCEH) (__FILE__, __LINE__, "Unhandled handler %s.\n",
-			 pv);
-		goto nothandled;
-	    }
+	while (i < len && isDIGIT (s[i])) {
+	    i++;
 	}
     }
-    else {
-#ifdef DEBUGOBJ
-	/* Leaving this debugging code here since this is liable
-	   to change a lot. */
-	I32 hvnum;
-	SV * s;
-	char * key;
-	I32 retlen;
-	fprintf (stderr, "Nothing in handlers for %s.\n", objtype);
-	hvnum = hv_iterinit (jc->handlers);
-
-	fprintf (stderr, "There are %ld keys in handlers.\n", hvnum);
-	while (1) {
-	    s = hv_iternextsv (jc->handlers, & key, & retlen);
-	    if (! s) {
+    if (i < len && (s[i] == 'e' || s[i] == 'E')) {
+	i++;
+	if (i < len && (s[i] == '+' || s[i] == '-')) {
+	    i++;
+	}
+	if (i == len || ! isDIGIT (s[i])) {
+	    return 0;
+	}
+	while (i < len && isDIGIT (s[i])) {
+	    i++;
+	}
+    }
+    return i == len;
+}
+
+/* Is "s" of length "len", which is a JSON number, an integer? */
+
+static int
+json_create_is_json_integer (const char * s, STRLEN len)
+{
+    STRLEN i;
+
+    for (i = 0; i < len; i++) {
+	if (s[i] == '.' || s[i] == 'e' || s[i] == 'E') {
+	    return 0;
+	}
+    }
+    return 1;
+}
+
+/* Write the decimal digits "s" of length "len", an integer too big
+   for 64 bits, as a CBOR bignum. The bytes of a negative bignum are
+   minus one minus the number. */
+
+static json_create_status_t
+cbor_bignum (json_create_t * jc, const char * s, STRLEN len, int negative)
+{
+    unsigned char * digits;
+    unsigned char * bytes;
+    STRLEN start;
+    STRLEN n_bytes;
+    STRLEN i;
+
+    /* There are fewer bytes than digits. The buffer is mortal so
+       that it is freed if writing the output fails. */
+    digits = (unsigned char *) SvPVX (sv_2mortal (newSV (2 * len)));
+    bytes = digits + len;
+    for (i = 0; i < len; i++) {
+	digits[i] = s[i] - '0';
+    }
+    /* Divide the digits by 256 until nothing is left, to get the
+       bytes from the least significant. */
+    start = 0;
+    n_bytes = 0;
+    while (start < len) {
+	unsigned int rem;
+	rem = 0;
+	for (i = start; i < len; i++) {
+	    unsigned int d;
+	    d = rem * 10 + digits[i];
+	    digits[i] = d / 256;
+	    rem = d % 256;
+	}
+	bytes[n_bytes++] = rem;
+	while (start < len && digits[start] == 0) {
+	    start++;
+	}
+    }
+    if (negative) {
+	/* The number is bigger than 64 bits, so this can't go below
+	   zero. */
+	for (i = 0; bytes[i] == 0; i++) {
+	    bytes[i] = 0xFF;
+	}
+	bytes[i]--;
+	while (n_bytes > 1 && bytes[n_bytes - 1] == 0) {
+	    n_bytes--;
+	}
+    }
+    CALL (cbor_head (jc, CBOR_TAG, negative ? CBOR_NEGATIVE_BIGNUM :
+		     CBOR_POSITIVE_BIGNUM));
+    CALL (cbor_head (jc, CBOR_BYTES, (uint64_t) n_bytes));
+    for (i = n_bytes; i > 0; i--) {
+	CALL (add_char (jc, bytes[i - 1]));
+    }
+    return json_create_ok;
+}
+
+/* Write the JSON number "s" of length "len" as a binary number. */
+
+static json_create_status_t
+json_create_binary_number (json_create_t * jc, const char * s, STRLEN len)
+{
+    const char * digits;
+    STRLEN n_digits;
+    uint64_t u;
+    STRLEN i;
+    int negative;
+
+    if (! json_create_is_json_integer (s, len)) {
+	return json_create_binary_float (jc, Atof (s));
+    }
+    negative = (s[0] == '-');
+    digits = s + negative;
+    n_digits = len - negative;
+    u = 0;
+    for (i = 0; i < n_digits; i++) {
+	unsigned int d;
+	d = digits[i] - '0';
+	if (u > (UINT64_MAX - d) / 10) {
+	    break;
+	}
+	u = u * 10 + d;
+    }
+    if (i == n_digits) {
+	if (! negative) {
+	    return json_create_binary_unsigned (jc, u);
+	}
+	if (u <= (uint64_t) INT64_MAX + 1) {
+	    /* This is written so that -2^63 doesn't overflow, and "-0"
+	       is zero. */
+	    return json_create_binary_signed (jc, u == 0 ? 0 :
+					      - (int64_t) (u - 1) - 1);
+	}
+    }
+    /* MessagePack has no bigger integers. */
+    if (jc->format == json_create_format_msgpack) {
+	return json_create_binary_float (jc, Atof (s));
+    }
+    return cbor_bignum (jc, digits, n_digits, negative);
+}
+
+/* Should the integer "s" of length "len" be quoted, because of
+   "quote_ints" or "quote_big_ints"? */
+
+static int
+json_create_quote_integer (json_create_t * jc, const char * s, STRLEN len)
+{
+    if (jc->core.quote_ints) {
+	return 1;
+    }
+    if (! jc->core.quote_big_ints) {
+	return 0;
+    }
+    if (s[0] == '-') {
+	s++;
+	len--;
+    }
+    /* JSON integers have no leading zeros, so the number of digits
+       decides, unless there are sixteen, the same as 2^53. */
+    if (len != 16) {
+	return len > 16;
+    }
+    return memcmp (s, "9007199254740992", 16) >= 0;
+}
+
+/* Write the object "input" as a bare number, from its string form,
+   for classes like Math::BigInt. Things like "NaN" and "inf" become
+   strings, like non-finite floating point numbers. */
+
+static json_create_status_t
+json_create_builtin_number (json_create_t * jc, SV * input)
+{
+    const char * pv;
+    STRLEN pvlen;
+
+    pv = SvPV (input, pvlen);
+    if (json_create_is_json_number (pv, pvlen)) {
+	if (BINARY) {
+	    return json_create_binary_number (jc, pv, pvlen);
+	}
+	if (json_create_is_json_integer (pv, pvlen) &&
+	    json_create_quote_integer (jc, pv, pvlen)) {
+	    CALL (add_char (jc, '"'));
+	    CALL (add_str_len (jc, pv, pvlen));
+	    return add_char (jc, '"');
+	}
+	return add_str_len (jc, pv, pvlen);
+    }
+    if (jc->strict) {
+	json_create_user_message (jc, json_create_non_finite_number,
+				  "Non-finite number in input");
+	return json_create_non_finite_number;
+    }
+    return json_create_add_pv (jc, pv, pvlen, SvUTF8 (input));
+}
+
+/* Write the object "input" as a string. URI objects are references
+   to their string, so that is used directly. Other objects are
+   stringified, usually by their overloaded "" operator. */
+
+static json_create_status_t
+json_create_builtin_string (json_create_t * jc, SV * input, SV * r,
+			    const char * objtype, I32 olen)
+{
+    const char * pv;
+    STRLEN pvlen;
+    SV * sv;
+
+    sv = input;
+    if ((olen == 3 || (olen > 5 && strncmp (objtype + 3, "::", 2) == 0)) &&
+	strncmp (objtype, "URI", 3) == 0 &&
+	SvPOK (r) && ! SvROK (r) && ! SvGMAGICAL (r)) {
+	sv = r;
+    }
+    pv = SvPV (sv, pvlen);
+    return json_create_add_value_pv (jc, pv, pvlen, SvUTF8 (sv));
+}
+
+#define TIME_PIECE "Time::Piece"
+
+/* Write the object "input" as an ISO 8601 date and time. Time::Piece
+   objects are arrays of the fields of "struct tm", which are read
+   directly. Objects with an "iso8601" method, such as DateTime, use
+   that, and others, such as Time::Moment, are stringified. */
+
+/* The "iso8601" method of "stash", or zero. Objects in a list are
+   usually all of the same class, so the last one is kept, until the
+   methods of the class or its parents change. */
+
+static CV *
+json_create_iso8601_method (json_create_t * jc, HV * stash)
+{
+    GV * gv;
+    struct mro_meta * meta;
+    U32 gen;
+
+    /* "pkg_gen" changes with the methods of "stash" itself, and
+       "cache_gen" with those of its parents. */
+    meta = HvMROMETA (stash);
+    gen = PL_sub_generation + meta->pkg_gen + meta->cache_gen;
+    if (stash == jc->iso8601_stash && gen == jc->iso8601_gen) {
+	return jc->iso8601_cv;
+    }
+    gv = gv_fetchmethod_autoload (stash, "iso8601", 0);
+    jc->iso8601_cv = (gv && isGV (gv)) ? GvCV (gv) : 0;
+    jc->iso8601_stash = stash;
+    jc->iso8601_gen = gen;
+    return jc->iso8601_cv;
+}
+
+static json_create_status_t
+json_create_builtin_iso8601 (json_create_t * jc, SV * input, SV * r,
+			     const char * objtype, I32 olen)
+{
+    CV * method;
+
+    if (olen == strlen (TIME_PIECE) && strcmp (objtype, TIME_PIECE) == 0 &&
+	SvTYPE (r) == SVt_PVAV && av_len ((AV *) r) >= 5) {
+	/* The indices of the fields in a Time::Piece. */
+	enum {sec, min, hour, mday, mon, year};
+	IV f[year + 1];
+	char buf[0x40];
+	int i;
+	int len;
+	for (i = sec; i <= year; i++) {
+	    SV ** field;
+	    field = av_fetch ((AV *) r, i, 0);
+	    if (! field) {
+		goto stringify;
+	    }
+	    f[i] = SvIV (* field);
+	}
+	len = snprintf (buf, sizeof (buf),
+			"%04" IVdf "-%02" IVdf "-%02" IVdf
+			"T%02" IVdf ":%02" IVdf ":%02" IVdf,
+			f[year] + 1900, f[mon] + 1, f[mday],
+			f[hour], f[min], f[sec]);
+	if (len < 0 || len >= (int) sizeof (buf)) {
+	    goto stringify;
+	}
+	return json_create_add_pv (jc, buf, (STRLEN) len, 0);
+    }
+    method = json_create_iso8601_method (jc, SvSTASH (r));
+    if (method) {
+	SV * iso;
+	json_create_status_t status;
+	iso = json_create_call_user ((SV *) method, r);
+	if (! SvOK (iso)) {
+	    SvREFCNT_dec (iso);
+	    json_create_user_message (jc, json_create_undefined_return_value,
+				      "Undefined value from user routine");
+	    return json_create_undefined_return_value;
+	}
+	status = json_create_builtin_string (jc, iso, iso, "", 0);
+	SvREFCNT_dec (iso);
+	return status;
+    }
+ stringify:
+    return json_create_builtin_string (jc, input, r, objtype, olen);
+}
+
+/* Write the object "input", which is a reference to "r", using the
+   built-in handler named "kind" of length "kind_len", such as
+   "bool". The return value is false if there is no such kind of
+   handler. */
+
+static int
+json_create_builtin_handler (json_create_t * jc, SV * input, SV * r,
+			     const char * objtype, I32 olen,
+			     const char * kind, STRLEN kind_len,
+			     json_create_status_t * status_ptr)
+{
+#define KIND(x) (kind_len == strlen (#x) && strncmp (kind, #x, kind_len) == 0)
+    json_create_status_t status;
+
+    status = json_create_ok;
+    if (KIND (bool)) {
+	status = json_create_add_literal (jc, SvTRUE (r) ? json_create_true :
+					  json_create_false);
+    }
+    else if (KIND (number)) {
+	status = json_create_builtin_number (jc, input);
+    }
+    else if (KIND (string)) {
+	status = json_create_builtin_string (jc, input, r, objtype, olen);
+    }
+    else if (KIND (iso8601)) {
+	status = json_create_builtin_iso8601 (jc, input, r, objtype, olen);
+    }
+    else {
+	return 0;
+    }
+#undef KIND
+    * status_ptr = status;
+    return 1;
+}
+
+static INLINE json_create_status_t
+json_create_handle_object (json_create_t * jc, SV * input, SV * r,
+			   const char * objtype, I32 olen)
+{
+    SV ** sv_ptr;
+#ifdef DEBUGOBJ
+    fprintf (stderr, "Have found an object of type %s.\n", objtype);
+#endif
+    sv_ptr = hv_fetch (jc->handlers, objtype, olen, 0);
+    if (sv_ptr) {
+	char * pv;
+	STRLEN pvlen;
+	pv = SvPV (*sv_ptr, pvlen);
+#ifdef DEBUGOBJ
+	fprintf (stderr, "Have found a handler %s for %s.\n", pv, objtype);
+#endif
+	if (SvROK (*sv_ptr)) {
+	    SV * what;
+	    what = SvRV (*sv_ptr);
+	    switch (SvTYPE (what)) {
+	    case SVt_PVCV:
+		CALL (json_create_call_object_handler (jc, what, r));
+		break;
+	    default:
+		/* Weird handler, not a code reference. */
+		goto nothandled;
+	    }
+	}
+	else {
+	    json_create_status_t status;
+	    if (json_create_builtin_handler (jc, input, r, objtype, olen,
+					     pv, pvlen, & status)) {
+		return status;
+	    }
+	    /* It's an object, it's in our handlers, but we don't
+	       have any code to deal with it, so we'll print an
+	       error and then stringify it. */
+	    if (JCEH) {
+		(*JCEH) (__FILE__, __LINE__, "Unhandled handler %s.\n",
+			 pv);
+		goto nothandled;
+	    }
+	}
+    }
+    else {
+#ifdef DEBUGOBJ
+	/* Leaving this debugging code here since this is liable
+	   to change a lot. */
+	I32 hvnum;
+	SV * s;
+	char * key;
+	I32 retlen;
+	fprintf (stderr, "Nothing in handlers for %s.\n", objtype);
+	hvnum = hv_iterinit (jc->handlers);
+
+	fprintf (stderr, "There are %ld keys in handlers.\n", hvnum);
+	while (1) {
+	    s = hv_iternextsv (jc->handlers, & key, & retlen);
+	    if (! s) {
 		break;
 	    }
 	    fprintf (stderr, "%s: %s\n", key, SvPV_nolen (s));
@@ -1487,6 +2690,247 @@ json_create_handle_object (json_create_t * jc, SV * r,
 
 #define JCBOOL "JSON::Create::Bool"
 
+/* Classes of booleans from other modules, which are written as
+   "true" or "false" unless there is a handler for them. Types::Serialiser
+   and Mojo::JSON use JSON::PP::Boolean. */
+
+static const char * const json_create_bool_classes[JCBOOLCLASSES] = {
+    "JSON::PP::Boolean",
+    "boolean",
+    "Mojo::JSON::_Bool",
+    "JSON::Tiny::_Bool",
+};
+
+/* Look up the stashes of "json_create_bool_classes", so that objects
+   only need their stash pointers compared. The stashes are made if
+   the classes are not loaded yet, as JSON::XS does, so that they are
+   the same stashes when the classes are loaded later. */
+
+static void
+json_create_find_bool_stashes (json_create_t * jc)
+{
+    int i;
+
+    for (i = 0; i < JCBOOLCLASSES; i++) {
+	jc->bool_stashes[i] = gv_stashpv (json_create_bool_classes[i],
+					  GV_ADD);
+    }
+}
+
+/* Is "stash" the stash of one of "json_create_bool_classes"? */
+
+static INLINE int
+json_create_is_bool_class (json_create_t * jc, HV * stash)
+{
+    int i;
+
+    for (i = 0; i < JCBOOLCLASSES; i++) {
+	if (jc->bool_stashes[i] == stash) {
+	    return 1;
+	}
+    }
+    return 0;
+}
+#define JCRAW "JSON::Create::Raw"
+#define JCCACHED "JSON::Create::Cached"
+#define JCPACKED "JSON::Create::Packed"
+
+/* Add the JSON from a JSON::Create::Raw object. "r" is the array
+   inside the object, containing the JSON and the trust flag. */
+
+static json_create_status_t
+json_create_add_raw (json_create_t * jc, SV * r)
+{
+    SV ** json;
+    SV ** trusted;
+
+    json = 0;
+    if (SvTYPE (r) == SVt_PVAV) {
+	json = av_fetch ((AV *) r, 0, 0);
+    }
+    if (! json || ! SvOK (* json)) {
+	json_create_user_message (jc, json_create_undefined_return_value,
+				  "Undefined value in %s object", JCRAW);
+	return json_create_undefined_return_value;
+    }
+    trusted = av_fetch ((AV *) r, 1, 0);
+    return json_create_add_user_json (jc, * json, trusted && SvTRUE (* trusted));
+}
+
+/* Add the array or hash inside a JSON::Create::Cached object. "r" is
+   the array inside the object, containing the reference and the
+   version. */
+
+static json_create_status_t
+json_create_add_cached_object (json_create_t * jc, SV * r)
+{
+    SV ** ref;
+    SV ** version;
+    svtype t;
+
+    ref = 0;
+    if (SvTYPE (r) == SVt_PVAV) {
+	ref = av_fetch ((AV *) r, 0, 0);
+    }
+    if (! ref || ! SvROK (* ref) ||
+	((t = SvTYPE (SvRV (* ref))) != SVt_PVAV && t != SVt_PVHV)) {
+	json_create_user_message (jc, json_create_unknown_type,
+				  "%s object does not contain an array "
+				  "or hash reference", JCCACHED);
+	return json_create_unknown_type;
+    }
+    if (! jc->cache_ok || jc->in_cache) {
+	/* Write it out like any other array or hash. */
+	CALL (json_create_handle_ref (jc, SvRV (* ref)));
+	return json_create_ok;
+    }
+    version = av_fetch ((AV *) r, 1, 0);
+    CALL (json_create_cached (jc, SvRV (* ref), version ? * version : 0, 0));
+    return json_create_ok;
+}
+
+/* Add one number from the bytes "p" of a JSON::Create::Packed object
+   with the "pack" letter "letter". */
+
+static INLINE json_create_status_t
+json_create_add_packed_number (json_create_t * jc, const char * p,
+			       char letter)
+{
+    double d;
+    float f;
+    int64_t q;
+    uint64_t u;
+    int32_t l;
+    uint32_t ul;
+
+    switch (letter) {
+    case 'd':
+	memcpy (& d, p, sizeof (d));
+	break;
+    case 'f':
+	memcpy (& f, p, sizeof (f));
+	d = (double) f;
+	break;
+    case 'q':
+	memcpy (& q, p, sizeof (q));
+	if (BINARY) {
+	    return json_create_binary_signed (jc, q);
+	}
+	return json_create_core_int (& jc->core, q);
+    case 'Q':
+	memcpy (& u, p, sizeof (u));
+	if (BINARY) {
+	    return json_create_binary_unsigned (jc, u);
+	}
+	return json_create_core_uint (& jc->core, u);
+    case 'l':
+	memcpy (& l, p, sizeof (l));
+	if (BINARY) {
+	    return json_create_binary_signed (jc, (int64_t) l);
+	}
+	return json_create_core_int (& jc->core, (int64_t) l);
+    case 'L':
+	memcpy (& ul, p, sizeof (ul));
+	if (BINARY) {
+	    return json_create_binary_unsigned (jc, (uint64_t) ul);
+	}
+	return json_create_core_uint (& jc->core, (uint64_t) ul);
+    default:
+	return json_create_unknown_type;
+    }
+    if (! isfinite (d)) {
+	/* Let the usual routine deal with the non-finite handler and
+	   strict mode. */
+	return json_create_add_float (jc, sv_2mortal (newSVnv (d)));
+    }
+    if (BINARY) {
+	return json_create_binary_float (jc, d);
+    }
+    return json_create_core_double (& jc->core, d);
+}
+
+/* Add the array of numbers from a JSON::Create::Packed object. "r" is
+   the array inside the object, containing the packed numbers and
+   their "pack" letter. */
+
+static json_create_status_t
+json_create_add_packed (json_create_t * jc, SV * r)
+{
+    SV ** buf_sv;
+    SV ** letter_sv;
+    const char * buf;
+    STRLEN len;
+    char letter;
+    STRLEN size;
+    SSize_t n;
+    SSize_t i;
+    int truncated;
+
+    buf_sv = 0;
+    letter_sv = 0;
+    if (SvTYPE (r) == SVt_PVAV) {
+	buf_sv = av_fetch ((AV *) r, 0, 0);
+	letter_sv = av_fetch ((AV *) r, 1, 0);
+    }
+    letter = 0;
+    if (letter_sv && SvPOK (* letter_sv) && SvCUR (* letter_sv) == 1) {
+	letter = SvPVX (* letter_sv)[0];
+    }
+    switch (letter) {
+    case 'd':
+    case 'q':
+    case 'Q':
+	size = 8;
+	break;
+    case 'f':
+    case 'l':
+    case 'L':
+	size = 4;
+	break;
+    default:
+	size = 0;
+    }
+    if (! size || ! buf_sv || ! SvPOK (* buf_sv) || SvUTF8 (* buf_sv)) {
+	json_create_user_message (jc, json_create_unknown_type,
+				  "%s object does not contain packed numbers",
+				  JCPACKED);
+	return json_create_unknown_type;
+    }
+    buf = SvPV (* buf_sv, len);
+    n = (SSize_t) (len / size);
+    CALL (json_create_array_items (jc, & n, & truncated));
+    /* The marker goes at the end of a truncated array. */
+    CALL (json_create_open (jc, '[', n + truncated));
+    for (i = 0; i < n; i++) {
+	if (jc->max_output_bytes > 0 &&
+	    jc->n_output + jc->core.length > jc->max_output_bytes) {
+	    if (! jc->truncate || BINARY) {
+		return json_create_truncate_output (jc);
+	    }
+	    /* This array has no frame, so close it here, and leave
+	       the rest to "json_create_next". */
+	    COMMA;
+	    CALL (json_create_add_marker (jc));
+	    jc->output_full = 1;
+	    return add_close (jc, ']');
+	}
+	if (! BINARY) {
+	    COMMA;
+	}
+	CALL (json_create_add_packed_number (jc, buf + i * size, letter));
+    }
+    if (truncated) {
+	if (! BINARY) {
+	    COMMA;
+	}
+	CALL (json_create_add_marker (jc));
+    }
+    if (! BINARY) {
+	CALL (add_close (jc, ']'));
+    }
+    return json_create_ok;
+}
+
 static json_create_status_t
 json_create_refobj (json_create_t * jc, SV * input)
 {
@@ -1498,24 +2942,52 @@ json_create_refobj (json_create_t * jc, SV * input)
     if (sv_isobject (input)) {
 	const char * objtype;
 	I32 olen;
+	HV * stash;
+	stash = SvSTASH (r);
+	if (json_create_is_bool_class (jc, stash) &&
+	    ! (jc->handlers && hv_exists (jc->handlers, HvNAME_get (stash),
+					  HvNAMELEN_get (stash)))) {
+	    if (SvTRUE (r)) {
+		LITERAL (true);
+	    }
+	    else {
+		LITERAL (false);
+	    }
+	    return json_create_ok;
+	}
 	objtype = sv_reftype (r, 1);
 	olen = (I32) strlen (objtype);
 	if (olen == strlen (JCBOOL) &&
 	    strncmp (objtype, JCBOOL, strlen (JCBOOL)) == 0) {
 	    if (SvTRUE (r)) {
-		ADD("true");
+		LITERAL (true);
 	    }
 	    else {
-		ADD("false");
+		LITERAL (false);
 	    }
 	    return json_create_ok;
 	}
+	if (olen == strlen (JCRAW) &&
+	    strncmp (objtype, JCRAW, strlen (JCRAW)) == 0) {
+	    CALL (json_create_add_raw (jc, r));
+	    return json_create_ok;
+	}
+	if (olen == strlen (JCCACHED) &&
+	    strncmp (objtype, JCCACHED, strlen (JCCACHED)) == 0) {
+	    CALL (json_create_add_cached_object (jc, r));
+	    return json_create_ok;
+	}
+	if (olen == strlen (JCPACKED) &&
+	    strncmp (objtype, JCPACKED, strlen (JCPACKED)) == 0) {
+	    CALL (json_create_add_packed (jc, r));
+	    return json_create_ok;
+	}
 	if (jc->obj_handler) {
-	    CALL (json_create_call_to_json (jc, jc->obj_handler, r));
+	    CALL (json_create_call_object_handler (jc, jc->obj_handler, r));
 	    return json_create_ok;
 	}
 	if (jc->handlers) {
-	    CALL (json_create_handle_object (jc, r, objtype, olen));
+	    CALL (json_create_handle_object (jc, input, r, objtype, olen));
 	    return json_create_ok;
 	}
 	if (jc->strict) {
@@ -1532,7 +3004,7 @@ json_create_refobj (json_create_t * jc, SV * input)
 
 #ifdef INDENT
 #define TOP_NEWLINE \
-    if (jc->indent && jc->depth == 0) {\
+    if (jc->indent && jc->depth == 0 && ! BINARY) {\
 	MSG ("Top-level non-object non-array with indent, adding newline");\
 	CALL (add_char (jc, '\n'));\
     }
@@ -1551,7 +3023,7 @@ json_create_not_ref (json_create_t * jc, SV * r)
     switch (t) {
 
     case SVt_NULL:
-	ADD ("null");
+	LITERAL (null);
 	break;
 
     case SVt_PVMG:
@@ -1615,66 +3087,675 @@ json_create_not_ref (json_create_t * jc, SV * r)
 	    MSG ("SVt_PVIV %s/%ld", SvPV_nolen (r), SvIV (r));
 	    CALL (json_create_add_integer (jc, r));
 	}
-	else {
+	else {
+
+	    /* This combination of things happens e.g. with the
+	       value returned under "script" by charinfo of
+	       Unicode::UCD. If we don't catch it with SvIOK as
+	       above, we get an error of the form 'Argument
+	       "Latin" isn't numeric in subroutine entry' */
+#if 0
+	    fprintf (stderr, "%s:%d: SVt_PVIV without valid IV %s\n", 
+		     __FILE__, __LINE__, SvPV_nolen (r));
+#endif /* 0 */
+	    CALL (json_create_add_string (jc, r));
+	}
+	break;
+	    
+    default:
+	CALL (json_create_handle_unknown_type (jc, r));
+    }
+    TOP_NEWLINE;
+    return json_create_ok;
+}
+
+/* Add the value of "input" to the output. Arrays and hashes are not
+   written out here, they are put onto the stack of frames. */
+
+static json_create_status_t
+json_create_value (json_create_t * jc, SV * input)
+{
+
+    MSG("sv = %p.", input);
+
+    if (! SvOK (input)) {
+	/* We were told to add an undefined value, so put the literal
+	   'null' (without quotes) at the end of "jc" then return. */
+	MSG("Adding 'null'");
+	LITERAL (null);
+	TOP_NEWLINE;
+	return json_create_ok;
+    }
+    /* JSON::Parse inserts pointers to &PL_sv_yes and no as literal
+       "true" and "false" markers. */
+    if (input == &PL_sv_yes) {
+	MSG("Adding 'true'");
+	LITERAL (true);
+	return json_create_ok;
+    }
+    if (input == &PL_sv_no) {
+	MSG("Adding 'false'");
+	LITERAL (false);
+	return json_create_ok;
+    }
+#ifdef SvIsBOOL
+    /* Copies of them, and "builtin::true" and "false", since Perl
+       5.36. */
+    if (SvIsBOOL (input)) {
+	if (SvTRUE (input)) {
+	    LITERAL (true);
+	}
+	else {
+	    LITERAL (false);
+	}
+	return json_create_ok;
+    }
+#endif /* def SvIsBOOL */
+    if (SvROK (input)) {
+	CALL (json_create_refobj (jc, input));
+	return json_create_ok;
+    }
+    CALL (json_create_not_ref (jc, input));
+    return json_create_ok;
+}
+
+/* Are there any entries of "frame" left to write? With "skip_undef",
+   the entries of hashes with undefined values don't count. This uses
+   up the hash's iterator, so it is only for when "frame" is being
+   closed early. */
+
+static int
+json_create_more_entries (json_create_t * jc, json_create_frame_t * frame)
+{
+    SSize_t i;
+
+    if (! jc->skip_undef || BINARY ||
+	frame->type == json_create_frame_array) {
+	return frame->i < frame->n_keys;
+    }
+    for (i = frame->i; i < frame->n_keys; i++) {
+	HE * he;
+	SV * value;
+	if (frame->type == json_create_frame_object) {
+	    he = hv_iternext ((HV *) frame->sv);
+	    if (! he) {
+		return 0;
+	    }
+	    value = hv_iterval ((HV *) frame->sv, he);
+	}
+	else {
+	    he = hv_fetch_ent ((HV *) frame->sv, frame->keys[i], 0, 0);
+	    if (! he) {
+		continue;
+	    }
+	    value = HeVAL (he);
+	}
+	if (SvOK (value)) {
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+/* The output has reached "max_output_bytes", so close all the open
+   arrays and hashes, with a marker in each one which had more
+   entries, or fail if "truncate" is off. */
+
+static json_create_status_t
+json_create_truncate_output (json_create_t * jc)
+{
+    if (! jc->truncate || BINARY) {
+	/* The binary formats gave the numbers of entries at the
+	   start, so they can't be cut short. */
+	json_create_user_message (jc, json_create_too_big,
+				  "Output is longer than "
+				  "max_output_bytes=%lu",
+				  (unsigned long) jc->max_output_bytes);
+	return json_create_too_big;
+    }
+    while (jc->n_frames > 0) {
+	json_create_frame_t * frame;
+	frame = jc->frames + jc->n_frames - 1;
+	if (json_create_more_entries (jc, frame)) {
+	    if (frame->unopened) {
+		CALL (add_open (jc, '{'));
+		frame->unopened = 0;
+	    }
+	    COMMA_AFTER (frame->n_written);
+	    if (frame->type != json_create_frame_array) {
+		CALL (json_create_add_marker (jc));
+		CALL (add_char (jc, ':'));
+	    }
+	    CALL (json_create_add_marker (jc));
+	}
+	CALL (json_create_pop (jc));
+    }
+    return json_create_ok;
+}
+
+/* Put the markers in place of the key and value of an entry of
+   "frame" whose key would take the output past "max_output_bytes",
+   then close all the open arrays and hashes, or fail if "truncate" is
+   off. Keys are not cut short. */
+
+static json_create_status_t
+json_create_cut_key (json_create_t * jc, json_create_frame_t * frame)
+{
+    if (jc->truncate && ! BINARY) {
+	CALL (json_create_add_marker (jc));
+	CALL (add_char (jc, ':'));
+	CALL (json_create_add_marker (jc));
+	/* The markers stand for the rest of the entries too. */
+	frame->i = frame->n_keys;
+    }
+    return json_create_truncate_output (jc);
+}
+
+/* Start an entry of "frame", after the comma which follows the
+   previous entry, or the brace if "skip_undef" left out all the
+   entries before it. */
+
+static INLINE json_create_status_t
+json_create_start_entry (json_create_t * jc, json_create_frame_t * frame)
+{
+    if (! BINARY) {
+	if (frame->unopened) {
+	    frame->unopened = 0;
+	    CALL (add_open (jc, '{'));
+	}
+	else {
+	    COMMA_AFTER (frame->n_written);
+	}
+    }
+    frame->n_written++;
+    return json_create_ok;
+}
+
+/* Is "value" one which "skip_undef" leaves out? The binary formats
+   counted the entries first, so they are dealt with there. */
+
+#define SKIP_UNDEF(value) (jc->skip_undef && ! BINARY && ! SvOK (value))
+
+/* Fail because a hash on the stack of frames has lost some of its
+   keys since we started writing it. This can only happen if the
+   input is changed by a user routine or between calls to
+   "next_chunk". */
+
+static json_create_status_t
+json_create_changed (json_create_t * jc)
+{
+    json_create_user_message (jc, json_create_input_changed,
+			      "Input changed during encoding");
+    return json_create_input_changed;
+}
+
+/* Write the next entry of the array or hash on top of the stack of
+   frames, or close it if there are no entries left. */
+
+static INLINE json_create_status_t
+json_create_next (json_create_t * jc)
+{
+    json_create_frame_t * frame;
+    SSize_t i;
+    SV * value;
+
+    frame = jc->frames + jc->n_frames - 1;
+    i = frame->i;
+    if (i >= frame->n_keys) {
+	MSG ("Adding last char");
+	return json_create_pop (jc);
+    }
+    if (jc->output_full ||
+	(jc->max_output_bytes > 0 &&
+	 jc->n_output + jc->core.length > jc->max_output_bytes)) {
+	return json_create_truncate_output (jc);
+    }
+    /* "frame" may be moved by "json_create_value", so we update this
+       first. */
+    frame->i++;
+    switch (frame->type) {
+
+    case json_create_frame_array: {
+	SV ** avv;
+	MSG ("i = %ld", (long) i);
+	CALL (json_create_start_entry (jc, frame));
+	if (frame->truncated && i == frame->n_keys - 1) {
+	    return json_create_add_marker (jc);
+	}
+	avv = av_fetch ((AV *) frame->sv, i,
+			0 /* don't delete the array value */);
+	if (avv) {
+	    value = * avv;
+	}
+	else {
+	    MSG ("null value returned by av_fetch");
+	    value = & PL_sv_undef;
+	}
+	break;
+    }
+
+    case json_create_frame_object: {
+	HE * he;
+	char * key;
+	/* I32 is correct, not STRLEN; see hv.c. */
+	I32 keylen;
+
+	/* Get the information from the hash. */
+	/* The following is necessary because "hv_iternextsv" doesn't
+	   tell us whether the key is "SvUTF8" or not. */
+	he = hv_iternext ((HV *) frame->sv);
+	if (! he) {
+	    /* The hash has fewer keys than when we started. */
+	    return json_create_changed (jc);
+	}
+	value = hv_iterval ((HV *) frame->sv, he);
+	if (SKIP_UNDEF (value)) {
+	    return json_create_ok;
+	}
+	CALL (json_create_start_entry (jc, frame));
+	key = hv_iterkey (he, & keylen);
+	/* The quotes and the colon. */
+	if (OVER_LIMIT (keylen + 3)) {
+	    return json_create_cut_key (jc, frame);
+	}
+
+	/* Write the information into the buffer. */
+
+	if (BINARY) {
+	    CALL (json_create_binary_string (jc, key, (STRLEN) keylen,
+					     HeUTF8 (he)));
+	    break;
+	}
+	if (HeUTF8 (he)) {
+	    jc->core.unicode = 1;
+	    CALL (json_create_add_key_len (jc, (const unsigned char *) key,
+					   (STRLEN) keylen));
+	}
+	else if (jc->strict) {
+	    CALL (json_create_add_ascii_key_len (jc, (unsigned char *) key,
+						 (STRLEN) keylen));
+	}
+	else {
+	    CALL (json_create_add_key_len (jc, (const unsigned char *) key,
+					   (STRLEN) keylen));
+	}
+	CALL (add_char (jc, ':'));
+	MSG ("Creating value of hash");
+	break;
+    }
+
+    case json_create_frame_sorted: {
+	SV * key_sv;
+	char * key;
+	STRLEN keylen;
+	HE * he;
+
+	key_sv = frame->keys[i];
+	he = hv_fetch_ent ((HV *) frame->sv, key_sv, 0, 0);
+	if (! he) {
+	    /* A key was deleted after we sorted the keys. */
+	    return json_create_changed (jc);
+	}
+	value = HeVAL (he);
+	if (SKIP_UNDEF (value)) {
+	    return json_create_ok;
+	}
+	CALL (json_create_start_entry (jc, frame));
+	key = SvPV (key_sv, keylen);
+	if (OVER_LIMIT (keylen + 3)) {
+	    return json_create_cut_key (jc, frame);
+	}
+	if (BINARY) {
+	    CALL (json_create_binary_string (jc, key, keylen,
+					     SvUTF8 (key_sv)));
+	}
+	else {
+	    CALL (json_create_add_key_len (jc, (const unsigned char *) key,
+					   keylen));
+	    CALL (add_char (jc, ':'));
+	}
+	break;
+    }
+
+    default:
+	return json_create_unknown_type;
+    }
+    return json_create_value (jc, value);
+}
+
+/* This is the core routine, which writes out "input" and everything
+   inside it. Rather than recursing on the C stack as hash values and
+   array values containing array or hash references are handled, the
+   containers are kept on a stack of frames. */
+
+static json_create_status_t
+json_create_traverse (json_create_t * jc, SV * input)
+{
+    json_create_status_t status;
+    json_create_frame_t frames[JCFRAMES];
+
+    jc->frames = frames;
+    jc->n_frames = 0;
+    jc->max_frames = JCFRAMES;
+    jc->active = 0;
+    status = json_create_value (jc, input);
+    while (status == json_create_ok && jc->n_frames > 0) {
+	status = json_create_next (jc);
+    }
+    if (status != json_create_ok) {
+	json_create_unwind (jc);
+    }
+    /* "frames" is about to go out of scope, and "active" is a
+       mortal. */
+    jc->frames = 0;
+    jc->max_frames = 0;
+    jc->active = 0;
+    return status;
+}
+
+/* The layout of the arrays in "jc->cache". */
+
+typedef enum {
+    /* A weak reference to the array or hash. This becomes undefined
+       when the array or hash is freed, so an entry is not used for a
+       different array or hash at the same address. */
+    json_create_cache_ref,
+    /* The user's version, or undef. */
+    json_create_cache_version,
+    /* The JSON, as bytes. */
+    json_create_cache_json,
+    /* Flags for "unicode" and "utf8_dangerous". */
+    json_create_cache_flags,
+    json_create_cache_n_fields,
+}
+json_create_cache_field_t;
+
+#define JCCUNICODE 1
+#define JCCDANGEROUS 2
+/* The array or hash was read-only all the way down when it was
+   put into the cache. */
+#define JCCREADONLY 4
+
+/* Write "r" into a new SV, using a copy of "jc" so that everything
+   about "jc" apart from the output and the flags is the same. The
+   copy is written at depth zero, and indented to the right depth
+   when it is copied into the output. Caching is switched off in the
+   copy, so this doesn't recurse more than once. */
+
+static json_create_status_t
+json_create_cache_encode (json_create_t * jc, SV * r, SV ** json_ptr,
+			  int * flags_ptr)
+{
+    json_create_t copy;
+    unsigned char buffer[BUFSIZE];
+    json_create_status_t status;
+
+    if (jc->max_depth > 0 && (unsigned int) jc->n_frames >= jc->max_depth) {
+	json_create_user_message (jc, json_create_too_deep,
+				  "Input is nested more deeply than "
+				  "max_depth=%u", jc->max_depth);
+	return json_create_too_deep;
+    }
+    copy = * jc;
+    json_create_buffer_init (& copy, buffer);
+    copy.output = 0;
+    copy.core.unicode = 0;
+    copy.utf8_dangerous = 0;
+    copy.in_cache = 1;
+    copy.frames_sv = 0;
+#ifdef HAVE_ZLIB
+    copy.zstream = 0;
+#endif /* def HAVE_ZLIB */
+#ifdef INDENT
+    copy.depth = 0;
+#endif /* def INDENT */
+    if (jc->max_depth > 0) {
+	copy.max_depth = jc->max_depth - jc->n_frames;
+    }
+    /* The cached JSON may go anywhere in the output, so it is
+       counted against "max_output_bytes" when it is copied in. */
+    copy.max_output_bytes = 0;
+    status = json_create_traverse (& copy, sv_2mortal (newRV_inc (r)));
+    if (status == json_create_ok) {
+	status = json_create_buffer_fill (& copy);
+    }
+    if (status != json_create_ok) {
+	if (copy.output && copy.output != & PL_sv_undef) {
+	    SvREFCNT_dec (copy.output);
+	}
+	return status;
+    }
+    * json_ptr = copy.output;
+    * flags_ptr = (copy.core.unicode ? JCCUNICODE : 0) |
+	(copy.utf8_dangerous ? JCCDANGEROUS : 0);
+    return json_create_ok;
+}
+
+/* Are the cached version "a" and the user's version "b" the same? */
+
+static int
+json_create_same_version (SV * a, SV * b)
+{
+    if (! b || ! SvOK (b)) {
+	return ! SvOK (a);
+    }
+    return SvOK (a) && sv_eq (a, b);
+}
+
+/* How deeply "json_create_readonly_deep" looks into arrays and
+   hashes before giving up. */
+
+#define JCREADONLYDEPTH 100
+
+/* The smallest value of "jc->cache_sweep". */
+
+#define JCCACHESWEEP 64
+
+static int
+json_create_readonly_deep (SV * r, int depth);
+
+/* Is the value "v" inside a read-only array or hash read-only itself,
+   and if it is a reference, does it refer to an array or hash which
+   is read-only all the way down? Objects and references to other
+   things are not looked into, so they are not treated as read-only. */
+
+static int
+json_create_readonly_value (SV * v, int depth)
+{
+    SV * r;
+
+    if (! SvREADONLY (v) || SvMAGICAL (v)) {
+	return 0;
+    }
+    if (! SvROK (v)) {
+	return 1;
+    }
+    r = SvRV (v);
+    if (SvOBJECT (r)) {
+	return 0;
+    }
+    if (SvTYPE (r) != SVt_PVAV && SvTYPE (r) != SVt_PVHV) {
+	return 0;
+    }
+    return json_create_readonly_deep (r, depth + 1);
+}
+
+/* Is the array or hash "r" read-only, and is everything inside it
+   read-only too? Tied arrays and hashes are not. */
+
+static int
+json_create_readonly_deep (SV * r, int depth)
+{
+    if (depth > JCREADONLYDEPTH || ! SvREADONLY (r) ||
+	json_create_magical (r)) {
+	return 0;
+    }
+    if (SvTYPE (r) == SVt_PVAV) {
+	SSize_t i;
+	SV ** array;
+
+	array = AvARRAY ((AV *) r);
+	for (i = 0; i <= AvFILLp ((AV *) r); i++) {
+	    if (array[i] && ! json_create_readonly_value (array[i], depth)) {
+		return 0;
+	    }
+	}
+	return 1;
+    }
+    if (HvARRAY ((HV *) r)) {
+	STRLEN i;
+	HE * he;
 
-	    /* This combination of things happens e.g. with the
-	       value returned under "script" by charinfo of
-	       Unicode::UCD. If we don't catch it with SvIOK as
-	       above, we get an error of the form 'Argument
-	       "Latin" isn't numeric in subroutine entry' */
-#if 0
-	    fprintf (stderr, "%s:%d: SVt_PVIV without valid IV %s\n", 
-		     __FILE__, __LINE__, SvPV_nolen (r));
-#endif /* 0 */
-	    CALL (json_create_add_string (jc, r));
+	/* This goes through the buckets rather than using
+	   "hv_iternext", so that the user's iterator is left alone. */
+	for (i = 0; i <= HvMAX ((HV *) r); i++) {
+	    for (he = HvARRAY ((HV *) r)[i]; he; he = HeNEXT (he)) {
+		SV * v;
+		v = HeVAL (he);
+		/* Keys deleted from a restricted hash. */
+		if (v == & PL_sv_placeholder) {
+		    continue;
+		}
+		if (! json_create_readonly_value (v, depth)) {
+		    return 0;
+		}
+	    }
 	}
-	break;
-	    
-    default:
-	CALL (json_create_handle_unknown_type (jc, r));
     }
-    TOP_NEWLINE;
-    return json_create_ok;
+    return 1;
 }
 
-/* This is the core routine, it is called recursively as hash values
-   and array values containing array or hash references are
-   handled. */
+/* Throw away the entries of "jc->cache" whose arrays or hashes have
+   been freed, and set the number of entries at which to do it
+   again. */
 
-static json_create_status_t
-json_create_recursively (json_create_t * jc, SV * input)
+static void
+json_create_sweep_cache (json_create_t * jc)
 {
+    HE * he;
+    I32 n;
+
+    hv_iterinit (jc->cache);
+    while ((he = hv_iternext (jc->cache))) {
+	SV ** fields;
+	fields = AvARRAY ((AV *) SvRV (HeVAL (he)));
+	if (! SvROK (fields[json_create_cache_ref])) {
+	    /* Deleting the entry which "hv_iternext" has just returned
+	       is allowed. */
+	    (void) hv_delete (jc->cache, HeKEY (he), HeKLEN (he), G_DISCARD);
+	}
+    }
+    n = 2 * HvUSEDKEYS (jc->cache);
+    jc->cache_sweep = n > JCCACHESWEEP ? n : JCCACHESWEEP;
+}
 
-    MSG("sv = %p.", input);
+/* Write the array or hash "r" from the cache, putting it into the
+   cache first if it is not already there, or if "version" has
+   changed. If "readonly" is set, "r" is from "cache_readonly", and
+   it is only put into the cache if everything inside it is
+   read-only. That is checked once, when the entry is made, so later
+   calls only look at whether "r" itself is read-only. */
 
-    if (! SvOK (input)) {
-	/* We were told to add an undefined value, so put the literal
-	   'null' (without quotes) at the end of "jc" then return. */
-	MSG("Adding 'null'");
-	ADD ("null");
-	TOP_NEWLINE;
-	return json_create_ok;
+static json_create_status_t
+json_create_cached (json_create_t * jc, SV * r, SV * version, int readonly)
+{
+    SV ** entry_ptr;
+    SV ** fields;
+    char * json;
+    STRLEN json_len;
+    int flags;
+
+    if (! jc->cache) {
+	jc->cache = newHV ();
+	jc->n_mallocs++;
     }
-    /* JSON::Parse inserts pointers to &PL_sv_yes and no as literal
-       "true" and "false" markers. */
-    if (input == &PL_sv_yes) {
-	MSG("Adding 'true'");
-	ADD ("true");
-	return json_create_ok;
+    fields = 0;
+    entry_ptr = hv_fetch (jc->cache, (char *) & r, sizeof (r), 0);
+    if (entry_ptr) {
+	fields = AvARRAY ((AV *) SvRV (* entry_ptr));
+	if (! SvROK (fields[json_create_cache_ref]) ||
+	    ! json_create_same_version (fields[json_create_cache_version],
+					version) ||
+	    (readonly &&
+	     ! (SvIV (fields[json_create_cache_flags]) & JCCREADONLY))) {
+	    fields = 0;
+	}
     }
-    if (input == &PL_sv_no) {
-	MSG("Adding 'false'");
-	ADD ("false");
-	return json_create_ok;
+    if (! fields) {
+	AV * entry;
+	SV * new_json;
+	SV * ref;
+
+	if (readonly && ! json_create_readonly_deep (r, 0)) {
+	    /* Something inside "r" can change, so write it out as
+	       usual. */
+	    if (SvTYPE (r) == SVt_PVAV) {
+		CALL (json_create_add_array (jc, (AV *) r));
+	    }
+	    else {
+		CALL (json_create_add_object (jc, (HV *) r));
+	    }
+	    return json_create_ok;
+	}
+	CALL (json_create_cache_encode (jc, r, & new_json, & flags));
+	if (readonly) {
+	    flags |= JCCREADONLY;
+	}
+	if (! entry_ptr) {
+	    if (jc->cache_sweep == 0) {
+		jc->cache_sweep = JCCACHESWEEP;
+	    }
+	    if (HvUSEDKEYS (jc->cache) >= jc->cache_sweep) {
+		json_create_sweep_cache (jc);
+	    }
+	}
+	entry = newAV ();
+	av_extend (entry, json_create_cache_n_fields - 1);
+	ref = newRV_inc (r);
+	sv_rvweaken (ref);
+	av_push (entry, ref);
+	av_push (entry, version ? newSVsv (version) : newSV (0));
+	av_push (entry, new_json);
+	av_push (entry, newSViv (flags));
+	(void) hv_store (jc->cache, (char *) & r, sizeof (r),
+			 newRV_noinc ((SV *) entry), 0);
+	fields = AvARRAY (entry);
     }
-    if (SvROK (input)) {
-	CALL (json_create_refobj (jc, input));
+    flags = SvIV (fields[json_create_cache_flags]);
+    if (flags & JCCUNICODE) {
+	jc->core.unicode = 1;
+    }
+    if (flags & JCCDANGEROUS) {
+	jc->utf8_dangerous = 1;
+    }
+    json = SvPV (fields[json_create_cache_json], json_len);
+    if (OVER_LIMIT (json_len)) {
+	return json_create_cut_value (jc);
+    }
+#ifdef INDENT
+    if (jc->indent && ! BINARY) {
+	/* This removes the final newline, so put it back at the top
+	   level. */
+	CALL (add_str_len_indent (jc, json, json_len));
+	TOP_NEWLINE;
 	return json_create_ok;
     }
-    CALL (json_create_not_ref (jc, input));
+#endif /* def INDENT */
+    CALL (add_str_len (jc, json, json_len));
     return json_create_ok;
 }
 
+static void
+json_create_clear_cache (json_create_t * jc)
+{
+    if (jc->cache) {
+	SvREFCNT_dec ((SV *) jc->cache);
+	jc->cache = 0;
+	jc->cache_sweep = 0;
+	jc->n_mallocs--;
+    }
+}
+
 /* Master-caller macro. Calls to subsystems from "json_create" cannot
    be handled using the CALL macro above, because we need to return a
    non-status value from json_create. If things go wrong somewhere, we
@@ -1685,6 +3766,7 @@ json_create_recursively (json_create_t * jc, SV * input)
 	status = x;						\
 	if (status != json_create_ok) {				\
 	    HANDLE_STATUS (x, status);				\
+	    JCPROBE1 (error, status);				\
 	    /* Free the memory of "output". */			\
 	    if (jc->output) {					\
 		SvREFCNT_dec (jc->output);			\
@@ -1695,28 +3777,45 @@ json_create_recursively (json_create_t * jc, SV * input)
 	}							\
     }
 
-/* This is the main routine of JSON::Create, where the JSON is
-   produced from the Perl structure in "input". */
+/* Produce the JSON from the Perl structure in "input". */
 
 static INLINE SV *
-json_create_create (json_create_t * jc, SV * input)
+json_create_make (json_create_t * jc, SV * input)
 {
     unsigned char buffer[BUFSIZE];
 
     /* Set up all the transient variables for reading. */
 
-    jc->buffer = buffer;
-    jc->length = 0;
+    json_create_buffer_init (jc, buffer);
     /* Tell json_create_buffer_fill that it needs to allocate an
        SV. */
     jc->output = 0;
     /* Not Unicode. */
-    jc->unicode = 0;
+    jc->core.unicode = 0;
 
-    FINALCALL (json_create_recursively (jc, input));
+    FINALCALL (json_create_traverse (jc, input));
     FINALCALL (json_create_buffer_fill (jc));
 
-    if (jc->unicode && ! jc->downgrade_utf8) {
+#ifdef HAVE_ZLIB
+    if (jc->zstream) {
+	/* The same check as below, on the bytes which went into the
+	   compressed output. */
+	if (jc->core.unicode && ! jc->downgrade_utf8 && jc->utf8_dangerous &&
+	    (jc->zstream_bad_utf8 || jc->n_utf8_partial > 0)) {
+	    FINALCALL (json_create_zstream_bad_utf8 (jc));
+	}
+	/* The output is compressed bytes, so it doesn't get a "utf8"
+	   flag. */
+	FINALCALL (json_create_deflate (jc, "", 0, Z_FINISH));
+	return jc->output;
+    }
+#endif /* def HAVE_ZLIB */
+
+    if (BINARY) {
+	/* Binary output is bytes. */
+	return jc->output;
+    }
+    if (jc->core.unicode && ! jc->downgrade_utf8) {
 	if (jc->utf8_dangerous) {
 	    if (is_utf8_string ((U8 *) SvPV_nolen (jc->output),
 				SvCUR (jc->output))) {
@@ -1725,6 +3824,7 @@ json_create_create (json_create_t * jc, SV * input)
 	    else {
 		json_create_user_message (jc, json_create_unicode_bad_utf8,
 					  "Invalid UTF-8 from user routine");
+		JCPROBE1 (error, json_create_unicode_bad_utf8);
 		return & PL_sv_undef;
 	    }
 	}
@@ -1739,6 +3839,83 @@ json_create_create (json_create_t * jc, SV * input)
     return jc->output;
 }
 
+#ifdef HAVE_ZLIB
+
+/* Produce the JSON from "input" compressed in gzip format. */
+
+static SV *
+json_create_make_gzip (json_create_t * jc, SV * input)
+{
+    z_stream * zs;
+    SV * output;
+    int zret;
+
+    /* "zs" isn't counted in "n_mallocs", since it may be freed after
+       "jc" has gone, if "jc" is on the stack of "create_json". */
+    Newxz (zs, 1, z_stream);
+    ENTER;
+    SAVEDESTRUCTOR_X (json_create_zstream_free, zs);
+    /* 15 is the largest window, and adding 16 gives gzip headers. */
+    zret = deflateInit2 (zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+			 Z_DEFAULT_STRATEGY);
+    if (zret != Z_OK) {
+	if (JCEH) {
+	    (*JCEH) (__FILE__, __LINE__, "deflateInit2 failed with %d",
+		     zret);
+	}
+	LEAVE;
+	return & PL_sv_undef;
+    }
+    jc->zstream = zs;
+    jc->n_utf8_partial = 0;
+    jc->zstream_bad_utf8 = 0;
+    output = json_create_make (jc, input);
+    jc->zstream = 0;
+    LEAVE;
+    return output;
+}
+
+#endif /* def HAVE_ZLIB */
+
+/* This is the main routine of JSON::Create, where the JSON is
+   produced from the Perl structure in "input". */
+
+static INLINE SV *
+json_create_create (json_create_t * jc, SV * input)
+{
+    SV * output;
+
+    JCPROBE1 (create__start, input);
+    jc->n_output = 0;
+    jc->output_full = 0;
+#ifdef HAVE_ZLIB
+    /* This may be left over if a previous call croaked. */
+    jc->zstream = 0;
+#endif /* def HAVE_ZLIB */
+    jc->memo = 0;
+    if (jc->memoize_handlers) {
+	/* This is mortal so that it goes away even if a handler
+	   croaks. */
+	jc->memo = (HV *) sv_2mortal ((SV *) newHV ());
+    }
+    if (jc->gzip) {
+#ifdef HAVE_ZLIB
+	output = json_create_make_gzip (jc, input);
+#else
+	json_create_user_message (jc, json_create_no_zlib,
+				  "gzip is not available because "
+				  "JSON::Create was built without zlib");
+	output = & PL_sv_undef;
+#endif /* def HAVE_ZLIB */
+    }
+    else {
+	output = json_create_make (jc, input);
+    }
+    jc->memo = 0;
+    JCPROBE1 (create__done, SvOK (output) ? SvCUR (output) : 0);
+    return output;
+}
+
 /*  __  __      _   _               _     
    |  \/  | ___| |_| |__   ___   __| |___ 
    | |\/| |/ _ \ __| '_ \ / _ \ / _` / __|
@@ -1756,6 +3933,8 @@ json_create_new (json_create_t ** jc_ptr)
     jc->fformat = 0;
     jc->type_handler = 0;
     jc->handlers = 0;
+    jc->cache_ok = 1;
+    json_create_find_bool_stashes (jc);
     * jc_ptr = jc;
     return json_create_ok;
 }
@@ -1768,6 +3947,7 @@ json_create_free_fformat (json_create_t * jc)
 	jc->fformat = 0;
 	jc->n_mallocs--;
     }
+    json_create_core_fformat (& jc->core, 0);
     return json_create_ok;
 }
 
@@ -1795,6 +3975,8 @@ json_create_set_fformat (json_create_t * jc, SV * fformat)
 	jc->fformat[i] = ff[i];
     }
     jc->fformat[fflen] = '\0';
+    /* Formats like "%.2f" are printed without snprintf. */
+    json_create_core_fformat (& jc->core, jc->fformat);
     return json_create_ok;
 }
 
@@ -1853,6 +4035,144 @@ json_create_remove_cmp (json_create_t * jc)
     return json_create_ok;
 }
 
+static json_create_status_t
+json_create_remove_include_keys (json_create_t * jc)
+{
+    if (jc->include_keys) {
+	SvREFCNT_dec ((SV *) jc->include_keys);
+	jc->include_keys = 0;
+	jc->n_mallocs--;
+    }
+    return json_create_ok;
+}
+
+static json_create_status_t
+json_create_remove_exclude_keys (json_create_t * jc)
+{
+    if (jc->exclude_keys) {
+	SvREFCNT_dec ((SV *) jc->exclude_keys);
+	jc->exclude_keys = 0;
+	jc->n_mallocs--;
+    }
+    return json_create_ok;
+}
+
+static json_create_status_t
+json_create_remove_obj_keys (json_create_t * jc)
+{
+    if (jc->obj_keys) {
+	SvREFCNT_dec ((SV *) jc->obj_keys);
+	jc->obj_keys = 0;
+	jc->n_mallocs--;
+    }
+    return json_create_ok;
+}
+
+/* Make an array of shared hash key scalars from the strings in the
+   array reference "list", for "include_keys" and "obj_keys". */
+
+static AV *
+json_create_key_list (SV * list)
+{
+    AV * av;
+    AV * keys;
+    I32 n;
+    I32 i;
+
+    av = (AV *) SvRV (list);
+    n = av_len (av) + 1;
+    keys = newAV ();
+    av_extend (keys, n);
+    for (i = 0; i < n; i++) {
+	SV ** svp;
+	const char * k;
+	STRLEN klen;
+	svp = av_fetch (av, i, 0);
+	if (! svp || ! SvOK (* svp)) {
+	    continue;
+	}
+	k = SvPV (* svp, klen);
+	av_push (keys, newSVpvn_share (k, SvUTF8 (* svp) ? - (I32) klen :
+				       (I32) klen, 0));
+    }
+    return keys;
+}
+
+#define IS_ARRAY_REF(sv) (SvROK (sv) && SvTYPE (SvRV (sv)) == SVt_PVAV)
+
+/* Write only the keys in the array reference "list" from hashes, or
+   all of them if "list" is undefined. */
+
+static void
+json_create_set_include_keys (json_create_t * jc, SV * list)
+{
+    json_create_remove_include_keys (jc);
+    if (! SvOK (list)) {
+	return;
+    }
+    if (! IS_ARRAY_REF (list)) {
+	warn ("include_keys needs an array reference");
+	return;
+    }
+    jc->include_keys = json_create_key_list (list);
+    jc->n_mallocs++;
+}
+
+/* Never write the keys in the array reference "list" from hashes. */
+
+static void
+json_create_set_exclude_keys (json_create_t * jc, SV * list)
+{
+    AV * av;
+    I32 n;
+    I32 i;
+
+    json_create_remove_exclude_keys (jc);
+    if (! SvOK (list)) {
+	return;
+    }
+    if (! IS_ARRAY_REF (list)) {
+	warn ("exclude_keys needs an array reference");
+	return;
+    }
+    av = (AV *) SvRV (list);
+    n = av_len (av) + 1;
+    jc->exclude_keys = newHV ();
+    jc->n_mallocs++;
+    for (i = 0; i < n; i++) {
+	SV ** svp;
+	svp = av_fetch (av, i, 0);
+	if (svp && SvOK (* svp)) {
+	    (void) hv_store_ent (jc->exclude_keys, * svp, newSViv (1), 0);
+	}
+    }
+}
+
+/* Write only the keys in the array reference "list" from hashes
+   blessed into "class", or remove the keys for "class" if "list" is
+   undefined. */
+
+static void
+json_create_set_obj_keys (json_create_t * jc, SV * class, SV * list)
+{
+    if (! SvOK (list)) {
+	if (jc->obj_keys) {
+	    (void) hv_delete_ent (jc->obj_keys, class, G_DISCARD, 0);
+	}
+	return;
+    }
+    if (! IS_ARRAY_REF (list)) {
+	warn ("obj_keys needs an array reference");
+	return;
+    }
+    if (! jc->obj_keys) {
+	jc->obj_keys = newHV ();
+	jc->n_mallocs++;
+    }
+    (void) hv_store_ent (jc->obj_keys, class,
+			 newRV_noinc ((SV *) json_create_key_list (list)), 0);
+}
+
 static json_create_status_t
 json_create_free (json_create_t * jc)
 {
@@ -1862,6 +4182,10 @@ json_create_free (json_create_t * jc)
     CALL (json_create_remove_obj_handler (jc));
     CALL (json_create_remove_non_finite_handler (jc));
     CALL (json_create_remove_cmp (jc));
+    CALL (json_create_remove_include_keys (jc));
+    CALL (json_create_remove_exclude_keys (jc));
+    CALL (json_create_remove_obj_keys (jc));
+    json_create_clear_cache (jc);
 
     /* Finished, check we have no leaks before freeing. */
 
@@ -1914,12 +4238,82 @@ set_type_handler (json_create_t * jc, SV * th)
 	return;								\
     }
 
+/* The same as BOOL for the options kept in "jc->core". */
+
+#define CORE_BOOL(x)							\
+    if (CMP(x)) {							\
+	jc->core.x = SvTRUE (value) ? 1 : 0;				\
+	return;								\
+    }
+
+#define UINT(x)								\
+    if (CMP(x)) {							\
+	jc->x = SvUV (value);						\
+	return;								\
+    }
+
 #define HANDLER(x)				\
     if (CMP(x ## _handler)) {			\
 	set_ ## x ## _handler (jc, value);	\
 	return;					\
     }
 
+static void
+json_create_set_format (json_create_t * jc, SV * format)
+{
+    const char * f;
+    STRLEN f_len;
+    int i;
+
+    f = SvPV (format, f_len);
+    for (i = 0; i < json_create_n_formats; i++) {
+	if (strlen (json_create_formats[i]) == f_len &&
+	    strncmp (json_create_formats[i], f, f_len) == 0) {
+	    jc->format = (json_create_format_t) i;
+	    return;
+	}
+    }
+    warn ("Unknown format '%s'", f);
+}
+
+static void
+json_create_set_escape_slash (json_create_t * jc, SV * onoff)
+{
+    json_create_core_escape_slash (& jc->core, SvTRUE (onoff));
+}
+
+static void
+json_create_set_escape_chars (json_create_t * jc, SV * chars)
+{
+    const char * c;
+    STRLEN c_len;
+
+    c = "";
+    c_len = 0;
+    if (SvOK (chars)) {
+	c = SvPV (chars, c_len);
+    }
+    if (! json_create_core_escape_chars (& jc->core, c, c_len)) {
+	warn ("Non-ASCII characters in escape_chars are ignored");
+    }
+}
+
+/* Switch RFC 8785 canonical JSON on or off. This also switches on
+   "sort" and off "indent" and the escapes which RFC 8785 doesn't
+   allow. */
+
+static void
+json_create_set_canonical (json_create_t * jc, SV * onoff)
+{
+    json_create_core_canonical (& jc->core, SvTRUE (onoff));
+    if (jc->core.canonical) {
+#ifdef INDENT
+	jc->sort = 1;
+	jc->indent = 0;
+#endif /* def INDENT */
+    }
+}
+
 static void
 json_create_set (json_create_t * jc, SV * key_sv, SV * value)
 {
@@ -1928,19 +4322,193 @@ json_create_set (json_create_t * jc, SV * key_sv, SV * value)
     
     key = SvPV (key_sv, key_len);
 
+    /* The cached JSON may have been made with other options. */
+    json_create_clear_cache (jc);
+
+    BOOL (cache_readonly);
+    if (CMP (canonical)) {
+	json_create_set_canonical (jc, value);
+	return;
+    }
     BOOL (downgrade_utf8);
-    BOOL (escape_slash);
+    if (CMP (escape_chars)) {
+	json_create_set_escape_chars (jc, value);
+	return;
+    }
+    CORE_BOOL (escape_non_bmp);
+    if (CMP (escape_slash)) {
+	json_create_set_escape_slash (jc, value);
+	return;
+    }
+    if (CMP (exclude_keys)) {
+	json_create_set_exclude_keys (jc, value);
+	return;
+    }
     BOOL (fatal_errors);
+    if (CMP (format)) {
+	json_create_set_format (jc, value);
+	return;
+    }
+    BOOL (gzip);
+    if (CMP (include_keys)) {
+	json_create_set_include_keys (jc, value);
+	return;
+    }
     BOOL (indent);
-    BOOL (no_javascript_safe);
-    BOOL (replace_bad_utf8);
+    UINT (max_array_items);
+    UINT (max_depth);
+    UINT (max_output_bytes);
+    UINT (max_string_bytes);
+    BOOL (memoize_handlers);
+    CORE_BOOL (no_javascript_safe);
+    CORE_BOOL (quote_big_ints);
+    CORE_BOOL (quote_ints);
+    CORE_BOOL (replace_bad_utf8);
+    BOOL (skip_undef);
     BOOL (sort);
     BOOL (strict);
-    BOOL (unicode_upper);
-    BOOL (unicode_escape_all);
+    BOOL (truncate);
+    CORE_BOOL (unicode_upper);
+    CORE_BOOL (unicode_escape_all);
     BOOL (validate);
     HANDLER (non_finite);
     HANDLER (object);
     HANDLER (type);
     warn ("Unknown option '%s'", key);
 }
+
+/* JSON::Create objects are references to a scalar which has our
+   "json_create_t" attached to it as magic, rather than the pointer
+   itself, so that when a new thread is made, Perl gives us a chance
+   to copy the "json_create_t" for the new thread. Otherwise, both
+   threads would share one "json_create_t" and free it twice. */
+
+static int
+json_create_mg_free (pTHX_ SV * sv, MAGIC * mg)
+{
+    if (mg->mg_ptr) {
+	json_create_free ((json_create_t *) mg->mg_ptr);
+	mg->mg_ptr = 0;
+    }
+    return 0;
+}
+
+#ifdef USE_ITHREADS
+
+/* Make a copy of "jc" for a new thread, with the new thread's copies
+   of the handlers. The cache holds JSON keyed by the addresses of the
+   old thread's arrays and hashes, so it is not copied. */
+
+static json_create_t *
+json_create_dup (pTHX_ json_create_t * jc, CLONE_PARAMS * param)
+{
+    json_create_t * copy;
+    int i;
+
+    Newx (copy, 1, json_create_t);
+    * copy = * jc;
+    if (jc->fformat) {
+	copy->fformat = savepv (jc->fformat);
+    }
+    json_create_core_fformat (& copy->core, copy->fformat);
+    if (jc->handlers) {
+	copy->handlers = (HV *) sv_dup_inc ((SV *) jc->handlers, param);
+    }
+    if (jc->type_handler) {
+	copy->type_handler = sv_dup_inc (jc->type_handler, param);
+    }
+    if (jc->obj_handler) {
+	copy->obj_handler = sv_dup_inc (jc->obj_handler, param);
+    }
+    if (jc->non_finite_handler) {
+	copy->non_finite_handler = sv_dup_inc (jc->non_finite_handler, param);
+    }
+    if (jc->cmp) {
+	copy->cmp = sv_dup_inc (jc->cmp, param);
+    }
+    if (jc->include_keys) {
+	copy->include_keys = (AV *) sv_dup_inc ((SV *) jc->include_keys,
+						param);
+    }
+    if (jc->exclude_keys) {
+	copy->exclude_keys = (HV *) sv_dup_inc ((SV *) jc->exclude_keys,
+						param);
+    }
+    if (jc->obj_keys) {
+	copy->obj_keys = (HV *) sv_dup_inc ((SV *) jc->obj_keys, param);
+    }
+    if (jc->cache) {
+	copy->cache = 0;
+	copy->cache_sweep = 0;
+	copy->n_mallocs--;
+    }
+    /* Only set during a call. */
+    copy->memo = 0;
+    copy->iso8601_stash = 0;
+    copy->iso8601_cv = 0;
+    /* Use the new thread's stashes. */
+    for (i = 0; i < JCBOOLCLASSES; i++) {
+	copy->bool_stashes[i] = (HV *) sv_dup ((SV *) jc->bool_stashes[i],
+					       param);
+    }
+    return copy;
+}
+
+static int
+json_create_mg_dup (pTHX_ MAGIC * mg, CLONE_PARAMS * param)
+{
+    if (mg->mg_ptr) {
+	mg->mg_ptr = (char *) json_create_dup (aTHX_ (json_create_t *) mg->mg_ptr,
+					       param);
+    }
+    return 0;
+}
+
+#endif /* def USE_ITHREADS */
+
+static MGVTBL json_create_vtbl = {
+    0, /* get */
+    0, /* set */
+    0, /* len */
+    0, /* clear */
+    json_create_mg_free,
+    0, /* copy */
+#ifdef USE_ITHREADS
+    json_create_mg_dup,
+#else
+    0,
+#endif /* def USE_ITHREADS */
+    0, /* local */
+};
+
+/* Make "sv" into a JSON::Create object holding "jc". */
+
+static void
+json_create_to_sv (SV * sv, json_create_t * jc)
+{
+    SV * obj;
+    MAGIC * mg;
+
+    obj = newSV (0);
+    mg = sv_magicext (obj, 0, PERL_MAGIC_ext, & json_create_vtbl,
+		      (const char *) jc, 0);
+    mg->mg_flags |= MGf_DUP;
+    sv_setsv (sv, sv_2mortal (newRV_noinc (obj)));
+    sv_bless (sv, gv_stashpv ("JSON::Create", GV_ADD));
+}
+
+/* Get the "json_create_t" out of the JSON::Create object "sv". */
+
+static json_create_t *
+json_create_from_sv (SV * sv, const char * var)
+{
+    MAGIC * mg;
+
+    if (SvROK (sv) && sv_derived_from (sv, "JSON::Create")) {
+	mg = mg_findext (SvRV (sv), PERL_MAGIC_ext, & json_create_vtbl);
+	if (mg && mg->mg_ptr) {
+	    return (json_create_t *) mg->mg_ptr;
+	}
+    }
+    croak ("%s is not a JSON::Create object", var);
+}
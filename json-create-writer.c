@@ -0,0 +1,403 @@
+/*
+   This is the event-style writer of JSON::Create, JSON::Create::Writer.
+
+   It's kept in a separate file but #included into the main file,
+   Create.xs, after "json-create-perl.c", since it writes into the
+   same buffer using the same escaping and number routines.
+*/
+
+/* One array or object which the user has started but not yet
+   ended. */
+
+typedef struct json_create_level {
+    /* Either '[' or '{'. */
+    unsigned char type;
+    /* The number of entries written so far. */
+    I32 count;
+    /* A key has been written, and its value has not. */
+    unsigned int key : 1;
+}
+json_create_level_t;
+
+typedef struct json_create_writer {
+    /* The formatting options, the buffer, and the output. */
+    json_create_t * jc;
+    /* The buffer of "jc", which unlike for "json_create_create" has
+       to last between calls. */
+    unsigned char * buffer;
+    /* The arrays and objects which are open. */
+    json_create_level_t * levels;
+    /* The number of open arrays and objects. */
+    int n_levels;
+    /* The number of levels "levels" has room for. */
+    int max_levels;
+    /* The user's filehandle, or zero. */
+    SV * fh;
+    /* The top-level value is complete. */
+    unsigned int done : 1;
+}
+json_create_writer_t;
+
+#define JCLEVELS 0x10
+
+/* Errors in the order of calls are the user's mistake, but we
+   cannot carry on after them without producing invalid JSON, so they
+   are always fatal. */
+
+#define WRITER_ERROR(msg) croak ("JSON::Create::Writer: %s", msg)
+
+static json_create_status_t
+json_create_writer_new (json_create_writer_t ** w_ptr)
+{
+    json_create_writer_t * w;
+    json_create_t * jc;
+
+    Newxz (w, 1, json_create_writer_t);
+    CALL (json_create_new (& w->jc));
+    jc = w->jc;
+    Newx (w->buffer, BUFSIZE, unsigned char);
+    jc->n_mallocs++;
+    Newx (w->levels, JCLEVELS, json_create_level_t);
+    jc->n_mallocs++;
+    w->max_levels = JCLEVELS;
+    json_create_buffer_init (jc, w->buffer);
+    jc->output = 0;
+    jc->fatal_errors = 1;
+    * w_ptr = w;
+    return json_create_ok;
+}
+
+static json_create_status_t
+json_create_writer_remove_fh (json_create_writer_t * w)
+{
+    if (w->fh) {
+	SvREFCNT_dec (w->fh);
+	w->fh = 0;
+	w->jc->n_mallocs--;
+    }
+    return json_create_ok;
+}
+
+static void
+json_create_writer_set_fh (json_create_writer_t * w, SV * fh)
+{
+    json_create_writer_remove_fh (w);
+    if (SvTRUE (fh)) {
+	w->fh = fh;
+	bump (w->jc, fh);
+    }
+}
+
+static json_create_status_t
+json_create_writer_free (json_create_writer_t * w)
+{
+    json_create_t * jc;
+
+    jc = w->jc;
+    CALL (json_create_writer_remove_fh (w));
+    if (jc->output && jc->output != & PL_sv_undef) {
+	SvREFCNT_dec (jc->output);
+    }
+    jc->output = 0;
+    Safefree (w->buffer);
+    jc->n_mallocs--;
+    Safefree (w->levels);
+    jc->n_mallocs--;
+    CALL (json_create_free (jc));
+    Safefree (w);
+    return json_create_ok;
+}
+
+/* Start an entry of the array or object "level", adding a comma
+   after the previous entry if necessary. */
+
+static INLINE json_create_status_t
+json_create_writer_entry (json_create_writer_t * w, json_create_level_t * level)
+{
+    json_create_t * jc;
+    I32 i;
+
+    jc = w->jc;
+    i = level->count;
+    level->count++;
+#ifdef INDENT
+    /* "add_open" is not used for the opening bracket, because
+       objects with no entries have no whitespace in them. */
+    if (i == 0 && jc->indent) {
+	DINC;
+	CALL (newline_indent (jc));
+    }
+#endif /* def INDENT */
+    COMMA;
+    return json_create_ok;
+}
+
+/* Check that a value can go here, and add a comma if necessary. */
+
+static json_create_status_t
+json_create_writer_value (json_create_writer_t * w)
+{
+    json_create_level_t * level;
+
+    if (w->jc->format != json_create_format_json) {
+	WRITER_ERROR ("only JSON output is supported");
+    }
+    if (w->n_levels == 0) {
+	if (w->done) {
+	    WRITER_ERROR ("more than one value at the top level");
+	}
+	return json_create_ok;
+    }
+    level = w->levels + w->n_levels - 1;
+    if (level->type == '{') {
+	if (! level->key) {
+	    WRITER_ERROR ("value in an object without a key");
+	}
+	level->key = 0;
+	return json_create_ok;
+    }
+    return json_create_writer_entry (w, level);
+}
+
+/* Finish off a value. "scalar" is true if the value was not an array
+   or object. */
+
+static json_create_status_t
+json_create_writer_value_end (json_create_writer_t * w, int scalar)
+{
+    json_create_t * jc;
+
+    jc = w->jc;
+    if (w->n_levels == 0) {
+	w->done = 1;
+	if (scalar) {
+	    TOP_NEWLINE;
+	}
+    }
+    return json_create_ok;
+}
+
+/* Write the key "key" of length "key_len", which is UTF-8 if "utf8"
+   is true. */
+
+static json_create_status_t
+json_create_writer_key_pv (json_create_writer_t * w, const char * key,
+			   STRLEN key_len, int utf8)
+{
+    json_create_t * jc;
+    json_create_level_t * level;
+
+    jc = w->jc;
+    if (w->n_levels == 0 || w->levels[w->n_levels - 1].type != '{') {
+	WRITER_ERROR ("key outside an object");
+    }
+    level = w->levels + w->n_levels - 1;
+    if (level->key) {
+	WRITER_ERROR ("key after a key without a value");
+    }
+    CALL (json_create_writer_entry (w, level));
+    CALL (json_create_add_pv (jc, key, key_len, utf8));
+    CALL (add_char (jc, ':'));
+    level->key = 1;
+    return json_create_ok;
+}
+
+static json_create_status_t
+json_create_writer_key (json_create_writer_t * w, SV * key)
+{
+    char * k;
+    STRLEN k_len;
+
+    k = SvPV (key, k_len);
+    return json_create_writer_key_pv (w, k, k_len, SvUTF8 (key));
+}
+
+/* Start an array if "c" is '[', or an object if "c" is '{'. */
+
+static json_create_status_t
+json_create_writer_start (json_create_writer_t * w, unsigned char c)
+{
+    json_create_t * jc;
+    json_create_level_t * level;
+
+    jc = w->jc;
+    if (jc->max_depth > 0 && (unsigned int) w->n_levels >= jc->max_depth) {
+	json_create_user_message (jc, json_create_too_deep,
+				  "Input is nested more deeply than "
+				  "max_depth=%u", jc->max_depth);
+	return json_create_too_deep;
+    }
+    CALL (json_create_writer_value (w));
+    CALL (add_char (jc, c));
+    if (w->n_levels >= w->max_levels) {
+	w->max_levels *= 2;
+	Renew (w->levels, w->max_levels, json_create_level_t);
+    }
+    level = w->levels + w->n_levels;
+    level->type = c;
+    level->count = 0;
+    level->key = 0;
+    w->n_levels++;
+    return json_create_ok;
+}
+
+/* End the most recently started array or object. */
+
+static json_create_status_t
+json_create_writer_end (json_create_writer_t * w)
+{
+    json_create_t * jc;
+    json_create_level_t * level;
+
+    jc = w->jc;
+    if (w->n_levels == 0) {
+	WRITER_ERROR ("end without a start");
+    }
+    level = w->levels + w->n_levels - 1;
+    if (level->key) {
+	WRITER_ERROR ("end after a key without a value");
+    }
+    w->n_levels--;
+    if (level->type == '{') {
+	if (level->count == 0) {
+	    /* The same as an empty hash. */
+	    CALL (add_char (jc, '}'));
+	}
+	else {
+	    CALL (add_close (jc, '}'));
+	}
+    }
+    else {
+#ifdef INDENT
+	if (level->count == 0 && jc->indent) {
+	    /* The same as an empty array. */
+	    DINC;
+	    CALL (newline_indent (jc));
+	}
+#endif /* def INDENT */
+	CALL (add_close (jc, ']'));
+    }
+    return json_create_writer_value_end (w, 0);
+}
+
+static json_create_status_t
+json_create_writer_string_pv (json_create_writer_t * w, const char * s,
+			      STRLEN s_len, int utf8)
+{
+    CALL (json_create_writer_value (w));
+    CALL (json_create_add_pv (w->jc, s, s_len, utf8));
+    return json_create_writer_value_end (w, 1);
+}
+
+static json_create_status_t
+json_create_writer_string (json_create_writer_t * w, SV * sv)
+{
+    char * s;
+    STRLEN s_len;
+
+    s = SvPV (sv, s_len);
+    return json_create_writer_string_pv (w, s, s_len, SvUTF8 (sv));
+}
+
+static json_create_status_t
+json_create_writer_number (json_create_writer_t * w, SV * sv)
+{
+    json_create_t * jc;
+
+    jc = w->jc;
+    if (! SvIOK (sv) && ! SvNOK (sv) && ! looks_like_number (sv)) {
+	WRITER_ERROR ("number is not a number");
+    }
+    CALL (json_create_writer_value (w));
+    if (SvIOK (sv)) {
+	CALL (json_create_add_integer (jc, sv));
+    }
+    else if (SvNOK (sv)) {
+	CALL (json_create_add_float (jc, sv));
+    }
+    else {
+	CALL (json_create_add_stringified (jc, sv));
+    }
+    return json_create_writer_value_end (w, 1);
+}
+
+static json_create_status_t
+json_create_writer_literal (json_create_writer_t * w, const char * literal)
+{
+    json_create_t * jc;
+
+    jc = w->jc;
+    CALL (json_create_writer_value (w));
+    ADD (literal);
+    return json_create_writer_value_end (w, 1);
+}
+
+/* Write a Perl structure in the same way as "json_create_create". */
+
+static json_create_status_t
+json_create_writer_structure (json_create_writer_t * w, SV * sv)
+{
+    CALL (json_create_writer_value (w));
+    CALL (json_create_traverse (w->jc, sv));
+    return json_create_writer_value_end (w, 0);
+}
+
+/* Take everything written so far out of "w". */
+
+static SV *
+json_create_writer_output (json_create_writer_t * w)
+{
+    json_create_t * jc;
+    SV * output;
+
+    jc = w->jc;
+    json_create_buffer_fill (jc);
+    output = jc->output;
+    jc->output = 0;
+    if (! output || output == & PL_sv_undef) {
+	output = newSVpvs ("");
+    }
+    return output;
+}
+
+/* Print the output so far to "fh". */
+
+static void
+json_create_writer_print (json_create_writer_t * w, SV * fh)
+{
+    json_create_t * jc;
+    PerlIO * fp;
+    char * pv;
+    STRLEN len;
+
+    jc = w->jc;
+    json_create_buffer_fill (jc);
+    if (! jc->output || jc->output == & PL_sv_undef) {
+	jc->output = 0;
+	return;
+    }
+    fp = IoOFP (sv_2io (fh));
+    if (! fp) {
+	WRITER_ERROR ("filehandle is not open for output");
+    }
+    pv = SvPV (jc->output, len);
+    if (PerlIO_write (fp, pv, len) != (SSize_t) len) {
+	WRITER_ERROR ("error writing to filehandle");
+    }
+    /* Keep the SV's memory for the next lot of output. */
+    SvCUR_set (jc->output, 0);
+}
+
+/* If the user gave us a filehandle, and the buffer has been copied
+   into the output, print it. This keeps the memory used down to
+   about BUFSIZE. */
+
+static INLINE void
+json_create_writer_auto_flush (json_create_writer_t * w)
+{
+    SV * output;
+    output = w->jc->output;
+    if (w->fh && output && output != & PL_sv_undef && SvCUR (output) > 0) {
+	json_create_writer_print (w, w->fh);
+    }
+}
@@ -66,6 +66,7 @@ sub bool
 {
     my ($obj, @list) = @_;
     my $handlers = $obj->get_handlers ();
+    $obj->clear_cache ();
     for my $item (@list) {
 	$handlers->{$item} = 'bool';
     }
@@ -75,6 +76,7 @@ sub obj
 {
     my ($obj, %handlers) = @_;
     my $handlers = $obj->get_handlers ();
+    $obj->clear_cache ();
     for my $item (keys %handlers) {
 	my $value = $handlers{$item};
 	# Check it's a code reference somehow.
@@ -86,6 +88,7 @@ sub del
 {
     my ($obj, @list) = @_;
     my $handlers = $obj->get_handlers ();
+    $obj->clear_cache ();
     for my $item (@list) {
 	delete $handlers->{$item};
     }
@@ -122,7 +125,7 @@ sub write_json
     # create_json's output is either ASCII or it is marked as utf8, so
     # the following is always safe.
     my $encoding = ':encoding(utf8)';
-    if ($options{downgrade_utf8}) {
+    if ($options{downgrade_utf8} || $options{gzip}) {
 	$encoding = ':raw';
     }
     open my $out, ">$encoding", $filename or die $!;
@@ -135,4 +138,19 @@ sub run
     goto &create;
 }
 
+sub encoder
+{
+    my ($jc, $input) = @_;
+    require JSON::Create::Encoder;
+    return JSON::Create::Encoder->new ($jc, $input);
+}
+
+sub gzip_available
+{
+    if ($xsok) {
+	return zlib_ok ();
+    }
+    return JSON::Create::PP::gzip_available ();
+}
+
 1;
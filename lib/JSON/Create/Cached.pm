@@ -0,0 +1,101 @@
+package JSON::Create::Cached;
+
+use warnings;
+use strict;
+use Carp;
+use Scalar::Util 'reftype';
+
+our $VERSION = '0.36';
+
+# The object is an array containing the reference and the version. The
+# XS code in JSON::Create reads this array directly, so don't change
+# its layout without changing json_create_add_cached_object too.
+
+sub new
+{
+    my ($class, $ref, %options) = @_;
+    my $type = reftype ($ref);
+    if (! $type || ($type ne 'ARRAY' && $type ne 'HASH')) {
+	croak "Not an array or hash reference";
+    }
+    my $version = $options{version};
+    delete $options{version};
+    for my $k (keys %options) {
+	carp "Unknown option '$k'";
+    }
+    return bless [$ref, $version], $class;
+}
+
+sub version
+{
+    my ($cached, $version) = @_;
+    if (@_ > 1) {
+	$cached->[1] = $version;
+    }
+    return $cached->[1];
+}
+
+1;
+
+=encoding UTF-8
+
+=head1 NAME
+
+JSON::Create::Cached - Keep the JSON of unchanging data in JSON::Create
+
+=head1 SYNOPSIS
+
+    use JSON::Create;
+    use JSON::Create::Cached;
+
+    my $jc = JSON::Create->new ();
+    my $flags = JSON::Create::Cached->new (\%feature_flags, version => 1);
+    for my $request (@requests) {
+        # %feature_flags is only made into JSON the first time.
+        print $jc->create ({flags => $flags, user => $request->{user}});
+    }
+
+=head1 DESCRIPTION
+
+This module marks a large array or hash which doesn't change, such as
+configuration data, so that a JSON::Create object made with
+L<JSON::Create/new> keeps its JSON after the first time it is
+created, and copies it into the output on later calls instead of
+making it again.
+
+The JSON is kept by the JSON::Create object, keyed by the address of
+the array or hash, so it doesn't matter whether the same
+JSON::Create::Cached object is used each time, or a new one is made
+for each call. The functions L<JSON::Create/create_json> and
+L<JSON::Create/create_json_strict> do not keep anything between
+calls, so they just write out the array or hash as usual. The
+JSON::Create object doesn't keep the array or hash alive, and once it
+is freed its JSON is thrown away.
+
+JSON::Create doesn't check whether the array or hash has changed. If
+it does change, change the version, or call
+L<JSON::Create/clear_cache>.
+
+=head1 METHODS
+
+=head2 new
+
+    my $cached = JSON::Create::Cached->new (\%tree);
+    my $cached = JSON::Create::Cached->new (\%tree, version => $version);
+
+Wrap an array or hash reference. If C<version> is given, the cached
+JSON is only used if it was made with the same version, compared as a
+string.
+
+=head2 version
+
+    $cached->version ($cached->version () + 1);
+
+Get or set the version.
+
+=head1 SEE ALSO
+
+See the documentation for L<JSON::Create> for author, copyright, date,
+and version information.
+
+=cut
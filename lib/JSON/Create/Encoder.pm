@@ -0,0 +1,95 @@
+package JSON::Create::Encoder;
+use warnings;
+use strict;
+use Carp;
+use JSON::Create;
+our $VERSION = '0.36';
+
+sub new
+{
+    my ($class, $jc, $input) = @_;
+    if (! $jc) {
+	croak "Use the encoder method of a JSON::Create object";
+    }
+    if ($JSON::Create::xsok) {
+	return bless enew ($jc, $input), $class;
+    }
+    return JSON::Create::PP::Encoder->new ($jc, $input);
+}
+
+# The C structure can't be copied, so a new thread gets undef
+# instead.
+
+sub CLONE_SKIP
+{
+    return 1;
+}
+
+1;
+
+=encoding UTF-8
+
+=head1 NAME
+
+JSON::Create::Encoder - Make JSON a chunk at a time
+
+=head1 SYNOPSIS
+
+    use JSON::Create;
+    my $jc = JSON::Create->new ();
+    my $enc = $jc->encoder (\%big);
+    while (defined (my $chunk = $enc->next_chunk (0x10000))) {
+        # Send $chunk, then let the event loop do something else.
+    }
+
+=head1 DESCRIPTION
+
+This module makes the JSON for one input in pieces, stopping after
+each piece until it is asked for the next one. This is for servers
+using event loops, where making the JSON for a very large input in one
+go with L<JSON::Create/create> would hold up everything else.
+
+Encoder objects are made with L<JSON::Create/encoder>, and use the
+options and handlers of the JSON::Create object at the time they are
+made. Changing the JSON::Create object afterwards doesn't affect the
+encoder.
+
+The input must not be altered until the encoder has finished with
+it, and the hashes in it must not be iterated over with C<each> or
+C<keys> in the meantime, since the encoder uses their iterators.
+
+Errors are fatal, as with L<JSON::Create::Writer>, since the output
+can't be continued after them. The output doesn't have the
+L</gzip|JSON::Create/gzip> option applied.
+
+=head1 METHODS
+
+=head2 next_chunk
+
+    my $chunk = $enc->next_chunk ($max_bytes);
+
+Get the next piece of JSON, of at most C<$max_bytes> bytes. Every
+chunk except the last one is exactly C<$max_bytes> long, so a chunk
+may end in the middle of a string, a number, or a UTF-8 character. If
+C<$max_bytes> is omitted or zero, the size of the buffer of
+JSON::Create, 16,384 bytes, is used. After all of the JSON has been
+returned, this returns the undefined value.
+
+The encoder holds a reference to the input, but not a copy of it. If
+a hash in the input loses keys between calls to C<next_chunk>, the
+next call dies with C<Input changed during encoding>. Other changes to
+the input don't cause errors, but may make incorrect JSON.
+
+The chunks are always bytes, without Perl's C<utf8> flag, with
+non-ASCII characters in UTF-8, so they can be sent over a network or
+printed to a filehandle in C<:raw> mode.
+
+The pure-Perl version makes all of the JSON on the first call, and
+then splits it into chunks.
+
+=head1 SEE ALSO
+
+See the documentation for L<JSON::Create> for author, copyright, date,
+and version information.
+
+=cut
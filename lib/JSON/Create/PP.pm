@@ -44,7 +44,7 @@ use warnings;
 use strict;
 use utf8;
 use Carp qw/croak carp confess cluck/;
-use Scalar::Util qw/looks_like_number blessed reftype/;
+use Scalar::Util qw/looks_like_number blessed reftype refaddr weaken/;
 use Unicode::UTF8 qw/decode_utf8 valid_utf8 encode_utf8/;
 use B;
 
@@ -55,10 +55,13 @@ sub create_json
     my ($input, %options) = @_;
     my $jc = bless {
 	output => '',
+	path => {},
     };
     $jc->{_strict} = !! $options{strict};
     $jc->{_indent} = !! $options{indent};
     $jc->{_sort} = !! $options{sort};
+    $jc->{_max_depth} = $options{max_depth};
+    $jc->{_gzip} = !! $options{gzip};
     if ($jc->{_indent}) {
 	$jc->{depth} = 0;
     }
@@ -68,6 +71,9 @@ sub create_json
 	delete $jc->{output};
 	return undef;
     }
+    if ($jc->{_gzip}) {
+	return $jc->gzip_output ();
+    }
     return $jc->{output};
 }
 
@@ -78,20 +84,6 @@ sub create_json_strict
     return create_json ($input, %options);
 }
 
-# http://stackoverflow.com/questions/1185822/how-do-i-create-or-test-for-nan-or-infinity-in-perl#1185828
-
-sub isinf {
-    $_[0]==9**9**9;
-}
-
-sub isneginf {
-    $_[0]==-9**9**9;
-}
-
-sub isnan {
-    return ! defined( $_[0] <=> 9**9**9 ); 
-}
-
 sub isfloat
 {
     my ($num) = @_;
@@ -109,9 +101,13 @@ sub isfloat
     # the "I'm gonna monkey with this NV" information available to the
     # Perl programmer.
 
+    #
+    # The flags are used rather than the type of $num, since Perl
+    # reuses the scalar of $num from the previous call, and its type
+    # is never downgraded.
+
     my $r = B::svref_2object (\$num);
-    my $isfloat = $r->isa("B::NV") || $r->isa("B::PVNV");
-    return $isfloat;
+    return $r->FLAGS & B::SVf_NOK;
 }
 
 # Built in booleans. The nasty PL_sv_(yes|no) stuff comes from
@@ -137,40 +133,122 @@ sub isbool
     return undef;
 }
 
+# Perl 5.36 and later know which scalars are booleans.
+
+my $is_bool = defined &builtin::is_bool ? \&builtin::is_bool : undef;
+
+# Classes of booleans from other modules, which are written as true or
+# false unless there is a handler for them. Types::Serialiser and
+# Mojo::JSON use JSON::PP::Boolean.
+
+my %bool_classes = (
+    'JSON::PP::Boolean' => 1,
+    'boolean' => 1,
+    'Mojo::JSON::_Bool' => 1,
+    'JSON::Tiny::_Bool' => 1,
+);
+
+# The escapes of the characters which always need escaping in JSON
+# strings.
+
+my %escapes = (
+    '"' => '\\"',
+    '\\' => '\\\\',
+    "\x08" => '\\b',
+    "\f" => '\\f',
+    "\n" => '\\n',
+    "\r" => '\\r',
+    "\t" => '\\t',
+);
+for my $c (0..0x1f) {
+    my $char = chr ($c);
+    if (! $escapes{$char}) {
+	$escapes{$char} = sprintf ("\\u%04x", $c);
+    }
+}
+
 sub json_escape
 {
     my ($input) = @_;
-    $input =~ s/("|\\)/\\$1/g;
-    $input =~ s/\x08/\\b/g;
-    $input =~ s/\f/\\f/g;
-    $input =~ s/\n/\\n/g;
-    $input =~ s/\r/\\r/g;
-    $input =~ s/\t/\\t/g;
-    $input =~ s/([\x00-\x1f])/sprintf ("\\u%04x", ord ($1))/ge;
+    $input =~ s/([\x00-\x1f"\\])/$escapes{$1}/g;
     return $input;
 }
 
-sub escape_all_unicode
+# Escape the character $char as \uXXXX, or as a surrogate pair of
+# those if it is above U+FFFF.
+
+sub unicode_escape
 {
-    my ($jc, $input) = @_;
+    my ($format, $char) = @_;
+    my $c = ord ($char);
+    if ($c < 0x10000) {
+	return sprintf ($format, $c);
+    }
+    return sprintf ($format, 0xD800 | ((($c - 0x10000) >> 10) & 0x3ff)) .
+	sprintf ($format, 0xDC00 | ($c & 0x3ff));
+}
+
+# Make a routine which escapes its argument in place according to the
+# options of $jc, so that the options are looked at once rather than
+# for every string. Everything is escaped by a single substitution.
+
+sub make_escaper
+{
+    my ($jc) = @_;
+    my %esc = %escapes;
     my $format = "\\u%04x";
     if ($jc->{_unicode_upper}) {
 	$format = "\\u%04X";
+	for my $char (keys %esc) {
+	    if ($esc{$char} =~ /^\\u/) {
+		$esc{$char} = sprintf ($format, ord ($char));
+	    }
+	}
     }
-    $input =~ s/([\x{007f}-\x{ffff}])/sprintf ($format, ord ($1))/ge;
-    # Convert U+10000 to U+10FFFF into surrogate pairs
-    $input =~ s/([\x{10000}-\x{10ffff}])/
-	sprintf ($format, 0xD800 | (((ord ($1)-0x10000) >>10) & 0x3ff)) .
-	sprintf ($format, 0xDC00 |  ((ord ($1)) & 0x3ff))
-    /gex;
-    return $input;
+    my $chars = '\x00-\x1f"\\\\';
+    if ($jc->{_escape_slash}) {
+	$esc{'/'} = '\\/';
+	$chars .= '/';
+    }
+    if (defined $jc->{_escape_chars}) {
+	for my $char (split //, $jc->{_escape_chars}) {
+	    if (ord ($char) >= 0x80) {
+		last;
+	    }
+	    if (! $esc{$char} || $char eq '/') {
+		$esc{$char} = sprintf ($format, ord ($char));
+		$chars .= quotemeta ($char);
+	    }
+	}
+    }
+    if (! $jc->{_no_javascript_safe}) {
+	$esc{"\x{2028}"} = '\\u2028';
+	$esc{"\x{2029}"} = '\\u2029';
+	$chars .= '\x{2028}\x{2029}';
+    }
+    if ($jc->{_unicode_escape_all}) {
+	my $re = qr/([$chars\x{0080}-\x{10ffff}])/;
+	return sub {
+	    $_[0] =~ s/$re/$esc{$1} || ($esc{$1} = unicode_escape ($format, $1))/ge;
+	};
+    }
+    if ($jc->{_escape_non_bmp}) {
+	my $re = qr/([$chars\x{10000}-\x{10ffff}])/;
+	return sub {
+	    $_[0] =~ s/$re/$esc{$1} || ($esc{$1} = unicode_escape ($format, $1))/ge;
+	};
+    }
+    my $re = qr/([$chars])/;
+    return sub {
+	$_[0] =~ s/$re/$esc{$1}/g;
+    };
 }
 
 sub stringify
 {
     my ($jc, $input) = @_;
-    if (! utf8::is_utf8 ($input)) {
-	if ($input =~ /[\x{80}-\x{FF}]/ && $jc->{_strict}) {
+    if (! utf8::is_utf8 ($input) && $input =~ /[\x{80}-\x{FF}]/) {
+	if ($jc->{_strict}) {
 	    return "Non-ASCII byte in non-utf8 string";
 	}
 	if (! valid_utf8 ($input)) {
@@ -183,18 +261,19 @@ sub stringify
 		return 'Invalid UTF-8';
 	    }
 	}
+	else {
+	    # Escape the characters which the UTF-8 bytes make, like
+	    # the XS version, but leave the output as bytes.
+	    my $escape = $jc->{escape} ||= make_escaper ($jc);
+	    utf8::decode ($input);
+	    $escape->($input);
+	    utf8::encode ($input);
+	    $jc->{output} .= "\"$input\"";
+	    return undef;
+	}
     }
-    $input = json_escape ($input);
-    if ($jc->{_escape_slash}) {
-	$input =~ s!/!\\/!g;
-    }
-    if (! $jc->{_no_javascript_safe}) {
-	$input =~ s/\x{2028}/\\u2028/g;
-	$input =~ s/\x{2029}/\\u2029/g;
-    }
-    if ($jc->{_unicode_escape_all}) {
-	$input = $jc->escape_all_unicode ($input);
-    }
+    my $escape = $jc->{escape} ||= make_escaper ($jc);
+    $escape->($input);
     $jc->{output} .= "\"$input\"";
     return undef;
 }
@@ -221,12 +300,118 @@ sub call_to_json
     if (! defined $json) {
 	return 'undefined value from user routine';
     }
-    if ($jc->{_validate}) {
+    return $jc->add_user_json ($json);
+}
+
+# The handlers which can be given to "obj" by name instead of a
+# routine, apart from "bool".
+
+my %builtin_handlers = (
+    iso8601 => \&builtin_iso8601,
+    number => \&builtin_number,
+    string => \&builtin_string,
+);
+
+# Write an object as a bare number, from its string form, for classes
+# like Math::BigInt.
+
+sub builtin_number
+{
+    my ($jc, $input) = @_;
+    my $string = "$input";
+    if ($string =~ /^-?(?:0|[1-9][0-9]*)(?:\.[0-9]+)?(?:[eE][-+]?[0-9]+)?\z/) {
+	if ($string =~ /^-?[0-9]+\z/ &&
+	    ($jc->{_quote_ints} ||
+	     ($jc->{_quote_big_ints} && abs ($string) >= 9007199254740992))) {
+	    $jc->{output} .= "\"$string\"";
+	    return undef;
+	}
+	$jc->{output} .= $string;
+	return undef;
+    }
+    if ($jc->{_strict}) {
+	return "Non-finite number in input";
+    }
+    return $jc->stringify ($string);
+}
+
+# Write an object as a string. URI objects are references to their
+# string.
+
+sub builtin_string
+{
+    my ($jc, $input) = @_;
+    if (ref ($input) =~ /^URI(?:::|\z)/ && reftype ($input) eq 'SCALAR') {
+	return $jc->value_string ($$input);
+    }
+    return $jc->value_string ("$input");
+}
+
+# Write an object as an ISO 8601 date and time.
+
+sub builtin_iso8601
+{
+    my ($jc, $input) = @_;
+    if (ref ($input) eq 'Time::Piece') {
+	my ($sec, $min, $hour, $mday, $mon, $year) = @$input;
+	return $jc->stringify (sprintf ("%04d-%02d-%02dT%02d:%02d:%02d",
+					$year + 1900, $mon + 1, $mday,
+					$hour, $min, $sec));
+    }
+    if ($input->can ('iso8601')) {
+	my $iso = $input->iso8601 ();
+	if (! defined $iso) {
+	    return 'undefined value from user routine';
+	}
+	return $jc->stringify ("$iso");
+    }
+    return $jc->builtin_string ($input);
+}
+
+# Call a handler for the object $r, or if memoize_handlers is on, use
+# what it returned for $r earlier in this call to create.
+
+sub call_object_handler
+{
+    my ($jc, $cv, $r) = @_;
+    my $memo = $jc->{memo};
+    if (! $memo) {
+	return $jc->call_to_json ($cv, $r);
+    }
+    my $addr = refaddr ($r);
+    if (exists $memo->{$addr}) {
+	return $jc->add_user_json ($memo->{$addr}, 1);
+    }
+    my $json = &{$cv} ($r);
+    if (! defined $json) {
+	return 'undefined value from user routine';
+    }
+    $memo->{$addr} = $json;
+    return $jc->add_user_json ($json);
+}
+
+# Add JSON from the user, either from a user routine or from a
+# JSON::Create::Raw object, to the output. If $trusted is true, it is
+# not validated.
+
+sub add_user_json
+{
+    my ($jc, $json, $trusted) = @_;
+    # JSON can't be cut short, so it is left out if it doesn't fit.
+    if ($jc->over_limit (do { use bytes; length ($json) })) {
+	return $jc->cut_value ();
+    }
+    if ($jc->{_validate} && ! $trusted) {
 	my $error = $jc->validate_user_json ($json);
 	if ($error) {
 	    return $error;
 	}
     }
+    if ($jc->{_indent}) {
+	my $indent = "\n" . "\t" x $jc->{depth};
+	$json =~ s/\n$//;
+	$json =~ s/\n/$indent/g;
+    }
     $jc->{output} .= $json;
     return undef;
 }
@@ -247,27 +432,129 @@ sub handle_non_finite
 	$jc->{output} .= $output;
 	return undef;
     }
-    if ($jc->{_strict}) {
+    if ($jc->{_strict} || $jc->{_canonical}) {
 	return "non-finite number";
     }
     $jc->{output} .= "\"$type\"";
     return undef;
 }
 
+# Make a string which sorts in the order of the UTF-16 code units of
+# $key.
+
+sub utf16_key
+{
+    my ($key) = @_;
+    my $utf16 = '';
+    for my $c (unpack ('U*', $key)) {
+	if ($c >= 0x10000) {
+	    $c -= 0x10000;
+	    $utf16 .= pack ('nn', 0xD800 + ($c >> 10), 0xDC00 + ($c & 0x3FF));
+	}
+	else {
+	    $utf16 .= pack ('n', $c);
+	}
+    }
+    return $utf16;
+}
+
+# Print a number in the way that ECMAScript's Number.toString does,
+# for canonical.
+
+sub es6_number
+{
+    my ($jc, $input) = @_;
+    my $x = $input + 0.0;
+    if ($x == 0) {
+	$jc->{output} .= '0';
+	return undef;
+    }
+    my $sign = $x < 0 ? '-' : '';
+    my $a = abs ($x);
+    my $digits;
+    my $n;
+    PRECISION: for my $p (0..16) {
+	my ($lead, $fraction, $exp) =
+	    (sprintf ("%.*e", $p, $a) =~ /^([0-9])\.?([0-9]*)e([-+][0-9]+)$/);
+	my $r = $lead . $fraction;
+	# When the nearest digits don't give back $a, the ones on the
+	# other side of it sometimes do, as in the XS version.
+	for my $c ($r, $r + 1, $r - 1) {
+	    if ($c == 0) {
+		next;
+	    }
+	    if ($p == 16 || "${c}e" . ($exp - $p) == $a) {
+		$digits = "$c";
+		$n = $exp - $p + length ($digits);
+		last PRECISION;
+	    }
+	}
+    }
+    $digits =~ s/0+$//;
+    my $k = length ($digits);
+    my $out;
+    if ($k <= $n && $n <= 21) {
+	$out = $digits . ('0' x ($n - $k));
+    }
+    elsif (0 < $n && $n <= 21) {
+	$out = substr ($digits, 0, $n) . '.' . substr ($digits, $n);
+    }
+    elsif (-6 < $n && $n <= 0) {
+	$out = '0.' . ('0' x (-$n)) . $digits;
+    }
+    else {
+	$out = substr ($digits, 0, 1);
+	if ($k > 1) {
+	    $out .= '.' . substr ($digits, 1);
+	}
+	$out .= 'e' . ($n - 1 < 0 ? '-' : '+') . abs ($n - 1);
+    }
+    $jc->{output} .= $sign . $out;
+    return undef;
+}
+
 sub handle_number
 {
     my ($jc, $input) = @_;
+    if (($jc->{_quote_ints} || $jc->{_quote_big_ints}) &&
+	$input =~ /^-?[0-9]+\z/ && ! isfloat ($input)) {
+	if ($jc->{_quote_ints} || abs ($input) >= 9007199254740992) {
+	    $jc->{output} .= "\"$input\"";
+	    return undef;
+	}
+    }
+    if ($jc->{_canonical}) {
+	if ($input == int ($input) &&
+	    $input =~ /^(?:0|-?[1-9][0-9]{0,14})\z/) {
+	    $jc->{output} .= $input;
+	    return undef;
+	}
+	if ($input == $input && abs ($input) != 9**9**9) {
+	    return $jc->es6_number ($input);
+	}
+    }
+    if (! $jc->{_fformat} && $input == int ($input) &&
+	$input =~ /^-?(?:0|[1-9][0-9]{0,8})\z/) {
+	# Whether this is an integer or a floating point number, it
+	# prints as itself, so we don't need to find out which it is.
+	$jc->{output} .= $input;
+	return undef;
+    }
+    # This has to be before the comparisons below, which make Perl
+    # keep a floating point value in $input.
+    my $isfloat = isfloat ($input);
     # Perl thinks that nan, inf, etc. look like numbers.
-    if (isnan ($input)) {
+    # http://stackoverflow.com/questions/1185822/how-do-i-create-or-test-for-nan-or-infinity-in-perl#1185828
+    if (! defined ($input <=> 9**9**9)) {
 	return $jc->handle_non_finite ($input, 'nan');
     }
-    elsif (isinf ($input)) {
+    elsif ($input == 9**9**9) {
 	return $jc->handle_non_finite ($input, 'inf');
     }
-    elsif (isneginf ($input)) {
+    elsif ($input == -9**9**9) {
 	return $jc->handle_non_finite ($input, '-inf');
     }
-    elsif (isfloat ($input)) {
+    elsif ($isfloat) {
 	# Default format
 	if ($jc->{_fformat}) {
 	    # Override. Validation is in
@@ -325,33 +612,220 @@ sub comma
     }
 }
 
+# Check that we can go into the array or hash $input, and if so record
+# that we are inside it. The return value is undefined if successful,
+# or the error value if an error occurred.
+
+sub enter
+{
+    my ($jc, $input) = @_;
+    my $addr = refaddr ($input);
+    my $depth = keys %{$jc->{path}};
+    my $max_depth = $jc->{_max_depth};
+    if ($max_depth && $depth >= $max_depth) {
+	return "Input is nested more deeply than max_depth=$max_depth";
+    }
+    if ($jc->{path}{$addr}) {
+	return "Circular reference in input";
+    }
+    $jc->{path}{$addr} = 1;
+    return undef;
+}
+
+sub leave
+{
+    my ($jc, $input) = @_;
+    delete $jc->{path}{refaddr ($input)};
+}
+
+# What goes in place of the things which "truncate" leaves out.
+
+my $marker = '"..."';
+
+# With "truncate", put the marker in place of arrays and hashes nested
+# more deeply than "max_depth".
+
+sub depth_marker
+{
+    my ($jc) = @_;
+    my $max_depth = $jc->{_max_depth};
+    if ($jc->{_truncate} && $max_depth &&
+	keys %{$jc->{path}} >= $max_depth) {
+	$jc->{output} .= $marker;
+	return 1;
+    }
+    return undef;
+}
+
+# Has the output gone past "max_output_bytes", or has a value been cut
+# short or left out because of it? The cached JSON is counted when it
+# is copied into the output.
+
+sub full
+{
+    my ($jc) = @_;
+    if ($jc->{output_full}) {
+	return 1;
+    }
+    return $jc->over_limit (0);
+}
+
+# Would adding $length more bytes take the output past
+# "max_output_bytes"?
+
+sub over_limit
+{
+    my ($jc, $length) = @_;
+    my $max = $jc->{_max_output_bytes};
+    if (! $max || $jc->{in_cache}) {
+	return undef;
+    }
+    return do { use bytes; length ($jc->{output}) } + $length > $max;
+}
+
+# Put the marker in place of a value which would take the output past
+# "max_output_bytes". The marker stands for the rest of the array or
+# hash which the value is in as well.
+
+sub cut_value
+{
+    my ($jc) = @_;
+    if (! $jc->{_truncate}) {
+	return "Output is longer than max_output_bytes=$jc->{_max_output_bytes}";
+    }
+    $jc->{output} .= $marker;
+    $jc->{output_full} = 2;
+    return undef;
+}
+
+# After writing a value of an array or hash, should the rest of it be
+# left out? If the value was replaced by the marker, there is no need
+# for another one.
+
+sub stop_after_value
+{
+    my ($jc) = @_;
+    if (! $jc->{output_full}) {
+	return undef;
+    }
+    if ($jc->{output_full} == 2) {
+	$jc->{output_full} = 1;
+	return 'marker';
+    }
+    return undef;
+}
+
+# Add a comma before all but the first entry of an array or hash.
+
+sub separator
+{
+    my ($jc, $i) = @_;
+    if ($i != 0) {
+	if ($jc->{_indent}) {
+	    comma ($jc);
+	}
+	else {
+	    $jc->{output} .= ',';
+	}
+    }
+}
+
 sub array
 {
     my ($jc, $input) = @_;
-    $jc->openB ('[');
+    if ($jc->depth_marker ()) {
+	return undef;
+    }
+    my $error = enter ($jc, $input);
+    if ($error) {
+	return $error;
+    }
+    my $max_items = $jc->{_max_array_items};
+    if ($max_items && @$input > $max_items && ! $jc->{_truncate}) {
+	return "Array has more than max_array_items=$max_items items";
+    }
+    openB ($jc, '[');
     my $i = 0;
+    my $truncated;
     for my $k (@$input) {
-	if ($i != 0) {
-	    $jc->comma ();
+	if (($max_items && $i >= $max_items) || $jc->full ()) {
+	    $truncated = 1;
+	    last;
 	}
+	separator ($jc, $i);
 	$i++;
 	my $error = create_json_recursively ($jc, $k, \$k);
 	if ($error) {
 	    return $error;
 	}
+	if ($jc->stop_after_value ()) {
+	    last;
+	}
+    }
+    if ($truncated) {
+	if (! $jc->{_truncate}) {
+	    return "Output is longer than max_output_bytes=$jc->{_max_output_bytes}";
+	}
+	separator ($jc, $i);
+	$jc->{output} .= $marker;
     }
-    $jc->closeB (']');
+    closeB ($jc, ']');
+    leave ($jc, $input);
     return undef;
 }
 
 sub object
 {
     my ($jc, $input) = @_;
-    $jc->openB ('{');
-    my @keys = keys %$input;
+    if ($jc->depth_marker ()) {
+	return undef;
+    }
+    if (! %$input) {
+	# Same as the XS version, no whitespace for an empty hash.
+	$jc->{output} .= '{}';
+	return undef;
+    }
+    my $error = enter ($jc, $input);
+    if ($error) {
+	return $error;
+    }
+    my @keys;
+    my $include = $jc->{_include_keys};
+    if ($jc->{_obj_keys}) {
+	my $class = blessed ($input);
+	if (defined $class && $jc->{_obj_keys}{$class}) {
+	    $include = $jc->{_obj_keys}{$class};
+	}
+    }
+    if ($include) {
+	@keys = grep {exists $input->{$_}} @$include;
+    }
+    else {
+	@keys = keys %$input;
+    }
+    my $exclude = $jc->{_exclude_keys};
+    if ($exclude) {
+	@keys = grep {! $exclude->{$_}} @keys;
+    }
+    if ($jc->{_skip_undef}) {
+	@keys = grep {defined $input->{$_}} @keys;
+    }
+    if (! @keys) {
+	leave ($jc, $input);
+	$jc->{output} .= '{}';
+	return undef;
+    }
+    openB ($jc, '{');
     if ($jc->{_sort}) {
-	if ($jc->{cmp}) {
-	    @keys = sort {&{$jc->{cmp}} ($a, $b)} @keys;
+	my $cmp = $jc->{cmp};
+	if ($cmp) {
+	    @keys = sort {&{$cmp} ($a, $b)} @keys;
+	}
+	elsif ($jc->{_canonical}) {
+	    # RFC 8785 sorts by UTF-16 code units.
+	    @keys = map {$_->[1]}
+		    sort {$a->[0] cmp $b->[0]}
+		    map {[utf16_key ($_), $_]} @keys;
 	}
 	else {
 	    @keys = sort @keys;
@@ -359,9 +833,18 @@ sub object
     }
     my $i = 0;
     for my $k (@keys) {
-	if ($i != 0) {
-	    $jc->comma ();
+	# Keys are not cut short, so the key, the quotes and the colon
+	# have to fit.
+	if ($jc->full () ||
+	    $jc->over_limit (do { use bytes; length ($k) } + 3)) {
+	    if (! $jc->{_truncate}) {
+		return "Output is longer than max_output_bytes=$jc->{_max_output_bytes}";
+	    }
+	    separator ($jc, $i);
+	    $jc->{output} .= "$marker:$marker";
+	    last;
 	}
+	separator ($jc, $i);
 	$i++;
 	my $error;
 	$error = stringify ($jc, $k);
@@ -373,10 +856,15 @@ sub object
 	if ($error) {
 	    return $error;
 	}
+	if ($jc->stop_after_value ()) {
+	    last;
+	}
     }
-    $jc->closeB ('}');
+    closeB ($jc, '}');
+    leave ($jc, $input);
     return undef;
 }
+
 sub newline_for_top
 {
     my ($jc) = @_;
@@ -385,52 +873,412 @@ sub newline_for_top
     }
 }
 
-sub create_json_recursively
+# Is the array or hash $input read-only, and is everything inside it
+# read-only too? Restricted hashes made with "lock_keys" are read-only
+# but their values can change, so the values are looked at as
+# well. Objects and references to other things are not treated as
+# read-only.
+
+sub readonly_deep
 {
-    my ($jc, $input, $input_ref) = @_;
-    if ($input_ref) {
-	my $bool = isbool ($input, $input_ref);
-	if ($bool) {
-	    $jc->{output} .= $bool;
-	    $jc->newline_for_top ();
+    my ($input, $depth) = @_;
+    if ($depth > 100) {
+	return undef;
+    }
+    my $is_hash = (reftype ($input) eq 'HASH');
+    if ($is_hash) {
+	if (! Internals::SvREADONLY (%$input) || tied %$input) {
 	    return undef;
 	}
     }
-    if (! defined $input) {
-	$jc->{output} .= 'null';
-	$jc->newline_for_top ();
+    elsif (! Internals::SvREADONLY (@$input) || tied @$input) {
 	return undef;
     }
-    my $ref = ref ($input);
-    if ($ref eq 'JSON::Create::Bool') {
-	if ($$input) {
-	    $jc->{output} .=  'true';
+    # $value is an alias of the value in $input, not a copy.
+    for my $value ($is_hash ? values %$input : @$input) {
+	if (! Internals::SvREADONLY ($value)) {
+	    return undef;
 	}
-	else {
-	     $jc->{output} .= 'false';
+	my $ref = ref $value;
+	if (! $ref) {
+	    next;
 	}
-	$jc->newline_for_top ();
+	if ($ref ne 'HASH' && $ref ne 'ARRAY') {
+	    return undef;
+	}
+	if (! readonly_deep ($value, $depth + 1)) {
+	    return undef;
+	}
+    }
+    return 1;
+}
+
+# Should the read-only array or hash $input be taken from the cache?
+# Whether everything inside $input is read-only is only checked when
+# it is put into the cache, so after that only $input itself is looked
+# at.
+
+sub use_cache
+{
+    my ($jc, $input) = @_;
+    if (! $jc->{_cache_readonly} || ! $jc->{cache} || $jc->{in_cache}) {
 	return undef;
     }
-    if (! keys %{$jc->{_handlers}} && ! $jc->{_obj_handler}) {
-	my $origref = $ref;
-	# Break encapsulation if the user has not supplied handlers.
-	$ref = reftype ($input);
-	if ($ref && $jc->{_strict}) {
-	    if ($ref ne $origref) {
-		return "Object cannot be serialized to JSON: $origref";
-	    }
+    if (reftype ($input) eq 'HASH') {
+	if (! Internals::SvREADONLY (%$input) || tied %$input) {
+	    return undef;
 	}
     }
-    if ($ref) {
-	if ($ref eq 'HASH') {
-	    my $error = $jc->object ($input);
-	    if ($error) {
-		return $error;
-	    }
-	}
-	elsif ($ref eq 'ARRAY') {
-	    my $error = $jc->array ($input);
+    elsif (! Internals::SvREADONLY (@$input) || tied @$input) {
+	return undef;
+    }
+    my $entry = $jc->{cache}{refaddr ($input)};
+    if ($entry && defined $entry->[0] && $entry->[3]) {
+	return 1;
+    }
+    return readonly_deep ($input, 0);
+}
+
+sub same_version
+{
+    my ($a, $b) = @_;
+    if (! defined $b) {
+	return ! defined $a;
+    }
+    return defined $a && $a eq $b;
+}
+
+# Throw away the entries of the cache whose arrays or hashes have been
+# freed, once the cache has grown to "cache_sweep" entries.
+
+sub sweep_cache
+{
+    my ($jc) = @_;
+    my $cache = $jc->{cache};
+    my $sweep = $jc->{cache_sweep} || 64;
+    if (scalar (keys %$cache) < $sweep) {
+	return;
+    }
+    for my $addr (keys %$cache) {
+	if (! defined $cache->{$addr}[0]) {
+	    delete $cache->{$addr};
+	}
+    }
+    $sweep = 2 * scalar (keys %$cache);
+    $jc->{cache_sweep} = $sweep > 64 ? $sweep : 64;
+}
+
+# Write the array or hash $input from the cache, putting it into the
+# cache first if it isn't there or if $version has changed. $readonly
+# marks entries made by "cache_readonly", which use_cache has checked
+# all the way down.
+
+sub cached
+{
+    my ($jc, $input, $version, $readonly) = @_;
+    my $addr = refaddr ($input);
+    my $entry = $jc->{cache}{$addr};
+    if (! $entry || ! defined $entry->[0] ||
+	! same_version ($entry->[1], $version) ||
+	($readonly && ! $entry->[3])) {
+	my $output = $jc->{output};
+	my $depth = $jc->{depth};
+	$jc->{output} = '';
+	$jc->{depth} = 0;
+	$jc->{in_cache} = 1;
+	my $error = create_json_recursively ($jc, $input);
+	$jc->{in_cache} = 0;
+	my $json = $jc->{output};
+	$jc->{output} = $output;
+	$jc->{depth} = $depth;
+	if ($error) {
+	    return $error;
+	}
+	if (! $entry) {
+	    $jc->sweep_cache ();
+	}
+	# The weak reference to $input becomes undefined when $input
+	# is freed, so the entry isn't used for something else at the
+	# same address.
+	$entry = [$input, $version, $json, $readonly];
+	weaken ($entry->[0]);
+	$jc->{cache}{$addr} = $entry;
+    }
+    $jc->add_user_json ($entry->[2], 1);
+    if ($jc->{_indent}) {
+	$jc->newline_for_top ();
+    }
+    return undef;
+}
+
+# Cut $input down to "max_string_bytes" bytes of UTF-8, at a
+# character boundary, and add the marker. The return value is the
+# string and the error, if any.
+
+sub shorten
+{
+    my ($jc, $input) = @_;
+    my $max = $jc->{_max_string_bytes};
+    my $bytes = $input;
+    my $is_utf8 = utf8::is_utf8 ($bytes);
+    if ($is_utf8) {
+	utf8::encode ($bytes);
+    }
+    if (length ($bytes) <= $max) {
+	return ($input, undef);
+    }
+    if (! $jc->{_truncate}) {
+	return (undef, "String is longer than max_string_bytes=$max");
+    }
+    my $cut = $max;
+    while ($cut > 0 && (ord (substr ($bytes, $cut, 1)) & 0xC0) == 0x80) {
+	$cut--;
+    }
+    my $short = substr ($bytes, 0, $cut) . '...';
+    if ($is_utf8) {
+	utf8::decode ($short);
+    }
+    return ($short, undef);
+}
+
+# The most bytes which each character of a string can take in the
+# output, the same as "json_create_core_string_fit" in the XS
+# version. The return value is the number of bytes at the start of the
+# UTF-8 $bytes which fit into $room bytes.
+
+sub string_fit
+{
+    my ($jc, $bytes, $room) = @_;
+    my $escape_chars = $jc->{_escape_chars};
+    if (! defined $escape_chars) {
+	$escape_chars = '';
+    }
+    my $n = length ($bytes);
+    my $used = 0;
+    my $i = 0;
+    while ($i < $n) {
+	my $c = substr ($bytes, $i, 1);
+	my $o = ord ($c);
+	my $length = 1;
+	my $most = 6;
+	if ($o < 0x20) {
+	    if ($c =~ /[\b\t\n\f\r]/) {
+		$most = 2;
+	    }
+	}
+	elsif ($c eq '"' || $c eq '\\') {
+	    $most = 2;
+	}
+	elsif ($o < 0x80) {
+	    if (index ($escape_chars, $c) >= 0) {
+		$most = 6;
+	    }
+	    elsif ($c eq '/' && $jc->{_escape_slash}) {
+		$most = 2;
+	    }
+	    else {
+		$most = 1;
+	    }
+	}
+	elsif ($o >= 0xC2 && $o <= 0xF4) {
+	    # The number of continuation bytes a valid character has.
+	    my $more = $o < 0xE0 ? 1 : $o < 0xF0 ? 2 : 3;
+	    my $valid = 1;
+	    for my $k (1..$more) {
+		if ($i + $k >= $n ||
+		    (ord (substr ($bytes, $i + $k, 1)) & 0xC0) != 0x80) {
+		    $valid = undef;
+		}
+	    }
+	    if ($valid) {
+		$length = $more + 1;
+		if ($more == 1) {
+		    $most = $jc->{_unicode_escape_all} ? 6 : 2;
+		}
+		elsif ($more == 2) {
+		    $most = ($jc->{_unicode_escape_all} ||
+			     ! $jc->{_no_javascript_safe}) ? 6 : 3;
+		}
+		else {
+		    $most = ($jc->{_unicode_escape_all} ||
+			     $jc->{_escape_non_bmp}) ? 12 : 4;
+		}
+	    }
+	}
+	if ($used + $most > $room) {
+	    last;
+	}
+	$used += $most;
+	$i += $length;
+    }
+    return $i;
+}
+
+# Write the string value $input, applying "max_string_bytes" and
+# "max_output_bytes". If it would take the output past
+# "max_output_bytes", as much of it as fits is written, followed by
+# the marker.
+
+sub value_string
+{
+    my ($jc, $input) = @_;
+    my $error;
+    my $original = $input;
+    if ($jc->{_max_string_bytes}) {
+	($input, $error) = $jc->shorten ($input);
+	if ($error) {
+	    return $error;
+	}
+    }
+    my $max = $jc->{_max_output_bytes};
+    if (! $max || $jc->{in_cache}) {
+	return stringify ($jc, $input);
+    }
+    my $output = $jc->{output};
+    $error = stringify ($jc, $input);
+    if ($error || ! $jc->over_limit (0)) {
+	return $error;
+    }
+    if (! $jc->{_truncate}) {
+	return "Output is longer than max_output_bytes=$max";
+    }
+    $jc->{output} = $output;
+    my $bytes = $input;
+    my $is_utf8 = utf8::is_utf8 ($bytes);
+    if ($is_utf8) {
+	utf8::encode ($bytes);
+    }
+    if ($input ne $original) {
+	# Cut the string again rather than adding a second marker.
+	$bytes =~ s/\.\.\.\z//;
+    }
+    # The quotes and the marker.
+    my $room = $max - do { use bytes; length ($output) } - length ($marker);
+    my $cut = 0;
+    if ($room > 0) {
+	$cut = $jc->string_fit ($bytes, $room);
+    }
+    my $short = substr ($bytes, 0, $cut) . '...';
+    if ($is_utf8) {
+	utf8::decode ($short);
+    }
+    $error = stringify ($jc, $short);
+    $jc->{output_full} = $cut == 0 ? 2 : 1;
+    return $error;
+}
+
+sub create_json_recursively
+{
+    my ($jc, $input, $input_ref) = @_;
+    if (! defined $input) {
+	$jc->{output} .= 'null';
+	if ($jc->{_indent}) {
+	    $jc->newline_for_top ();
+	}
+	return undef;
+    }
+    my $ref = ref ($input);
+    if (! $ref) {
+	# Strings and numbers, which are most of the input, are dealt
+	# with first. &PL_sv_yes and &PL_sv_no are read-only, so
+	# looking at that first saves calling "isbool" for every
+	# value.
+	my $error;
+	if ($input_ref && Internals::SvREADONLY ($$input_ref) &&
+	    (my $bool = isbool ($input, $input_ref))) {
+	    $jc->{output} .= $bool;
+	}
+	elsif ($is_bool && do { no warnings; $is_bool->($input) }) {
+	    $jc->{output} .= $input ? 'true' : 'false';
+	}
+	elsif (looks_like_number ($input) && $input !~ /^0[^.]/) {
+	    $error = handle_number ($jc, $input);
+	}
+	else {
+	    $error = $jc->value_string ($input);
+	}
+	if ($error) {
+	    return $error;
+	}
+	if ($jc->{_indent}) {
+	    $jc->newline_for_top ();
+	}
+	return undef;
+    }
+    if ($ref eq 'HASH' || $ref eq 'ARRAY') {
+	# Unblessed arrays and hashes don't need the checks for
+	# objects below.
+	if ($jc->{_cache_readonly} && $jc->use_cache ($input)) {
+	    return $jc->cached ($input, undef, 1);
+	}
+	if ($ref eq 'HASH') {
+	    return object ($jc, $input);
+	}
+	return array ($jc, $input);
+    }
+    if ($ref eq 'JSON::Create::Bool' ||
+	($bool_classes{$ref} && ! $jc->{_handlers}{$ref})) {
+	if ($$input) {
+	    $jc->{output} .=  'true';
+	}
+	else {
+	     $jc->{output} .= 'false';
+	}
+	$jc->newline_for_top ();
+	return undef;
+    }
+    if ($ref eq 'JSON::Create::Raw') {
+	my ($json, $trusted) = @$input;
+	if (! defined $json) {
+	    return "Undefined value in JSON::Create::Raw object";
+	}
+	return $jc->add_user_json ($json, $trusted);
+    }
+    if ($ref eq 'JSON::Create::Packed') {
+	my ($buf, $letter) = @$input;
+	if (! defined $buf || ! $letter || $letter !~ /^[dfqQlL]$/) {
+	    return "JSON::Create::Packed object does not contain packed numbers";
+	}
+	$input = [unpack ("$letter*", $buf)];
+	$ref = 'ARRAY';
+    }
+    if ($ref eq 'JSON::Create::Cached') {
+	my ($tree, $version) = @$input;
+	my $type = reftype ($tree);
+	if (! $type || ($type ne 'ARRAY' && $type ne 'HASH')) {
+	    return "JSON::Create::Cached object does not contain an array or hash reference";
+	}
+	if (! $jc->{cache} || $jc->{in_cache}) {
+	    $input = $tree;
+	    $ref = $type;
+	}
+	else {
+	    return $jc->cached ($tree, $version);
+	}
+    }
+    if (! keys %{$jc->{_handlers}} && ! $jc->{_obj_handler}) {
+	my $origref = $ref;
+	# Break encapsulation if the user has not supplied handlers.
+	$ref = reftype ($input);
+	if ($ref && $jc->{_strict}) {
+	    if ($ref ne $origref) {
+		return "Object cannot be serialized to JSON: $origref";
+	    }
+	}
+    }
+    if ($ref) {
+	if (($ref eq 'HASH' || $ref eq 'ARRAY') && $jc->{_cache_readonly} &&
+	    $jc->use_cache ($input)) {
+	    return $jc->cached ($input, undef, 1);
+	}
+	if ($ref eq 'HASH') {
+	    my $error = object ($jc, $input);
+	    if ($error) {
+		return $error;
+	    }
+	}
+	elsif ($ref eq 'ARRAY') {
+	    my $error = array ($jc, $input);
 	    if ($error) {
 		return $error;
 	    }
@@ -447,7 +1295,7 @@ sub create_json_recursively
 	else {
 	    if (blessed ($input)) {
 		if ($jc->{_obj_handler}) {
-		    my $error = call_to_json ($jc, $jc->{_obj_handler}, $input);
+		    my $error = $jc->call_object_handler ($jc->{_obj_handler}, $input);
 		    if ($error) {
 			return $error;
 		    }
@@ -464,7 +1312,13 @@ sub create_json_recursively
 			    }
 			}
 			elsif (ref ($handler) eq 'CODE') {
-			    my $error = $jc->call_to_json ($handler, $input);
+			    my $error = $jc->call_object_handler ($handler, $input);
+			    if ($error) {
+				return $error;
+			    }
+			}
+			elsif ($builtin_handlers{$handler}) {
+			    my $error = &{$builtin_handlers{$handler}} ($jc, $input);
 			    if ($error) {
 				return $error;
 			    }
@@ -491,19 +1345,6 @@ sub create_json_recursively
 	    }	    
 	}	
     }
-    else {
-	my $error;
-	if (looks_like_number ($input) && $input !~ /^0[^.]/) {
-	    $error = $jc->handle_number ($input);
-	}
-	else {
-	    $error = stringify ($jc, $input);
-	}
-	if ($error) {
-	    return $error;
-	}
-	$jc->newline_for_top ();
-    }
     return undef;
 }
 
@@ -522,12 +1363,30 @@ sub new
 {
     return bless {
 	_handlers => {},
+	cache => {},
     };
 }
 
+sub cache_readonly
+{
+    my ($jc, $onoff) = @_;
+    $jc->clear_cache ();
+    $jc->{_cache_readonly} = !! $onoff;
+}
+
+sub clear_cache
+{
+    my ($jc) = @_;
+    if ($jc->{cache}) {
+	$jc->{cache} = {};
+	delete $jc->{cache_sweep};
+    }
+}
+
 sub strict
 {
     my ($jc, $onoff) = @_;
+    $jc->clear_cache ();
     $jc->{_strict} = !! $onoff;
 }
 
@@ -540,6 +1399,7 @@ sub get_handlers
 sub non_finite_handler
 {
     my ($jc, $handler) = @_;
+    $jc->clear_cache ();
     $jc->{_non_finite_handler} = $handler;
     return undef;
 }
@@ -547,60 +1407,193 @@ sub non_finite_handler
 sub bool
 {
     my ($jc, @list) = @_;
+    $jc->clear_cache ();
     my $handlers = $jc->get_handlers ();
     for my $k (@list) {
 	$handlers->{$k} = 'bool';
     }
 }
 
+sub canonical
+{
+    my ($jc, $onoff) = @_;
+    $jc->clear_cache ();
+    delete $jc->{escape};
+    $jc->{_canonical} = !! $onoff;
+    if ($onoff) {
+	$jc->{_sort} = 1;
+	$jc->{_indent} = 0;
+	$jc->{_escape_slash} = 0;
+	$jc->{_escape_chars} = undef;
+	$jc->{_unicode_upper} = 0;
+	$jc->{_unicode_escape_all} = 0;
+	$jc->{_escape_non_bmp} = 0;
+	$jc->{_no_javascript_safe} = 1;
+    }
+}
+
 sub cmp
 {
     my ($jc, $cmp) = @_;
+    $jc->clear_cache ();
     $jc->{cmp} = $cmp;
 }
 
+sub escape_chars
+{
+    my ($jc, $chars) = @_;
+    $jc->clear_cache ();
+    delete $jc->{escape};
+    if (defined $chars && $chars =~ /[^\x00-\x7f]/) {
+	carp "Non-ASCII characters in escape_chars are ignored";
+    }
+    $jc->{_escape_chars} = $chars;
+}
+
+sub escape_non_bmp
+{
+    my ($jc, $onoff) = @_;
+    $jc->clear_cache ();
+    delete $jc->{escape};
+    $jc->{_escape_non_bmp} = !! $onoff;
+}
+
 sub escape_slash
 {
     my ($jc, $onoff) = @_;
+    $jc->clear_cache ();
+    delete $jc->{escape};
     $jc->{_escape_slash} = !! $onoff;
 }
 
+sub exclude_keys
+{
+    my ($jc, $keys) = @_;
+    $jc->clear_cache ();
+    if (defined $keys && ref $keys ne 'ARRAY') {
+	carp "exclude_keys needs an array reference";
+	return;
+    }
+    $jc->{_exclude_keys} = $keys && {map {$_ => 1} @$keys};
+}
+
 sub fatal_errors
 {
     my ($jc, $onoff) = @_;
     $jc->{_fatal_errors} = !! $onoff;
 }
 
+sub include_keys
+{
+    my ($jc, $keys) = @_;
+    $jc->clear_cache ();
+    if (defined $keys && ref $keys ne 'ARRAY') {
+	carp "include_keys needs an array reference";
+	return;
+    }
+    $jc->{_include_keys} = $keys && [@$keys];
+}
+
 sub indent
 {
     my ($jc, $onoff) = @_;
+    $jc->clear_cache ();
     $jc->{_indent} = !! $onoff;
 }
 
+sub max_array_items
+{
+    my ($jc, $max_array_items) = @_;
+    $jc->clear_cache ();
+    $jc->{_max_array_items} = $max_array_items;
+}
+
+sub max_depth
+{
+    my ($jc, $max_depth) = @_;
+    $jc->{_max_depth} = $max_depth;
+}
+
+sub max_output_bytes
+{
+    my ($jc, $max_output_bytes) = @_;
+    $jc->{_max_output_bytes} = $max_output_bytes;
+}
+
+sub max_string_bytes
+{
+    my ($jc, $max_string_bytes) = @_;
+    $jc->clear_cache ();
+    $jc->{_max_string_bytes} = $max_string_bytes;
+}
+
+sub memoize_handlers
+{
+    my ($jc, $onoff) = @_;
+    $jc->{_memoize_handlers} = !! $onoff;
+}
+
 sub no_javascript_safe
 {
     my ($jc, $onoff) = @_;
+    $jc->clear_cache ();
+    delete $jc->{escape};
     $jc->{_no_javascript_safe} = !! $onoff;
 }
 
 sub obj
 {
     my ($jc, %things) = @_;
+    $jc->clear_cache ();
     my $handlers = $jc->get_handlers ();
     for my $k (keys %things) {
 	$handlers->{$k} = $things{$k};
     }
 }
 
+sub obj_keys
+{
+    my ($jc, %things) = @_;
+    $jc->clear_cache ();
+    for my $class (keys %things) {
+	my $keys = $things{$class};
+	if (! defined $keys) {
+	    delete $jc->{_obj_keys}{$class};
+	    next;
+	}
+	if (ref $keys ne 'ARRAY') {
+	    carp "obj_keys needs an array reference";
+	    next;
+	}
+	$jc->{_obj_keys}{$class} = [@$keys];
+    }
+}
+
 sub obj_handler
 {
     my ($jc, $handler) = @_;
+    $jc->clear_cache ();
     $jc->{_obj_handler} = $handler;
 }
 
+sub quote_big_ints
+{
+    my ($jc, $onoff) = @_;
+    $jc->clear_cache ();
+    $jc->{_quote_big_ints} = !! $onoff;
+}
+
+sub quote_ints
+{
+    my ($jc, $onoff) = @_;
+    $jc->clear_cache ();
+    $jc->{_quote_ints} = !! $onoff;
+}
+
 sub replace_bad_utf8
 {
     my ($jc, $onoff) = @_;
+    $jc->clear_cache ();
     $jc->{_replace_bad_utf8} = !! $onoff;
 }
 
@@ -613,18 +1606,81 @@ sub create
 {
     my ($jc, $input) = @_;
     $jc->{output} = '';
+    $jc->{output_full} = 0;
+    $jc->{path} = {};
+    $jc->{depth} = 0;
+    if ($jc->{_memoize_handlers}) {
+	$jc->{memo} = {};
+    }
     my $error = create_json_recursively ($jc, $input);
+    delete $jc->{memo};
     if ($error) {
 	$jc->user_error ($error);
 	delete $jc->{output};
 	return undef;
     }
+    if ($jc->{_gzip}) {
+	return $jc->gzip_output ();
+    }
     if ($jc->{_downgrade_utf8}) {
 	$jc->{output} = encode_utf8 ($jc->{output});
     }
     return $jc->{output};
 }
 
+sub gzip_available
+{
+    return eval {
+	require IO::Compress::Gzip;
+	1;
+    };
+}
+
+# Compress the output with gzip. The return value is the compressed
+# output, or undef if there is an error.
+
+sub gzip_output
+{
+    my ($jc) = @_;
+    if (! gzip_available ()) {
+	$jc->user_error ("gzip is not available because IO::Compress::Gzip could not be loaded");
+	return undef;
+    }
+    my $json = $jc->{output};
+    if (utf8::is_utf8 ($json)) {
+	$json = encode_utf8 ($json);
+    }
+    my $gzipped;
+    if (! IO::Compress::Gzip::gzip (\$json, \$gzipped)) {
+	$jc->user_error ("gzip failed: $IO::Compress::Gzip::GzipError");
+	return undef;
+    }
+    return $gzipped;
+}
+
+sub encoder
+{
+    my ($jc, $input) = @_;
+    require JSON::Create::Encoder;
+    return JSON::Create::Encoder->new ($jc, $input);
+}
+
+sub gzip
+{
+    my ($jc, $onoff) = @_;
+    $jc->{_gzip} = !! $onoff;
+}
+
+# Only JSON is made by the pure-Perl version.
+
+sub format
+{
+    my ($jc, $format) = @_;
+    if ($format ne 'json') {
+	warn "format '$format' is not available in JSON::Create::PP";
+    }
+}
+
 sub set_fformat
 {
     my ($jc, $fformat) = @_;
@@ -634,6 +1690,7 @@ sub set_fformat
 sub set_fformat_unsafe
 {
     my ($jc, $fformat) = @_;
+    $jc->clear_cache ();
     if ($fformat) {
 	$jc->{_fformat} = $fformat;
     }
@@ -645,15 +1702,31 @@ sub set_fformat_unsafe
 sub set_validate
 {
     my ($jc, $onoff) = @_;
+    $jc->clear_cache ();
     $jc->{_validate} = !! $onoff;
 }
 
+sub skip_undef
+{
+    my ($jc, $onoff) = @_;
+    $jc->clear_cache ();
+    $jc->{_skip_undef} = !! $onoff;
+}
+
 sub JSON::Create::PP::sort
 {
     my ($jc, $onoff) = @_;
+    $jc->clear_cache ();
     $jc->{_sort} = !! $onoff;
 }
 
+sub JSON::Create::PP::truncate
+{
+    my ($jc, $onoff) = @_;
+    $jc->clear_cache ();
+    $jc->{_truncate} = !! $onoff;
+}
+
 sub downgrade_utf8
 {
     my ($jc, $onoff) = @_;
@@ -672,6 +1745,14 @@ sub set
 	    $jc->bool (@$value);
 	    next;
 	}
+	if ($k eq 'cache_readonly') {
+	    $jc->cache_readonly ($value);
+	    next;
+	}
+	if ($k eq 'canonical') {
+	    $jc->canonical ($value);
+	    next;
+	}
 	if ($k eq 'cmp') {
 	    $jc->cmp ($value);
 	    next;
@@ -680,18 +1761,62 @@ sub set
 	    $jc->downgrade_utf8 ($value);
 	    next;
 	}
+	if ($k eq 'escape_chars') {
+	    $jc->escape_chars ($value);
+	    next;
+	}
+	if ($k eq 'escape_non_bmp') {
+	    $jc->escape_non_bmp ($value);
+	    next;
+	}
 	if ($k eq 'escape_slash') {
 	    $jc->escape_slash ($value);
 	    next;
 	}
+	if ($k eq 'exclude_keys') {
+	    $jc->exclude_keys ($value);
+	    next;
+	}
 	if ($k eq 'fatal_errors') {
 	    $jc->fatal_errors ($value);
 	    next;
 	}
+	if ($k eq 'format') {
+	    $jc->format ($value);
+	    next;
+	}
+	if ($k eq 'gzip') {
+	    $jc->gzip ($value);
+	    next;
+	}
+	if ($k eq 'include_keys') {
+	    $jc->include_keys ($value);
+	    next;
+	}
 	if ($k eq 'indent') {
 	    $jc->indent ($value);
 	    next;
 	}
+	if ($k eq 'max_array_items') {
+	    $jc->max_array_items ($value);
+	    next;
+	}
+	if ($k eq 'max_depth') {
+	    $jc->max_depth ($value);
+	    next;
+	}
+	if ($k eq 'max_output_bytes') {
+	    $jc->max_output_bytes ($value);
+	    next;
+	}
+	if ($k eq 'max_string_bytes') {
+	    $jc->max_string_bytes ($value);
+	    next;
+	}
+	if ($k eq 'memoize_handlers') {
+	    $jc->memoize_handlers ($value);
+	    next;
+	}
 	if ($k eq 'no_javascript_safe') {
 	    $jc->no_javascript_safe ($value);
 	    next;
@@ -704,10 +1829,22 @@ sub set
 	    $jc->obj_handler ($value);
 	    next;
 	}
+	if ($k eq 'quote_big_ints') {
+	    $jc->quote_big_ints ($value);
+	    next;
+	}
+	if ($k eq 'quote_ints') {
+	    $jc->quote_ints ($value);
+	    next;
+	}
 	if ($k eq 'replace_bad_utf8') {
 	    $jc->replace_bad_utf8 ($value);
 	    next;
 	}
+	if ($k eq 'skip_undef') {
+	    $jc->skip_undef ($value);
+	    next;
+	}
 	if ($k eq 'sort') {
 	    $jc->sort ($value);
 	    next;
@@ -716,6 +1853,14 @@ sub set
 	    $jc->strict ($value);
 	    next;
 	}
+	if ($k eq 'truncate') {
+	    $jc->truncate ($value);
+	    next;
+	}
+	if ($k eq 'unicode_escape_all') {
+	    $jc->unicode_escape_all ($value);
+	    next;
+	}
 	if ($k eq 'unicode_upper') {
 	    $jc->unicode_upper ($value);
 	    next;
@@ -731,18 +1876,23 @@ sub set
 sub type_handler
 {
     my ($jc, $handler) = @_;
+    $jc->clear_cache ();
     $jc->{_type_handler} = $handler;
 }
 
 sub unicode_escape_all
 {
     my ($jc, $onoff) = @_;
+    $jc->clear_cache ();
+    delete $jc->{escape};
     $jc->{_unicode_escape_all} = !! $onoff;
 }
 
 sub unicode_upper
 {
     my ($jc, $onoff) = @_;
+    $jc->clear_cache ();
+    delete $jc->{escape};
     $jc->{_unicode_upper} = !! $onoff;
 }
 
@@ -757,4 +1907,305 @@ sub write_json
     JSON::Create::write_json (@_);
 }
 
+# Pure-Perl version of JSON::Create::Writer.
+
+package JSON::Create::PP::Writer;
+use warnings;
+use strict;
+use Carp 'croak';
+use Scalar::Util 'looks_like_number';
+use Unicode::UTF8 'encode_utf8';
+
+# The size of the XS version's buffer.
+
+my $bufsize = 0x4000;
+
+sub new
+{
+    my $jc = JSON::Create::PP->new ();
+    $jc->fatal_errors (1);
+    $jc->{output} = '';
+    $jc->{depth} = 0;
+    $jc->{path} = {};
+    return bless {
+	jc => $jc,
+	levels => [],
+    };
+}
+
+sub set
+{
+    my ($w, %args) = @_;
+    $w->{jc}->set (%args);
+}
+
+sub fh
+{
+    my ($w, $fh) = @_;
+    $w->{fh} = $fh;
+}
+
+sub writer_error
+{
+    my ($msg) = @_;
+    croak "JSON::Create::Writer: $msg";
+}
+
+# Die if $error is set, since output cannot continue after errors.
+
+sub check
+{
+    my ($w, $error) = @_;
+    if ($error) {
+	$w->{jc}->user_error ($error);
+	writer_error ("output abandoned after error");
+    }
+    if ($w->{fh} && length ($w->{jc}{output}) >= $bufsize) {
+	$w->flush ();
+    }
+}
+
+sub entry
+{
+    my ($w, $level) = @_;
+    my $jc = $w->{jc};
+    if ($level->{count} == 0) {
+	if ($jc->{_indent}) {
+	    $jc->{depth}++;
+	    $jc->newline_indent ();
+	}
+    }
+    else {
+	$jc->comma ();
+    }
+    $level->{count}++;
+}
+
+sub value
+{
+    my ($w, $value) = @_;
+    $w->begin ();
+    $w->check (JSON::Create::PP::create_json_recursively ($w->{jc}, $value));
+    $w->finish (0);
+}
+
+sub begin
+{
+    my ($w) = @_;
+    my $levels = $w->{levels};
+    if (! @$levels) {
+	if ($w->{done}) {
+	    writer_error ("more than one value at the top level");
+	}
+	return;
+    }
+    my $level = $levels->[-1];
+    if ($level->{type} eq '{') {
+	if (! $level->{key}) {
+	    writer_error ("value in an object without a key");
+	}
+	$level->{key} = 0;
+	return;
+    }
+    $w->entry ($level);
+}
+
+sub finish
+{
+    my ($w, $scalar) = @_;
+    if (! @{$w->{levels}}) {
+	$w->{done} = 1;
+	if ($scalar) {
+	    $w->{jc}->newline_for_top ();
+	}
+    }
+}
+
+sub key
+{
+    my ($w, $key) = @_;
+    my $levels = $w->{levels};
+    if (! @$levels || $levels->[-1]{type} ne '{') {
+	writer_error ("key outside an object");
+    }
+    my $level = $levels->[-1];
+    if ($level->{key}) {
+	writer_error ("key after a key without a value");
+    }
+    $w->entry ($level);
+    $w->check (JSON::Create::PP::stringify ($w->{jc}, $key));
+    $w->{jc}{output} .= ':';
+    $level->{key} = 1;
+}
+
+sub start
+{
+    my ($w, $type) = @_;
+    my $jc = $w->{jc};
+    my $max_depth = $jc->{_max_depth};
+    if ($max_depth && @{$w->{levels}} >= $max_depth) {
+	$w->check ("Input is nested more deeply than max_depth=$max_depth");
+    }
+    $w->begin ();
+    $jc->{output} .= $type;
+    push @{$w->{levels}}, {type => $type, count => 0};
+    $w->check ();
+}
+
+sub start_array
+{
+    my ($w) = @_;
+    $w->start ('[');
+}
+
+sub start_object
+{
+    my ($w) = @_;
+    $w->start ('{');
+}
+
+sub end
+{
+    my ($w) = @_;
+    my $jc = $w->{jc};
+    my $level = pop @{$w->{levels}};
+    if (! $level) {
+	writer_error ("end without a start");
+    }
+    if ($level->{key}) {
+	writer_error ("end after a key without a value");
+    }
+    if ($level->{type} eq '{') {
+	if ($level->{count} == 0) {
+	    $jc->{output} .= '}';
+	}
+	else {
+	    $jc->closeB ('}');
+	}
+    }
+    else {
+	if ($level->{count} == 0 && $jc->{_indent}) {
+	    $jc->{depth}++;
+	    $jc->newline_indent ();
+	}
+	$jc->closeB (']');
+    }
+    $w->finish (0);
+    $w->check ();
+}
+
+sub string
+{
+    my ($w, $string) = @_;
+    $w->begin ();
+    $w->check (JSON::Create::PP::stringify ($w->{jc}, $string));
+    $w->finish (1);
+}
+
+sub number
+{
+    my ($w, $number) = @_;
+    if (! looks_like_number ($number)) {
+	writer_error ("number is not a number");
+    }
+    $w->begin ();
+    $w->check ($w->{jc}->handle_number ($number));
+    $w->finish (1);
+}
+
+sub literal
+{
+    my ($w, $literal) = @_;
+    $w->begin ();
+    $w->{jc}{output} .= $literal;
+    $w->finish (1);
+    $w->check ();
+}
+
+sub bool
+{
+    my ($w, $value) = @_;
+    $w->literal ($value ? 'true' : 'false');
+}
+
+sub null
+{
+    my ($w) = @_;
+    $w->literal ('null');
+}
+
+sub output
+{
+    my ($w) = @_;
+    my $jc = $w->{jc};
+    my $output = $jc->{output};
+    $jc->{output} = '';
+    if (utf8::is_utf8 ($output)) {
+	$output = encode_utf8 ($output);
+    }
+    return $output;
+}
+
+sub flush
+{
+    my ($w, $fh) = @_;
+    if (! $fh) {
+	$fh = $w->{fh};
+    }
+    if (! $fh) {
+	writer_error ("no filehandle to flush to");
+    }
+    print {$fh} $w->output ();
+    $fh->flush ();
+}
+
+package JSON::Create::PP::Encoder;
+use warnings;
+use strict;
+use Carp 'croak';
+use Unicode::UTF8 'encode_utf8';
+
+# Unlike the XS version, this makes all of the JSON at once, then
+# hands it out in pieces.
+
+sub new
+{
+    my ($class, $jc, $input) = @_;
+    return bless {
+	jc => $jc,
+	input => $input,
+	offset => 0,
+    }, $class;
+}
+
+sub next_chunk
+{
+    my ($e, $max_bytes) = @_;
+    if (! $max_bytes) {
+	$max_bytes = 0x4000;
+    }
+    if (! defined $e->{json}) {
+	my $jc = $e->{jc};
+	# The encoder's output is never compressed.
+	local $jc->{_gzip};
+	# As in the XS version, errors are always fatal.
+	local $jc->{_fatal_errors} = 1;
+	my $json = $jc->create ($e->{input});
+	if (! defined $json) {
+	    croak "JSON::Create::Encoder: output abandoned after error";
+	}
+	if (utf8::is_utf8 ($json)) {
+	    $json = encode_utf8 ($json);
+	}
+	$e->{json} = $json;
+	delete $e->{input};
+    }
+    if ($e->{offset} >= length ($e->{json})) {
+	return undef;
+    }
+    my $chunk = substr ($e->{json}, $e->{offset}, $max_bytes);
+    $e->{offset} += length ($chunk);
+    return $chunk;
+}
+
 1;
@@ -0,0 +1,176 @@
+package JSON::Create::Packed;
+
+use warnings;
+use strict;
+use Carp;
+
+our $VERSION = '0.36';
+
+# The object is an array containing the packed numbers and their
+# "pack" letter. The XS code in JSON::Create reads this array
+# directly, so don't change its layout without changing
+# json_create_add_packed too.
+
+my %sizes = (
+    d => 8,
+    f => 4,
+    q => 8,
+    Q => 8,
+    l => 4,
+    L => 4,
+);
+
+sub make
+{
+    my ($class, $letter, $buf) = @_;
+    if (! defined $buf) {
+	croak "Undefined packed data";
+    }
+    if (utf8::is_utf8 ($buf)) {
+	# Downgrade a copy, not the user's string.
+	my $copy = $buf;
+	if (! utf8::downgrade ($copy, 1)) {
+	    croak "Packed data contains characters over 0xFF";
+	}
+	$buf = $copy;
+    }
+    my $size = $sizes{$letter};
+    if (length ($buf) % $size != 0) {
+	croak "Length of packed data is not a multiple of $size";
+    }
+    return bless [$buf, $letter], $class;
+}
+
+sub doubles
+{
+    my ($class, $buf) = @_;
+    return make ($class, 'd', $buf);
+}
+
+sub floats
+{
+    my ($class, $buf) = @_;
+    return make ($class, 'f', $buf);
+}
+
+sub int32
+{
+    my ($class, $buf) = @_;
+    return make ($class, 'l', $buf);
+}
+
+sub int64
+{
+    my ($class, $buf) = @_;
+    return make ($class, 'q', $buf);
+}
+
+sub uint32
+{
+    my ($class, $buf) = @_;
+    return make ($class, 'L', $buf);
+}
+
+sub uint64
+{
+    my ($class, $buf) = @_;
+    return make ($class, 'Q', $buf);
+}
+
+sub numbers
+{
+    my ($packed) = @_;
+    my ($buf, $letter) = @$packed;
+    return unpack ("$letter*", $buf);
+}
+
+1;
+
+=encoding UTF-8
+
+=head1 NAME
+
+JSON::Create::Packed - Packed arrays of numbers for JSON::Create
+
+=head1 SYNOPSIS
+
+    use JSON::Create 'create_json';
+    use JSON::Create::Packed;
+
+    my $prices = pack ('d*', 1.25, 2.5, 100);
+    my %series = (prices => JSON::Create::Packed->doubles ($prices));
+    print create_json (\%series);
+    # {"prices":[1.25,2.5,100]}
+
+=head1 DESCRIPTION
+
+This module wraps a string of numbers in the machine's own format,
+as made by L<perlfunc/pack> or taken from a module like L<PDL>, so
+that L<JSON::Create> writes it out as an array of numbers straight
+from the bytes. This avoids making a Perl scalar for each number,
+which saves a lot of time and memory for long series.
+
+JSON::Create handles these objects itself, so there is no need to set
+up an L<JSON::Create/obj> handler, and they work with
+L<JSON::Create/strict>, L<JSON::Create/indent>,
+L<JSON::Create/set_fformat>, and the binary formats of
+L<JSON::Create/format>. Non-finite floating point numbers are
+treated in the same way as other non-finite numbers.
+
+=head1 METHODS
+
+Each of the following makes an object from C<$buf>, which is in the
+byte order of the machine. Its length must be a multiple of the
+size of one number. C<$buf> is copied, but Perl usually shares the
+memory of the copy until one of them is changed.
+
+=head2 doubles
+
+    my $packed = JSON::Create::Packed->doubles ($buf);
+
+Double-precision floating point numbers, as made by C<pack ('d*',
+...)>.
+
+=head2 floats
+
+    my $packed = JSON::Create::Packed->floats ($buf);
+
+Single-precision floating point numbers, as made by C<pack ('f*',
+...)>.
+
+=head2 int32
+
+    my $packed = JSON::Create::Packed->int32 ($buf);
+
+Signed 32-bit integers, as made by C<pack ('l*', ...)>.
+
+=head2 int64
+
+    my $packed = JSON::Create::Packed->int64 ($buf);
+
+Signed 64-bit integers, as made by C<pack ('q*', ...)>.
+
+=head2 uint32
+
+    my $packed = JSON::Create::Packed->uint32 ($buf);
+
+Unsigned 32-bit integers, as made by C<pack ('L*', ...)>.
+
+=head2 uint64
+
+    my $packed = JSON::Create::Packed->uint64 ($buf);
+
+Unsigned 64-bit integers, as made by C<pack ('Q*', ...)>.
+
+=head2 numbers
+
+    my @numbers = $packed->numbers ();
+
+Get the numbers back out of the object as a list.
+
+=head1 SEE ALSO
+
+See the documentation for L<JSON::Create> for author, copyright, date,
+and version information.
+
+=cut
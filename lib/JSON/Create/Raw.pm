@@ -0,0 +1,88 @@
+package JSON::Create::Raw;
+
+use warnings;
+use strict;
+use Carp;
+
+our $VERSION = '0.36';
+
+# The object is an array containing the JSON and the trust flag. The
+# XS code in JSON::Create reads this array directly, so don't change
+# its layout without changing json_create_add_raw too.
+
+sub new
+{
+    my ($class, $json, %options) = @_;
+    if (! defined $json) {
+	croak "Undefined JSON";
+    }
+    my $trust = !! $options{trust};
+    delete $options{trust};
+    for my $k (keys %options) {
+	carp "Unknown option '$k'";
+    }
+    return bless [$json, $trust], $class;
+}
+
+sub json
+{
+    my ($raw) = @_;
+    return $raw->[0];
+}
+
+1;
+
+=encoding UTF-8
+
+=head1 NAME
+
+JSON::Create::Raw - Pre-encoded JSON for JSON::Create
+
+=head1 SYNOPSIS
+
+    use JSON::Create 'create_json';
+    use JSON::Create::Raw;
+
+    my $cached = '{"name":"Goldilocks","bowls":3}';
+    my %thing = (story => JSON::Create::Raw->new ($cached));
+    print create_json (\%thing);
+
+=head1 DESCRIPTION
+
+This module wraps a string of JSON which has already been created so
+that L<JSON::Create> copies it into its output as it is, without
+escaping it as a string. It is for cases like JSON fragments which
+are stored in a database or a cache, where decoding them into Perl
+and encoding them again would be a waste of time.
+
+JSON::Create handles these objects itself, so there is no need to set
+up an L<JSON::Create/obj> handler, and they work with
+L<JSON::Create/strict>.
+
+=head1 METHODS
+
+=head2 new
+
+    my $raw = JSON::Create::Raw->new ($json);
+    my $raw = JSON::Create::Raw->new ($json, trust => 1);
+
+Make a raw JSON object from C<$json>. If L<JSON::Create/validate> is
+switched on, the JSON is checked in the same way as the return
+values of user routines, unless the C<trust> option is set to a true
+value. If C<$json> is a character string, the output of JSON::Create
+is upgraded to characters in the same way as for user routines. When
+L<JSON::Create/indent> is on, newlines in C<$json> are indented to
+the current depth and a final newline is removed.
+
+=head2 json
+
+    my $json = $raw->json ();
+
+Get the JSON back out of the object.
+
+=head1 SEE ALSO
+
+See the documentation for L<JSON::Create> for author, copyright, date,
+and version information.
+
+=cut
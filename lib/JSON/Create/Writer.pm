@@ -0,0 +1,177 @@
+package JSON::Create::Writer;
+use warnings;
+use strict;
+use JSON::Create;
+our $VERSION = '0.36';
+
+sub new
+{
+    my ($class, %args) = @_;
+    my $fh = delete $args{fh};
+    my $w;
+    if ($JSON::Create::xsok) {
+	$w = bless wnew (), $class;
+    }
+    else {
+	$w = JSON::Create::PP::Writer->new ();
+    }
+    $w->set (%args);
+    if ($fh) {
+	$w->fh ($fh);
+    }
+    return $w;
+}
+
+# The C structure can't be copied, so a new thread gets undef
+# instead.
+
+sub CLONE_SKIP
+{
+    return 1;
+}
+
+1;
+
+=encoding UTF-8
+
+=head1 NAME
+
+JSON::Create::Writer - Write JSON one piece at a time
+
+=head1 SYNOPSIS
+
+    use JSON::Create::Writer;
+    my $w = JSON::Create::Writer->new (fh => \*STDOUT);
+    $w->start_array ();
+    while (my $row = $sth->fetchrow_hashref ()) {
+        $w->start_object ();
+        $w->key ('id');
+        $w->number ($row->{id});
+        $w->key ('name');
+        $w->string ($row->{name});
+        $w->end ();
+    }
+    $w->end ();
+    $w->flush ();
+
+=head1 DESCRIPTION
+
+This module writes JSON from a series of calls, so that JSON can be
+made from something like a database cursor without first building a
+Perl structure for L<JSON::Create/create> to turn into JSON. It uses
+the same buffer and the same escaping and number formatting as
+L<JSON::Create>.
+
+The writer checks that the calls make a valid JSON text, so, for
+example, a L</key> must come before each value in an object, and there
+may only be one value at the top level. Calls in the wrong order are
+fatal errors. Errors in the values, such as invalid UTF-8, are also
+fatal by default, since the output cannot be continued after them.
+
+The output is always UTF-8 encoded bytes, as if
+L<JSON::Create/downgrade_utf8> were switched on, so that it can be
+printed to a filehandle without an encoding layer.
+
+=head1 METHODS
+
+=head2 new
+
+    my $w = JSON::Create::Writer->new (%options);
+
+Make a new writer. The options are the same as for
+L<JSON::Create/set>, with the addition of C<fh>, which is the same as
+calling L</fh>.
+
+=head2 bool
+
+    $w->bool ($value);
+
+Write C<true> if C<$value> is true, or C<false> if it is false.
+
+=head2 end
+
+    $w->end ();
+
+End the array or object started most recently by L</start_array> or
+L</start_object>.
+
+=head2 fh
+
+    $w->fh ($fh);
+
+Print the output to C<$fh> whenever the writer's buffer is full, so
+that the memory used stays small however much JSON is written. Call
+L</flush> after the last value to print the remainder. Call with a
+false value to stop printing.
+
+=head2 flush
+
+    $w->flush ($fh);
+
+Print all the output so far to C<$fh>, or to the filehandle set with
+L</fh> if there is no argument, and flush the filehandle.
+
+=head2 key
+
+    $w->key ($key);
+
+Write a key of an object. Each value in an object must be preceded by
+a key.
+
+=head2 null
+
+    $w->null ();
+
+Write C<null>.
+
+=head2 number
+
+    $w->number ($number);
+
+Write a number. It is a fatal error if C<$number> does not look like a
+number.
+
+=head2 output
+
+    my $json = $w->output ();
+
+Return all the output so far and remove it from the writer.
+
+=head2 set
+
+    $w->set (indent => 1);
+
+Set options, as for L<JSON::Create/set>.
+
+=head2 start_array
+
+    $w->start_array ();
+
+Start an array. End it with L</end>.
+
+=head2 start_object
+
+    $w->start_object ();
+
+Start an object. End it with L</end>.
+
+=head2 string
+
+    $w->string ($string);
+
+Write a string. This is always quoted, even if C<$string> looks like a
+number.
+
+=head2 value
+
+    $w->value ($thing);
+
+Write C<$thing> in the same way as L<JSON::Create/create>, so an
+array or hash reference is written out with everything inside it.
+
+=head1 SEE ALSO
+
+See the documentation for L<JSON::Create> for author, copyright, date,
+and version information.
+
+=cut
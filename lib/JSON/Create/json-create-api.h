@@ -0,0 +1,102 @@
+/*
+   C interface of JSON::Create for other XS modules.
+
+   JSON::Create puts a pointer to a "json_create_api_t" into
+   PL_modglobal under the key JSON_CREATE_API_KEY when it is
+   loaded. Get it with "json_create_api_fetch", after loading
+   JSON::Create, for example with "use JSON::Create;" in your Perl
+   module. See "C INTERFACE" in the documentation of JSON::Create.
+
+   The functions which return "int" return zero if everything went
+   well, and otherwise an error number, after a warning, or a croak if
+   the JSON::Create object has "fatal_errors" switched on.
+*/
+
+#ifndef JSON_CREATE_API_H
+#define JSON_CREATE_API_H
+
+/* The version of "json_create_api_t" in this file. New versions only
+   add members at the end. */
+
+#define JSON_CREATE_API_VERSION 1
+
+/* The key in PL_modglobal. */
+
+#define JSON_CREATE_API_KEY "JSON::Create::API"
+
+/* These are only used through pointers. */
+
+struct json_create;
+struct json_create_writer;
+
+typedef struct json_create_api {
+    /* The version of this structure which JSON::Create has. */
+    int version;
+    /* The size of this structure which JSON::Create has. */
+    size_t size;
+
+    /* A JSON::Create object, "$jc" in Perl. This croaks if "sv" is
+       not a JSON::Create object. The object belongs to "sv". */
+    struct json_create * (* jc_from_sv) (pTHX_ SV * sv);
+    /* A new object with the default options. */
+    struct json_create * (* jc_new) (pTHX);
+    /* Free an object from "jc_new". */
+    void (* jc_free) (pTHX_ struct json_create * jc);
+    /* The same as "$jc->set ($key => $value)". */
+    void (* jc_set) (pTHX_ struct json_create * jc, SV * key, SV * value);
+
+    /* The same as "$jc->create ($input)". The return value is a new
+       SV, which the caller must free or mortalize, or & PL_sv_undef
+       after an error. "flags" must be zero. */
+    SV * (* encode_sv) (pTHX_ struct json_create * jc, SV * input,
+			unsigned int flags);
+
+    /* Append the string "s" of length "len" as a JSON string, with
+       the escaping options of "jc", to "out". "s" is UTF-8 if "utf8"
+       is true, otherwise bytes. */
+    int (* escape) (pTHX_ struct json_create * jc, SV * out, const char * s,
+		    STRLEN len, int utf8);
+
+    /* A JSON::Create::Writer object. This croaks if "sv" is not a
+       JSON::Create::Writer object. The object belongs to "sv". */
+    struct json_create_writer * (* writer_from_sv) (pTHX_ SV * sv);
+    /* These do the same as the JSON::Create::Writer methods. Errors
+       in the order of calls croak. */
+    int (* writer_start_array) (pTHX_ struct json_create_writer * w);
+    int (* writer_start_object) (pTHX_ struct json_create_writer * w);
+    int (* writer_end) (pTHX_ struct json_create_writer * w);
+    int (* writer_key) (pTHX_ struct json_create_writer * w, const char * key,
+			STRLEN len, int utf8);
+    int (* writer_string) (pTHX_ struct json_create_writer * w,
+			   const char * s, STRLEN len, int utf8);
+    /* "number" must be an integer, a floating point number, or a
+       string which looks like a number. */
+    int (* writer_number) (pTHX_ struct json_create_writer * w, SV * number);
+    int (* writer_bool) (pTHX_ struct json_create_writer * w, int onoff);
+    int (* writer_null) (pTHX_ struct json_create_writer * w);
+    /* Any Perl structure, the same as "$w->value ($value)". */
+    int (* writer_value) (pTHX_ struct json_create_writer * w, SV * value);
+}
+json_create_api_t;
+
+/* The interface, or zero if JSON::Create is not loaded or is older
+   than "version". */
+
+PERL_STATIC_INLINE json_create_api_t *
+json_create_api_fetch (pTHX_ int version)
+{
+    SV ** svp;
+    json_create_api_t * api;
+
+    svp = hv_fetchs (PL_modglobal, JSON_CREATE_API_KEY, 0);
+    if (! svp || ! SvIOK (* svp)) {
+	return 0;
+    }
+    api = INT2PTR (json_create_api_t *, SvIV (* svp));
+    if (api->version < version) {
+	return 0;
+    }
+    return api;
+}
+
+#endif /* ndef JSON_CREATE_API_H */
@@ -81,7 +81,7 @@ sub setvar
     $set =~ s/^.*(static\s+void\s+json_create_set)/$1/gs;
     $set =~ s/^}.*$//gsm;
     my @setvar;
-    while ($set =~ m!(BOOL|HANDLER|CMP)\s*\((.*?)\)!g) {
+    while ($set =~ m!(BOOL|HANDLER|UINT|CMP)\s*\((.*?)\)!g) {
 	my $value = $2;
 	if ($1 eq 'HANDLER') {
 	    $value .= '_handler';
@@ -0,0 +1,95 @@
+# Test the built-in handlers "number", "string" and "iso8601", which
+# are given to "obj" instead of a routine.
+
+use FindBin '$Bin';
+use lib "$Bin";
+use JCT;
+use Math::BigInt;
+use Math::BigFloat;
+use Time::Piece;
+
+my $jc = JSON::Create->new ();
+$jc->obj (
+    'Math::BigInt' => 'number',
+    'Math::BigFloat' => 'number',
+);
+
+# Numbers
+
+my $big = Math::BigInt->new ('123456789012345678901234567890');
+is ($jc->create ([$big]), '[123456789012345678901234567890]', "big integer");
+is ($jc->create ([Math::BigInt->new (-42)]), '[-42]', "negative integer");
+is ($jc->create ([Math::BigFloat->new ('3.14159265358979323846264338')]),
+    '[3.14159265358979323846264338]', "big float");
+is ($jc->create ([Math::BigInt->bnan ()]), '["NaN"]', "NaN is a string");
+is ($jc->create ([Math::BigInt->binf ('-')]), '["-inf"]',
+    "infinity is a string");
+my $strict = JSON::Create->new (strict => 1);
+$strict->obj ('Math::BigInt' => 'number');
+is ($strict->create ([$big]), "[$big]", "strict mode allows numbers");
+my $warning;
+$SIG{__WARN__} = sub { $warning = "@_"; };
+ok (! defined $strict->create ([Math::BigInt->bnan ()]),
+    "strict mode rejects NaN");
+like ($warning, qr/Non-finite number/, "got a warning");
+
+# Strings
+
+package URI {
+    use overload '""' => sub { return ${$_[0]}; };
+};
+package URI::http {
+    our @ISA = ('URI');
+};
+package Stringy {
+    use overload '""' => sub { return "stringy <$_[0]{x}>"; };
+};
+my $uri = 'http://example.com/a?b="c"';
+my $jcs = JSON::Create->new ();
+$jcs->obj (
+    'URI::http' => 'string',
+    'Stringy' => 'string',
+);
+is ($jcs->create ([bless \$uri, 'URI::http']),
+    '["http://example.com/a?b=\"c\""]', "URI");
+is ($jcs->create ({a => bless {x => "\x{3042}"}, 'Stringy'}),
+    qq!{"a":"stringy <\x{3042}>"}!, "overloaded stringification");
+
+# Dates and times
+
+my $jct = JSON::Create->new ();
+$jct->obj (
+    'Time::Piece' => 'iso8601',
+    'My::Date' => 'iso8601',
+);
+my $t = gmtime (1234567890);
+is ($jct->create ([$t]), '["2009-02-13T23:31:30"]', "Time::Piece");
+is ($jct->create ([$t]), '["' . $t->datetime . '"]', "same as datetime");
+package My::Date {
+    sub iso8601 { return '2001-02-03T04:05:06'; }
+};
+is ($jct->create ([bless {}, 'My::Date']), '["2001-02-03T04:05:06"]',
+    "iso8601 method");
+
+# The method is looked up again when it changes.
+
+{
+    no warnings 'redefine';
+    *My::Date::iso8601 = sub { return '2002-03-04T05:06:07'; };
+}
+is ($jct->create ([bless {}, 'My::Date']), '["2002-03-04T05:06:07"]',
+    "redefined iso8601 method");
+package My::Date::Sub {
+    our @ISA = ('My::Date');
+};
+$jct->obj ('My::Date::Sub' => 'iso8601');
+is ($jct->create ([bless ({}, 'My::Date::Sub'), bless ({}, 'My::Date')]),
+    '["2002-03-04T05:06:07","2002-03-04T05:06:07"]', "inherited method");
+{
+    no warnings 'redefine';
+    *My::Date::iso8601 = sub { return '2003-04-05T06:07:08'; };
+}
+is ($jct->create ([bless {}, 'My::Date::Sub']), '["2003-04-05T06:07:08"]',
+    "redefined inherited method");
+
+done_testing ();
@@ -0,0 +1,160 @@
+# Test JSON::Create::Cached and cache_readonly.
+
+use FindBin '$Bin';
+use lib "$Bin";
+use JCT;
+use JSON::Create::Cached;
+use Hash::Util qw/lock_hash_recurse lock_keys/;
+use Scalar::Util 'weaken';
+
+my %tree = (a => [1, 2, 3]);
+my $cached = JSON::Create::Cached->new (\%tree, version => 1);
+my $jc = JSON::Create->new ();
+is ($jc->create ({t => $cached}), '{"t":{"a":[1,2,3]}}', "cached output");
+push @{$tree{a}}, 4;
+is ($jc->create ({t => $cached}), '{"t":{"a":[1,2,3]}}',
+    "cached output is used again");
+is ($jc->create ([JSON::Create::Cached->new (\%tree, version => 1)]),
+    '[{"a":[1,2,3]}]', "cache is keyed by the array or hash");
+$cached->version (2);
+is ($jc->create ({t => $cached}), '{"t":{"a":[1,2,3,4]}}',
+    "new version is written again");
+push @{$tree{a}}, 5;
+$jc->clear_cache ();
+is ($jc->create ({t => $cached}), '{"t":{"a":[1,2,3,4,5]}}',
+    "clear_cache");
+$jc->set (sort => 1);
+push @{$tree{a}}, 6;
+is ($jc->create ({t => $cached}), '{"t":{"a":[1,2,3,4,5,6]}}',
+    "changing options clears the cache");
+
+# Functions do not keep a cache.
+
+is (create_json ($cached), '{"a":[1,2,3,4,5,6]}', "create_json");
+
+# Indentation at different depths
+
+my $jci = JSON::Create->new (indent => 1, sort => 1);
+my $small = JSON::Create::Cached->new ({b => [1]});
+my $in = {x => {y => $small}, z => $small};
+my $expect = JSON::Create->new (indent => 1, sort => 1)->create (
+    {x => {y => {b => [1]}}, z => {b => [1]}});
+is ($jci->create ($in), $expect, "indentation of cached JSON");
+is ($jci->create ($in), $expect, "indentation of cached JSON again");
+is ($jci->create ($small), "{\n\t\"b\":[\n\t\t1\n\t]\n}\n",
+    "cached JSON at the top level");
+
+# Read-only data
+
+# Make the array @$array and its values read-only.
+
+sub lock_array
+{
+    my ($array) = @_;
+    Internals::SvREADONLY (@$array, 1);
+    Internals::SvREADONLY ($_, 1) for @$array;
+}
+
+my %config = (name => 'x', list => [1, 2]);
+lock_hash_recurse (%config);
+my $jcr = JSON::Create->new (cache_readonly => 1, sort => 1);
+is ($jcr->create ({c => \%config}), '{"c":{"list":[1,2],"name":"x"}}',
+    "hash with an array which is not read-only");
+$config{list}[1] = 3;
+is ($jcr->create ({c => \%config}), '{"c":{"list":[1,3],"name":"x"}}',
+    "hash which is not read-only all the way down is not cached");
+$config{list}[1] = 2;
+lock_array ($config{list});
+is ($jcr->create ({c => \%config}), '{"c":{"list":[1,2],"name":"x"}}',
+    "read-only hash");
+Hash::Util::unlock_hash (%config);
+$config{name} = 'y';
+Hash::Util::lock_hash (%config);
+is ($jcr->create ({c => \%config}), '{"c":{"list":[1,2],"name":"x"}}',
+    "read-only hash is cached");
+$jcr->cache_readonly (0);
+is ($jcr->create ({c => \%config}), '{"c":{"list":[1,2],"name":"y"}}',
+    "cache_readonly off");
+$jcr->cache_readonly (1);
+
+# Read-only arrays with a writable value deep down are not cached.
+
+my $leaf = [0];
+my $deep = $leaf;
+for (1..20) {
+    $deep = [$deep];
+    lock_array ($deep);
+}
+my $nest = '[' x 20;
+my $tsen = ']' x 20;
+is ($jcr->create ($deep), "$nest\[0]$tsen", "deep array");
+$leaf->[0] = 1;
+is ($jcr->create ($deep), "$nest\[1]$tsen",
+    "deep array with a writable value is not cached");
+
+# Only the outer array or hash is checked once it has been cached.
+
+my %inner = (v => 1);
+lock_hash_recurse (%inner);
+my $outer = [\%inner];
+lock_array ($outer);
+is ($jcr->create ([$outer]), '[[{"v":1}]]', "read-only outer array");
+Hash::Util::unlock_hash (%inner);
+$inner{v} = 2;
+is ($jcr->create ([$outer]), '[[{"v":1}]]',
+    "inside of cached array is not checked");
+$jcr->clear_cache ();
+is ($jcr->create ([$outer]), '[[{"v":2}]]', "clear_cache");
+
+# The values of restricted hashes can change.
+
+my %keys = (a => 1);
+lock_keys (%keys);
+ok (Internals::SvREADONLY (%keys), "restricted hash is read-only");
+is ($jcr->create (\%keys), '{"a":1}', "restricted hash");
+$keys{a} = 2;
+is ($jcr->create (\%keys), '{"a":2}', "restricted hash is not cached");
+
+# The cache doesn't keep arrays and hashes alive.
+
+my $weak;
+{
+    my $list = [1, 2];
+    lock_array ($list);
+    $weak = $list;
+    weaken ($weak);
+    is ($jcr->create ($list), '[1,2]', "read-only array");
+    is ($jcr->create ($list), '[1,2]', "read-only array from the cache");
+}
+ok (! defined $weak, "read-only array is freed");
+{
+    my $tree = {x => 1};
+    $weak = $tree;
+    weaken ($weak);
+    is ($jc->create (JSON::Create::Cached->new ($tree)), '{"x":1}',
+	"cached object");
+}
+ok (! defined $weak, "array or hash of a cached object is freed");
+my $all = 1;
+for my $i (1..200) {
+    my $list = [$i];
+    lock_array ($list);
+    if ($jcr->create ($list) ne "[$i]") {
+	$all = 0;
+    }
+}
+ok ($all, "new arrays at the addresses of freed ones are not mixed up");
+
+# Errors are not cached.
+
+my $warning;
+$SIG{__WARN__} = sub { $warning = "@_"; };
+my $jcs = JSON::Create->new (strict => 1);
+my $bad = JSON::Create::Cached->new ([\1]);
+ok (! defined $jcs->create ([$bad]), "error inside cached data");
+ok ($warning, "got warning");
+$warning = undef;
+ok (! defined $jcs->create ([$bad]), "error is not cached");
+ok ($warning, "got warning again");
+
+done_testing ();
@@ -0,0 +1,114 @@
+# Test the canonical option, which makes the JSON Canonicalization
+# Scheme of RFC 8785.
+
+use FindBin '$Bin';
+use lib "$Bin";
+use JCT;
+use JSON::Create::Bool;
+
+my $jc = JSON::Create->new (canonical => 1);
+
+# The example of section 3.2.2 of the RFC
+
+my $input = {
+    numbers => [333333333.33333329, 1E30, 4.50, 2e-3,
+		0.000000000000000000000000001],
+    string => "\x{20ac}\$\x{0f}\nA'B\"\\\\\"/",
+    literals => [undef, true,
+		 false],
+};
+is ($jc->create ($input),
+    '{"literals":[null,true,false],"numbers":[333333333.3333333,1e+30,4.5,0.002,1e-27],"string":"€$\u000f\nA\'B\"\\\\\\\\\"/"}',
+    "RFC 8785 example");
+
+# Sorting by UTF-16 code units, section 3.2.3
+
+my %keys = (
+    "\x{20ac}" => "Euro Sign",
+    "\r" => "Carriage Return",
+    "\x{fb33}" => "Hebrew Letter Dalet With Dagesh",
+    "1" => "One",
+    "\x{1f600}" => "Emoji: Grinning Face",
+    "\x{80}" => "Control",
+    "\x{f6}" => "Latin Small Letter O With Diaeresis",
+);
+# Make sure that U+0080 and U+00F6 are characters, not bytes.
+for my $k (keys %keys) {
+    my $v = delete $keys{$k};
+    utf8::upgrade ($k);
+    $keys{$k} = $v;
+}
+my $sorted = $jc->create (\%keys);
+my @order = map {$keys{$_}} ("\r", "1", "\x{80}", "\x{f6}", "\x{20ac}",
+			     "\x{1f600}", "\x{fb33}");
+my @got = ($sorted =~ /:"([^"]*)"/g);
+is_deeply (\@got, \@order, "keys sorted by UTF-16 code units");
+like ($sorted, qr/"\\r":/, "carriage return escaped");
+like ($sorted, qr/"\x{80}":/, "control character U+0080 not escaped");
+
+# Numbers, from appendix B
+
+my @numbers = (
+    [0, '0'],
+    [-0.0, '0'],
+    [5e-324, '5e-324'],
+    [-5e-324, '-5e-324'],
+    [1.7976931348623157e308, '1.7976931348623157e+308'],
+    [9007199254740992, '9007199254740992'],
+    [-9007199254740992, '-9007199254740992'],
+    [295147905179352830000, '295147905179352830000'],
+    [9.999999999999997e22, '9.999999999999997e+22'],
+    [1e23, '1e+23'],
+    [1e21, '1e+21'],
+    [999999999999999700000, '999999999999999700000'],
+    [0.000001, '0.000001'],
+    [1e-7, '1e-7'],
+    [0.1, '0.1'],
+    [-1.5, '-1.5'],
+    [123, '123'],
+);
+for my $n (@numbers) {
+    my ($value, $expect) = @$n;
+    is ($jc->create ([$value]), "[$expect]", "number $expect");
+}
+
+# Powers of two where the nearest digits at the shortest length don't
+# give back the number, but the next ones up do. The expected outputs
+# are from Number.prototype.toString.
+
+my @powers = (
+    [89, '6.189700196426902e+26'],
+    [-1017, '7.120236347223045e-307'],
+    [-1007, '7.291122019556398e-304'],
+    [-957, '8.209073602596753e-289'],
+    [-808, '5.858190679279809e-244'],
+    [-788, '6.142758149716505e-238'],
+    [-705, '5.940911144672375e-213'],
+);
+for my $n (@powers) {
+    my ($power, $expect) = @$n;
+    is ($jc->create ([2**$power]), "[$expect]", "2**$power");
+}
+
+SKIP: {
+    skip "No 64-bit integers", 1 unless eval { pack ('q', 1) };
+    is ($jc->create ([18446744073709551615]), '[18446744073709552000]',
+	"integer too big for a double is printed as a double");
+};
+
+# Other options are overridden
+
+my $jco = JSON::Create->new (indent => 1, escape_slash => 1,
+			     unicode_escape_all => 1);
+$jco->canonical (1);
+is ($jco->create ({b => '/', a => "\x{2028}"}),
+    qq!{"a":"\x{2028}","b":"/"}!, "canonical overrides other options");
+
+# Errors
+
+my $warning;
+$SIG{__WARN__} = sub { $warning = "@_"; };
+ok (! defined $jc->create ([9**9**9]), "infinity is an error");
+like ($warning, qr/non-finite/i, "got a warning");
+
+done_testing ();
@@ -0,0 +1,179 @@
+# Test the CBOR output format. The expected values are from appendix
+# A of RFC 8949.
+
+use FindBin '$Bin';
+use lib "$Bin";
+use JCT;
+use JSON::Create::Bool;
+use JSON::Create::Raw;
+use JSON::Create::Packed;
+
+if ($ENV{JSONCreatePP}) {
+    plan skip_all => 'CBOR is not available in JSON::Create::PP';
+}
+
+my $jc = JSON::Create->new (format => 'cbor', sort => 1);
+
+sub cbor_is
+{
+    my ($input, $hex, $name) = @_;
+    my $cbor = $jc->create ($input);
+    is (unpack ('H*', $cbor), $hex, $name);
+}
+
+# Integers
+
+cbor_is (0, '00', "zero");
+cbor_is (23, '17', "largest one-byte integer");
+cbor_is (24, '1818', "smallest two-byte integer");
+cbor_is (1000, '1903e8', "one thousand");
+cbor_is (1000000, '1a000f4240', "one million");
+cbor_is (1000000000000, '1b000000e8d4a51000', "eight-byte integer");
+cbor_is (18446744073709551615, '1bffffffffffffffff', "largest unsigned");
+cbor_is (-1, '20', "minus one");
+cbor_is (-1000, '3903e7', "minus one thousand");
+
+# Floats, in the shortest form which doesn't lose anything
+
+cbor_is (1.5, 'f93e00', "half-precision float");
+cbor_is (-4.1, 'fbc010666666666666', "double-precision float");
+cbor_is (100000.0, 'fa47c35000', "single-precision float");
+cbor_is (5.960464477539063e-8, 'f90001', "subnormal half");
+cbor_is (0.1 + 0.2, 'fb3fd3333333333334', "0.1 + 0.2");
+my $inf = 9**9**9;
+cbor_is ($inf, 'f97c00', "infinity");
+cbor_is (-$inf, 'f9fc00', "minus infinity");
+
+# Strings
+
+cbor_is ('', '60', "empty string");
+cbor_is ('a', '6161', "string");
+my $upgraded = "\x{fc}";
+utf8::upgrade ($upgraded);
+cbor_is ($upgraded, '62c3bc', "character string is UTF-8 text");
+cbor_is ("\x{fc}", '41fc', "non-UTF-8 byte string is bytes");
+cbor_is ("\x{6c34}", '63e6b0b4', "character string outside Latin-1");
+cbor_is ("\xff\x00", '42ff00', "byte string");
+cbor_is ('a' x 24, '7818' . ('61' x 24), "string with one-byte length");
+
+# Literals
+
+cbor_is (undef, 'f6', "undef is null");
+cbor_is (true, 'f5', "true");
+cbor_is (false, 'f4', "false");
+cbor_is ([undef], '81f6', "undef inside an array");
+
+# Arrays and hashes
+
+cbor_is ([], '80', "empty array");
+cbor_is ([1, 2, 3], '83010203', "array");
+cbor_is ([1, [2, 3], [4, 5]], '8301820203820405', "nested arrays");
+cbor_is ([(1) x 25], '9819' . ('01' x 25), "array with one-byte length");
+cbor_is ({}, 'a0', "empty hash");
+cbor_is ({a => 1, b => [2, 3]}, 'a26161016162820203', "hash");
+cbor_is (['a', {b => 'c'}], '826161a161626163', "hash in an array");
+
+# Unsorted hashes have the same entries
+
+my $unsorted = JSON::Create->new (format => 'cbor');
+is (length ($unsorted->create ({a => 1, b => 2})),
+    length ($jc->create ({a => 1, b => 2})),
+    "unsorted hash has the same length");
+
+# Output is bytes, even with character strings
+
+my $cbor = $jc->create (["\x{3042}"]);
+ok (! utf8::is_utf8 ($cbor), "output is bytes");
+
+# Indentation doesn't apply
+
+$jc->indent (1);
+cbor_is ({a => [1]}, 'a1616181' . '01', "indent is ignored");
+cbor_is (1, '01', "no newline after a top-level scalar");
+$jc->indent (0);
+
+# Handlers give Perl values rather than JSON text
+
+my $obj = bless {}, 'Some::Object';
+my $jcobj = JSON::Create->new (format => 'cbor');
+$jcobj->obj_handler (sub { return [1, 'x']; });
+is (unpack ('H*', $jcobj->create ([$obj])), '8182016178',
+    "object handler returns a Perl structure");
+$jcobj->obj_handler (sub { return undef; });
+is (unpack ('H*', $jcobj->create ($obj)), 'f6',
+    "object handler returning undef gives null");
+$jcobj->obj_handler (sub { return $_[0]; });
+my $warning;
+$SIG{__WARN__} = sub { $warning = "@_"; };
+ok (! defined $jcobj->create ($obj), "returning the input is an error");
+like ($warning, qr/returned its input/, "got a warning");
+my $calls = 0;
+$jcobj->obj_handler (sub { $calls++; return [1]; });
+$jcobj->memoize_handlers (1);
+is (unpack ('H*', $jcobj->create ([$obj, $obj])), '828101' . '8101',
+    "memoized handler value");
+is ($calls, 1, "memoized handler called once");
+$jcobj->memoize_handlers (0);
+my $yes = 1;
+my $boolobj = bless \$yes, 'Some::Bool';
+my $jcbool = JSON::Create->new (format => 'cbor');
+$jcbool->bool ('Some::Bool');
+is (unpack ('H*', $jcbool->create ($boolobj)), 'f5', "bool handler");
+
+# Raw holds pre-encoded CBOR
+
+is (unpack ('H*', $jc->create ([JSON::Create::Raw->new ("\x01", trust => 1)])),
+    '8101', "raw CBOR");
+
+# Packed numbers
+
+cbor_is (JSON::Create::Packed->int32 (pack ('l*', 1, -1000)), '82013903e7',
+	 "packed integers");
+cbor_is (JSON::Create::Packed->doubles (pack ('d*', 1.5, -4.1)),
+	 '82f93e00fbc010666666666666', "packed doubles");
+
+# The built-in "number" handler writes numbers, not strings
+
+use Math::BigInt;
+use Math::BigFloat;
+my $jcn = JSON::Create->new (format => 'cbor');
+$jcn->obj ('Math::BigInt' => 'number', 'Math::BigFloat' => 'number');
+my @bignums = (
+    ['5', '8105', "small integer"],
+    ['-1000', '813903e7', "negative integer"],
+    ['-9223372036854775808', '813b7fffffffffffffff', "most negative int64"],
+    ['18446744073709551616', '81c249010000000000000000', "positive bignum"],
+    ['-18446744073709551617', '81c349010000000000000000', "negative bignum"],
+);
+for (@bignums) {
+    my ($value, $hex, $name) = @$_;
+    is (unpack ('H*', $jcn->create ([Math::BigInt->new ($value)])), $hex,
+	"Math::BigInt $name");
+}
+is (unpack ('H*', $jcn->create ([Math::BigFloat->new ('1.5')])), '81f93e00',
+    "Math::BigFloat");
+is (unpack ('H*', $jcn->create ([Math::BigInt->bnan ()])), '81634e614e',
+    "NaN is a string");
+
+# Options go back to JSON
+
+$jc->format ('json');
+is ($jc->create ({a => 1}), '{"a":1}', "back to JSON");
+$warning = undef;
+$jc->format ('xml');
+like ($warning, qr/Unknown format 'xml'/, "unknown format");
+is ($jc->create ([1]), '[1]', "unknown format leaves format alone");
+
+# The chunk-at-a-time encoder
+
+my $big = [map {{n => $_, s => 'x' x ($_ % 50)}} 0..5000];
+my $bigjc = JSON::Create->new (format => 'cbor', sort => 1);
+my $whole = $bigjc->create ($big);
+my $enc = $bigjc->encoder ($big);
+my $chunks = '';
+while (defined (my $chunk = $enc->next_chunk (1000))) {
+    $chunks .= $chunk;
+}
+ok ($chunks eq $whole, "encoder gives the same CBOR");
+
+done_testing ();
@@ -0,0 +1,121 @@
+# Test JSON::Create::Encoder.
+
+use FindBin '$Bin';
+use lib "$Bin";
+use JCT;
+
+sub all_chunks
+{
+    my ($enc, $max) = @_;
+    if (! defined $max) {
+	$max = 0;
+    }
+    my @chunks;
+    while (defined (my $chunk = $enc->next_chunk ($max))) {
+	push @chunks, $chunk;
+    }
+    return @chunks;
+}
+
+my $jc = JSON::Create->new (sort => 1, indent => 1);
+my %big;
+for my $i (0..2000) {
+    $big{"k$i"} = [$i, "\x{3042}" x ($i % 7), {a => $i / 3}];
+}
+my $expect = $jc->create (\%big);
+utf8::encode ($expect);
+my $enc = $jc->encoder (\%big);
+my @chunks = all_chunks ($enc, 1000);
+ok (scalar (@chunks) > 10, "got lots of chunks");
+my $over = grep {length ($_) > 1000} @chunks;
+ok (! $over, "chunks are no bigger than the maximum");
+my $short = grep {length ($_) < 1000} @chunks[0..$#chunks - 1];
+ok (! $short, "only the last chunk is short");
+my $utf8 = grep {utf8::is_utf8 ($_)} @chunks;
+ok (! $utf8, "chunks are bytes");
+ok (join ('', @chunks) eq $expect, "chunks make the same JSON as create");
+ok (! defined $enc->next_chunk (), "undef after the end");
+
+# Scalars and empty containers
+
+for my $input (1, 'x', undef, [], {}) {
+    my $e = $jc->encoder ($input);
+    my $j = $jc->create ($input);
+    is (join ('', all_chunks ($e)), $j, "same as create");
+}
+
+# Changing the JSON::Create object doesn't affect the encoder.
+
+my $jcu = JSON::Create->new ();
+my $input = [map {{n => $_}} 1..3000];
+my $e = $jcu->encoder ($input);
+my $first = $e->next_chunk (100);
+$jcu->indent (1);
+my $rest = join ('', all_chunks ($e));
+$jcu->indent (0);
+is ($first . $rest, $jcu->create ($input), "options are copied");
+
+# The input can go out of scope.
+
+my $e2 = $jcu->encoder ([[1, 2], {a => [3]}]);
+my $out = join ('', all_chunks ($e2, 1));
+is ($out, '[[1,2],{"a":[3]}]', "encoder keeps its own reference to input");
+
+# The JSON::Create object can go out of scope.
+
+my $e4 = JSON::Create->new (sort => 1)->encoder ({b => 1, a => 2});
+is (join ('', all_chunks ($e4)), '{"a":2,"b":1}',
+    "encoder keeps its own options");
+
+# A chunk smaller than one string.
+
+my $long = 'abcdefghij' x 10;
+my $e5 = $jcu->encoder ([$long, $long]);
+my @small = all_chunks ($e5, 7);
+ok (! (grep {length ($_) > 7} @small), "long strings are split");
+is (join ('', @small), "[\"$long\",\"$long\"]", "split strings are put back");
+
+# Changing the input between chunks.
+
+SKIP: {
+    skip "JSON::Create::PP makes all the JSON on the first call", 2
+	if $ENV{JSONCreatePP};
+    local $SIG{__WARN__} = sub {};
+    for my $sort (0, 1) {
+	my %shrink = map {("k$_" => $_)} 1..1000;
+	my $es = JSON::Create->new (sort => $sort)->encoder (\%shrink);
+	$es->next_chunk (100);
+	%shrink = ();
+	eval {
+	    all_chunks ($es, 100);
+	};
+	like ($@, qr/Input changed during encoding/,
+	      "error if hash loses keys between chunks, sort = $sort");
+    }
+}
+
+# A circle is found before it has been written out many times.
+
+my $loop = {a => [1]};
+push @{$loop->{a}}, $loop;
+my $el = $jcu->encoder ($loop);
+eval {
+    $el->next_chunk (10);
+};
+like ($@, qr/Circular reference/, "circle found in the first chunk");
+pop @{$loop->{a}};
+
+# Errors are fatal.
+
+my $e3 = $jcu->encoder ([1, sub {}]);
+local $SIG{__WARN__} = sub {};
+eval {
+    all_chunks ($e3);
+};
+ok ($@, "error is fatal");
+eval {
+    $e3->next_chunk ();
+};
+ok ($@, "can't carry on after error");
+
+done_testing ();
@@ -0,0 +1,58 @@
+# Test escape_chars and escape_non_bmp.
+
+use FindBin '$Bin';
+use lib "$Bin";
+use JCT;
+
+my $jc = JSON::Create->new (escape_chars => q{<>&'});
+my $html = q{</script><a href='x'>&amp;</a>};
+is ($jc->create ([$html]),
+    '["\u003c/script\u003e\u003ca href=\u0027x\u0027\u003e\u0026amp;\u003c/a\u003e"]',
+    "HTML-safe escapes");
+is ($jc->create ({'<' => 1}), '{"\u003c":1}', "keys are escaped too");
+my $long = 'x' x 1000;
+is ($jc->create (["$long<$long"]), "[\"$long\\u003c$long\"]",
+    "escape in a long run");
+
+# Quotes and backslashes keep their usual escapes.
+
+$jc->escape_chars (q{"\\a});
+is ($jc->create (["\"\\a"]), '["\"\\\\\u0061"]',
+    "quote and backslash keep their escapes");
+
+# The new set replaces the old one.
+
+is ($jc->create (['<']), '["<"]', "previous characters are not escaped");
+$jc->escape_chars ();
+is ($jc->create (['a']), '["a"]', "no characters escaped");
+
+# Interaction with escape_slash
+
+$jc->escape_slash (1);
+is ($jc->create (['/']), '["\/"]', "escape_slash");
+$jc->escape_chars ('/');
+is ($jc->create (['/']), '["\u002f"]', "escape_chars beats escape_slash");
+$jc->escape_chars ('');
+is ($jc->create (['/']), '["\/"]', "escape_slash is still on");
+$jc->escape_slash (0);
+is ($jc->create (['/']), '["/"]', "escape_slash is off");
+$jc->unicode_upper (1);
+$jc->escape_chars ('<');
+is ($jc->create (['<']), '["\u003C"]', "unicode_upper");
+
+my $warning;
+$SIG{__WARN__} = sub { $warning = "@_"; };
+$jc->escape_chars ("<\x{3042}");
+like ($warning, qr/Non-ASCII characters in escape_chars/, "non-ASCII warning");
+
+# Characters outside the Basic Multilingual Plane
+
+my $bmp = JSON::Create->new (escape_non_bmp => 1);
+is ($bmp->create (["\x{3042}\x{1F600}"]), "[\"\x{3042}\\ud83d\\ude00\"]",
+    "non-BMP escaped as surrogates");
+is ($bmp->create (["$long\x{1F600}$long"]), "[\"$long\\ud83d\\ude00$long\"]",
+    "non-BMP in a long run");
+my $bytes = "\xf0\x9f\x98\x80";
+is ($bmp->create ([$bytes]), '["\ud83d\ude00"]', "non-BMP UTF-8 bytes");
+
+done_testing ();
@@ -56,6 +56,26 @@ my $elpout = $jc->create (\@piarray);
 #note $elpout;
 like ($elpout, $eout_re, "%2.10e looks like e format");
 
+# Formats which are printed without snprintf.
+
+my $jcf = JSON::Create->new ();
+$jcf->set_fformat ('%.2f');
+is ($jcf->create ([0.125, 2.675, -0.001, 19.999, 1e20]),
+    '[0.12,2.67,-0.00,20.00,' . sprintf ('%.2f', 1e20) . ']', "%.2f");
+$jcf->set_fformat ('%.3e');
+is ($jcf->create ([12345.678, -0.00012345, 0.0]),
+    '[1.235e+04,-1.234e-04,0.000e+00]', "%.3e");
+$jcf->set_fformat ('%.4g');
+is ($jcf->create ([123456.0, 0.0001, 1.5, 99999.0]),
+    '[1.235e+05,0.0001,1.5,1e+05]', "%.4g");
+for my $format ('%.6f', '%.1e', '%G', '%f') {
+    $jcf->set_fformat ($format);
+    my @numbers = map {$_ * 1.1} (-3, 0.3, 1/3, 77.7, 1e-7);
+    is ($jcf->create (\@numbers),
+	'[' . join (',', map {sprintf ($format, $_)} @numbers) . ']',
+	"same as sprintf with $format");
+}
+
 badformat ($jc, '%2.100g');
 badformat ($jc, 'Magnum PI');
 
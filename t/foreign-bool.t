@@ -0,0 +1,65 @@
+# Test that the booleans of other modules, and Perl's own booleans,
+# are written as true and false without handlers.
+
+use FindBin '$Bin';
+use lib "$Bin";
+use JCT;
+use JSON::Create::Bool;
+
+# These are made the same way as by the modules themselves, so that
+# we don't need to install them.
+
+sub make_bool
+{
+    my ($class, $value) = @_;
+    return bless \$value, $class;
+}
+
+# This is made before any of the classes exist.
+my $early = JSON::Create->new ();
+my @classes = ('JSON::PP::Boolean', 'boolean', 'Mojo::JSON::_Bool',
+	       'JSON::Tiny::_Bool');
+for my $class (@classes) {
+    my $input = [make_bool ($class, 1), make_bool ($class, 0)];
+    is (create_json ($input), '[true,false]', "$class");
+    is (create_json_strict ($input), '[true,false]', "$class in strict mode");
+    is ($early->create ($input), '[true,false]',
+	"$class made after the JSON::Create object");
+}
+
+# Mixed data from several places
+
+my $mixed = {
+    a => make_bool ('JSON::PP::Boolean', 1),
+    b => make_bool ('boolean', 0),
+    c => true,
+};
+my $jc = JSON::Create->new (sort => 1);
+is ($jc->create ($mixed), '{"a":true,"b":false,"c":true}', "mixed booleans");
+
+# A handler for the class overrides it
+
+$jc->obj ('JSON::PP::Boolean' => sub { return '"yes"'; });
+is ($jc->create ($mixed), '{"a":"yes","b":false,"c":true}',
+    "handler overrides the built-in booleans");
+my $jcbool = JSON::Create->new ();
+$jcbool->bool ('JSON::PP::Boolean');
+is ($jcbool->create ([make_bool ('JSON::PP::Boolean', 0)]), '[false]',
+    "bool still works");
+
+# Other objects are unchanged
+
+is (create_json ([make_bool ('Some::Class', 1)]), '[1]',
+    "other classes are not booleans");
+
+# Perl's booleans
+
+SKIP: {
+    skip "Perl before 5.36 has no boolean scalars", 2 if $] < 5.036;
+    my $yes = (1 == 1);
+    my $no = (1 == 0);
+    is (create_json ([$yes, $no]), '[true,false]', "copies of Perl's booleans");
+    is (create_json ({x => !! 1}), '{"x":true}', "!! 1");
+};
+
+done_testing ();
@@ -0,0 +1,107 @@
+# Test the gzip option.
+
+use FindBin '$Bin';
+use lib "$Bin";
+use JCT;
+use File::Temp 'tempfile';
+
+if (! JSON::Create::gzip_available ()) {
+    plan skip_all => 'gzip is not available';
+}
+eval {
+    require IO::Uncompress::Gunzip;
+};
+if ($@) {
+    plan skip_all => 'IO::Uncompress::Gunzip is not available';
+}
+
+sub gunzip
+{
+    my ($gzipped) = @_;
+    my $json;
+    IO::Uncompress::Gunzip::gunzip (\$gzipped, \$json)
+	or die "gunzip failed";
+    return $json;
+}
+
+my $input = {a => [1, 2, 3], b => 'sister'};
+my $jc = JSON::Create->new (sort => 1);
+my $plain = $jc->create ($input);
+$jc->gzip (1);
+my $gzipped = $jc->create ($input);
+ok (length ($gzipped) > 0, "got compressed output");
+ok (! utf8::is_utf8 ($gzipped), "compressed output is bytes");
+is (gunzip ($gzipped), $plain, "uncompresses to the same JSON");
+
+# Output bigger than the buffer, with long strings which bypass it
+
+my @big;
+for my $i (0..20000) {
+    push @big, {n => $i, s => 'x' x ($i % 100)};
+}
+push @big, 'y' x 100000;
+$jc->gzip (0);
+my $bigplain = $jc->create (\@big);
+$jc->gzip (1);
+my $biggz = $jc->create (\@big);
+ok (length ($biggz) < length ($bigplain), "compressed output is smaller");
+ok (gunzip ($biggz) eq $bigplain, "big output uncompresses to the same JSON");
+
+# Unicode output is compressed as UTF-8
+
+my $uni = $jc->create (["\x{3042}"]);
+my $unijson = gunzip ($uni);
+utf8::decode ($unijson);
+is ($unijson, "[\"\x{3042}\"]", "character output is UTF-8");
+
+# create_json and write_json
+
+is (gunzip (create_json ($input, gzip => 1, sort => 1)), $plain,
+    "create_json with gzip");
+my ($fh, $file) = tempfile ("/tmp/json-create-gzip-XXXXXX");
+close $fh or die $!;
+write_json ($file, $input, gzip => 1, sort => 1);
+open my $in, "<:raw", $file or die $!;
+my $fromfile = do { local $/; <$in> };
+close $in or die $!;
+unlink $file;
+is (gunzip ($fromfile), $plain, "write_json with gzip");
+
+# Errors
+
+my $warning;
+$SIG{__WARN__} = sub { $warning = "@_"; };
+my $bad = $jc->create ([sub {}]);
+ok (! defined $bad, "error with gzip gives undef");
+ok ($warning, "got a warning");
+is (gunzip ($jc->create ($input)), $plain, "works again after error");
+
+# Invalid UTF-8 from a user routine is an error, as without gzip, and
+# valid UTF-8 split across pieces of the output is not.
+
+my $jcu = JSON::Create->new ();
+my $badjson = '"' . "\xff" . '"';
+my $goodjson = '"' . ("\xe3\x81\x82" x 3) . '"';
+$jcu->obj ('Bad' => sub { return $badjson; },
+	   'Good' => sub { return $goodjson; });
+SKIP: {
+    skip "JSON::Create::PP doesn't check user routines' UTF-8", 3
+	if $ENV{JSONCreatePP};
+    my $badinput = ["\x{3042}", bless {}, 'Bad'];
+    ok (! defined $jcu->create ($badinput), "invalid UTF-8 without gzip");
+    $warning = undef;
+    $jcu->gzip (1);
+    ok (! defined $jcu->create ($badinput), "invalid UTF-8 with gzip");
+    like ($warning, qr/Invalid UTF-8 from user routine/, "got a warning");
+};
+$jcu->gzip (1);
+my $goodinput = ["\x{3042}", map {bless {}, 'Good'} 1..10000];
+my $goodgz = $jcu->create ($goodinput);
+ok (defined $goodgz, "valid UTF-8 with gzip");
+$jcu->gzip (0);
+my $goodplain = $jcu->create ($goodinput);
+utf8::encode ($goodplain);
+ok (gunzip ($goodgz) eq $goodplain,
+    "valid UTF-8 uncompresses to the same JSON");
+
+done_testing ();
@@ -0,0 +1,71 @@
+# Test include_keys, exclude_keys and obj_keys, which choose the keys
+# of hashes to write.
+
+use FindBin '$Bin';
+use lib "$Bin";
+use JCT;
+
+my $row = {
+    id => 1,
+    name => 'Mimi',
+    password => 'secret',
+    internal => {password => 2, a => 3},
+};
+
+# exclude_keys
+
+my $jce = JSON::Create->new (sort => 1, exclude_keys => ['password']);
+is ($jce->create ($row), '{"id":1,"internal":{"a":3},"name":"Mimi"}',
+    "exclude_keys at every level");
+is ($jce->create ({password => 1}), '{}', "all keys excluded");
+$jce->exclude_keys ();
+like ($jce->create ($row), qr/secret/, "exclude_keys removed");
+
+# include_keys
+
+my $jci = JSON::Create->new ();
+$jci->include_keys (['name', 'id', 'not there']);
+is ($jci->create ([$row, {x => 1}]), '[{"name":"Mimi","id":1},{}]',
+    "include_keys in the order given");
+$jci->sort (1);
+is ($jci->create ($row), '{"id":1,"name":"Mimi"}', "include_keys with sort");
+my $jcb = JSON::Create->new (include_keys => ['id', 'password'],
+			     exclude_keys => ['password']);
+is ($jcb->create ($row), '{"id":1}', "exclude_keys beats include_keys");
+$jci->include_keys (undef);
+is ($jci->create ({b => 1, a => 2}), '{"a":2,"b":1}', "include_keys removed");
+
+# obj_keys
+
+my $jco = JSON::Create->new (sort => 1);
+$jco->obj_keys ('My::User' => ['id', 'name']);
+my $user = bless {%$row}, 'My::User';
+is ($jco->create ({user => $user, row => {id => 2, x => 3}}),
+    '{"row":{"id":2,"x":3},"user":{"id":1,"name":"Mimi"}}',
+    "obj_keys only applies to its class");
+$jco->include_keys (['id']);
+is ($jco->create ([$user, {id => 2, x => 3}]),
+    '[{"id":1,"name":"Mimi"},{"id":2}]', "obj_keys beats include_keys");
+$jco->obj_keys ('My::User' => undef);
+is ($jco->create ([$user]), '[{"id":1}]', "obj_keys removed");
+
+# The values of skipped keys are not looked at.
+
+my $jcs = JSON::Create->new (strict => 1, exclude_keys => ['code']);
+is ($jcs->create ({code => sub {}, ok => 1}), '{"ok":1}',
+    "excluded values are not checked");
+
+# Unicode keys
+
+my $jcu = JSON::Create->new (include_keys => ["\x{3042}"]);
+is ($jcu->create ({"\x{3042}" => 1, b => 2}), "{\"\x{3042}\":1}",
+    "Unicode key");
+
+# Errors
+
+my $warning;
+$SIG{__WARN__} = sub { $warning = "@_"; };
+$jcu->include_keys ('id');
+like ($warning, qr/array reference/, "warning for a non-array");
+
+done_testing ();
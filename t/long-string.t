@@ -0,0 +1,51 @@
+# Test strings which are longer than the buffer, or which have long
+# runs of bytes which need no escaping.
+
+use FindBin '$Bin';
+use lib "$Bin";
+use JCT;
+
+my $jc = JSON::Create->new ();
+
+for my $n (1, 63, 64, 65, 0x3fff, 0x4000, 0x4001, 100000) {
+    my $plain = 'a' x $n;
+    is ($jc->create ([$plain]), "[\"$plain\"]", "$n plain bytes");
+    is ($jc->create (["$plain\"$plain\n"]), "[\"$plain\\\"$plain\\n\"]",
+	"$n plain bytes with escapes");
+    my $utf8 = "\x{3042}" x $n;
+    is ($jc->create (["$plain$utf8/$plain"]), "[\"$plain$utf8/$plain\"]",
+	"$n plain bytes and characters");
+}
+
+my $long = 'b' x 1000;
+my $u2028 = "$long\x{2028}$long";
+is ($jc->create ([$u2028]), "[\"$long\\u2028$long\"]",
+    "U+2028 in a long run is escaped");
+$jc->escape_slash (1);
+is ($jc->create (["$long/$long"]), "[\"$long\\/$long\"]",
+    "slash in a long run is escaped");
+$jc->escape_slash (0);
+$jc->unicode_escape_all (1);
+my $e_acute = "$long\x{e9}$long";
+utf8::upgrade ($e_acute);
+is ($jc->create ([$e_acute]), "[\"$long\\u00e9$long\"]",
+    "non-ASCII in a long run is escaped");
+$jc->unicode_escape_all (0);
+
+# Invalid UTF-8 in the middle of a long run.
+
+my $bytes = "$long\xff$long";
+$jc->replace_bad_utf8 (1);
+my $out = $jc->create ([$bytes]);
+is ($out, "[\"$long\x{fffd}$long\"]", "bad UTF-8 in a long run is replaced");
+
+# Non-ASCII bytes in a long run in strict mode.
+
+my $strict = JSON::Create->new (strict => 1);
+my $warning;
+local $SIG{__WARN__} = sub { $warning = "@_"; };
+$out = $strict->create (["$long\xe9$long"]);
+ok (! defined $out, "non-ASCII byte in a long run fails in strict mode");
+like ($warning, qr/Non-ASCII byte/, "got a warning");
+
+done_testing ();
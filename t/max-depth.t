@@ -0,0 +1,97 @@
+# Test the nesting depth limit and the detection of circular
+# references.
+
+use FindBin '$Bin';
+use lib "$Bin";
+use JCT;
+
+my $nested = [[[1, {a => [2]}]]];
+my $jc = JSON::Create->new ();
+is ($jc->create ($nested), '[[[1,{"a":[2]}]]]', "no limit by default");
+$jc->max_depth (5);
+is ($jc->create ($nested), '[[[1,{"a":[2]}]]]', "within max_depth");
+$jc->max_depth (4);
+my $warning;
+$SIG{__WARN__} = sub { $warning = shift; };
+my $out = $jc->create ($nested);
+ok (! defined $out, "undef returned when too deep");
+like ($warning, qr!max_depth=4!, "got warning for too deep");
+$warning = undef;
+$out = create_json ({b => $nested}, max_depth => 4);
+ok (! defined $out, "max_depth option to create_json");
+like ($warning, qr!max_depth=4!, "got warning from create_json");
+
+# Circular references
+
+my $circle = {x => [1, 2]};
+push @{$circle->{x}}, $circle;
+$warning = undef;
+$out = create_json ($circle);
+ok (! defined $out, "undef returned for circular reference");
+like ($warning, qr!Circular reference!, "got warning for circular reference");
+$jc = JSON::Create->new (fatal_errors => 1);
+eval {
+    $jc->create ($circle);
+};
+like ($@, qr!Circular reference!, "circular reference error is fatal");
+# Break the circle so that the memory is freed.
+pop @{$circle->{x}};
+
+# The same container in two places is not a circle.
+$warning = undef;
+my $twice = [1];
+is (create_json ([$twice, {y => $twice}]), '[[1],{"y":[1]}]',
+    "repeated container is OK");
+ok (! $warning || $warning !~ /Circular/, "no false positive");
+
+# Circles are found as soon as they are entered, so max_depth is not
+# reached first.
+
+$jc = JSON::Create->new (max_depth => 1000);
+my $self = [];
+push @$self, $self;
+$warning = undef;
+ok (! defined $jc->create ($self), "array containing itself");
+like ($warning, qr!Circular reference!, "circle found before max_depth");
+pop @$self;
+
+# A circle which starts and ends deep down, and a container which
+# appears twice deep down without a circle.
+
+my $chain = [];
+my $link = $chain;
+my $middle;
+for my $i (1..40) {
+    my $next = [];
+    push @$link, $next;
+    $link = $next;
+    if ($i == 20) {
+	$middle = $link;
+    }
+}
+push @$link, $middle;
+$warning = undef;
+ok (! defined create_json ($chain), "deep circle");
+like ($warning, qr!Circular reference!, "got warning for deep circle");
+pop @$link;
+$warning = undef;
+is (create_json ([$chain, $chain]), ('[' x 42) . (']' x 41) . ',' .
+    ('[' x 41) . (']' x 42), "deep repeated container");
+ok (! $warning, "no false positive deep down");
+
+# Deeper nesting than the C stack could cope with.
+
+SKIP: {
+    if (! $JSON::Create::xsok) {
+	skip "Deep nesting is slow in the pure-Perl version", 1;
+    }
+    my $depth = 100_000;
+    my $deep = 1;
+    for (1..$depth) {
+	$deep = [$deep];
+    }
+    my $deepjson = create_json ($deep);
+    is ($deepjson, ('[' x $depth) . 1 . (']' x $depth), "very deep nesting");
+}
+
+done_testing ();
@@ -0,0 +1,71 @@
+# Test memoize_handlers, which calls the handler once for each object
+# in one call to create.
+
+use FindBin '$Bin';
+use lib "$Bin";
+use JCT;
+
+my $calls = 0;
+my $handler = sub {
+    my ($obj) = @_;
+    $calls++;
+    return '"' . $obj->{name} . '"';
+};
+my $a = bless {name => 'a'}, 'Some::Object';
+my $b = bless {name => 'b'}, 'Some::Object';
+my $input = [($a, $b) x 50, {x => $a}];
+my $expect = '[' . join (',', ('"a","b"') x 50) . ',{"x":"a"}]';
+
+my $jc = JSON::Create->new ();
+$jc->obj (
+    'Some::Object' => $handler,
+);
+is ($jc->create ($input), $expect, "output without memoize_handlers");
+is ($calls, 101, "handler called for every object");
+
+$calls = 0;
+$jc->memoize_handlers (1);
+is ($jc->create ($input), $expect, "same output with memoize_handlers");
+is ($calls, 2, "handler called once for each object");
+$calls = 0;
+$jc->create ($input);
+is ($calls, 2, "handler results are forgotten after each call");
+
+# obj_handler
+
+$calls = 0;
+my $jcobj = JSON::Create->new (memoize_handlers => 1);
+$jcobj->obj_handler ($handler);
+is ($jcobj->create ($input), $expect, "obj_handler output");
+is ($calls, 2, "obj_handler called once for each object");
+
+# Indentation is applied to the copies too
+
+my $multi = sub {
+    return "[\n\t1\n]\n";
+};
+my $jcindent = JSON::Create->new (indent => 1, memoize_handlers => 1,
+				  sort => 1);
+$jcindent->obj ('Some::Object' => $multi);
+my $memoized = $jcindent->create ({x => {y => $a}, z => $a});
+$jcindent->memoize_handlers (0);
+is ($memoized, $jcindent->create ({x => {y => $a}, z => $a}),
+    "indentation of memoized JSON");
+
+# Errors are not remembered
+
+$calls = 0;
+my $undef = sub {
+    $calls++;
+    return undef;
+};
+my $jcundef = JSON::Create->new (memoize_handlers => 1);
+$jcundef->obj ('Some::Object' => $undef);
+my $warning;
+$SIG{__WARN__} = sub { $warning = "@_"; };
+ok (! defined $jcundef->create ([$a, $a]), "undef from handler is an error");
+ok ($warning, "got a warning");
+ok (! defined $jcundef->create ([$a, $a]), "still an error next time");
+is ($calls, 2, "handler called again after an error");
+
+done_testing ();
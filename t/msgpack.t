@@ -0,0 +1,105 @@
+# Test the MessagePack output format.
+
+use FindBin '$Bin';
+use lib "$Bin";
+use JCT;
+use JSON::Create::Bool;
+
+if ($ENV{JSONCreatePP}) {
+    plan skip_all => 'MessagePack is not available in JSON::Create::PP';
+}
+
+my $jc = JSON::Create->new (format => 'msgpack', sort => 1);
+
+sub msgpack_is
+{
+    my ($input, $hex, $name) = @_;
+    my $msgpack = $jc->create ($input);
+    is (unpack ('H*', $msgpack), $hex, $name);
+}
+
+# Integers use the smallest form
+
+msgpack_is (0, '00', "zero");
+msgpack_is (127, '7f', "largest positive fixint");
+msgpack_is (128, 'cc80', "uint 8");
+msgpack_is (256, 'cd0100', "uint 16");
+msgpack_is (65536, 'ce00010000', "uint 32");
+msgpack_is (4294967296, 'cf0000000100000000', "uint 64");
+msgpack_is (18446744073709551615, 'cfffffffffffffffff', "largest unsigned");
+msgpack_is (-1, 'ff', "minus one");
+msgpack_is (-32, 'e0', "smallest negative fixint");
+msgpack_is (-33, 'd0df', "int 8");
+msgpack_is (-129, 'd1ff7f', "int 16");
+msgpack_is (-32769, 'd2ffff7fff', "int 32");
+msgpack_is (-2147483649, 'd3ffffffff7fffffff', "int 64");
+
+# Floats
+
+msgpack_is (1.5, 'ca3fc00000', "float 32");
+msgpack_is (1.1, 'cb3ff199999999999a', "float 64");
+my $inf = 9**9**9;
+msgpack_is ($inf, 'ca7f800000', "infinity");
+msgpack_is (-$inf, 'caff800000', "minus infinity");
+
+# Strings
+
+msgpack_is ('', 'a0', "empty string");
+msgpack_is ('a', 'a161', "fixstr");
+msgpack_is ('a' x 32, 'd920' . ('61' x 32), "str 8");
+msgpack_is ('a' x 256, 'da0100' . ('61' x 256), "str 16");
+msgpack_is ("\x{3042}", 'a3e38182', "character string");
+msgpack_is ("\xff\x00", 'c402ff00', "byte string is bin");
+
+# Literals
+
+msgpack_is (undef, 'c0', "undef is nil");
+msgpack_is (true, 'c3', "true");
+msgpack_is (false, 'c2', "false");
+my $yes = 1;
+my $jcbool = JSON::Create->new (format => 'msgpack');
+$jcbool->bool ('Some::Bool');
+is (unpack ('H*', $jcbool->create (bless \$yes, 'Some::Bool')), 'c3',
+    "bool handler");
+
+# The built-in "number" handler writes numbers, not strings
+
+use Math::BigInt;
+use Math::BigFloat;
+my $jcn = JSON::Create->new (format => 'msgpack');
+$jcn->obj ('Math::BigInt' => 'number', 'Math::BigFloat' => 'number');
+is (unpack ('H*', $jcn->create ([Math::BigInt->new (5)])), '9105',
+    "Math::BigInt");
+is (unpack ('H*', $jcn->create ([Math::BigInt->new (-200)])), '91d1ff38',
+    "negative Math::BigInt");
+is (unpack ('H*', $jcn->create ([Math::BigFloat->new ('1.5')])),
+    '91ca3fc00000', "Math::BigFloat");
+is (unpack ('H*', $jcn->create ([Math::BigInt->new ('1' . '0' x 20)])),
+    '91cb4415af1d78b58c40', "too big for 64 bits is a float");
+
+# Arrays and hashes
+
+msgpack_is ([], '90', "empty array");
+msgpack_is ([1, 2, 3], '93010203', "fixarray");
+msgpack_is ([(1) x 16], 'dc0010' . ('01' x 16), "array 16");
+msgpack_is ({}, '80', "empty hash");
+msgpack_is ({a => 1, b => [2, 3]}, '82a16101a162920203', "fixmap");
+my %big = map {sprintf ("%02d", $_) => 0} 1..16;
+like (unpack ('H*', $jc->create (\%big)), qr/^de0010a23031/, "map 16");
+
+# Output is bytes
+
+ok (! utf8::is_utf8 ($jc->create (["\x{3042}"])), "output is bytes");
+
+# The chunk-at-a-time encoder
+
+my $input = [map {{n => $_, s => 'x' x ($_ % 50)}} 0..5000];
+my $whole = $jc->create ($input);
+my $enc = $jc->encoder ($input);
+my $chunks = '';
+while (defined (my $chunk = $enc->next_chunk (1000))) {
+    $chunks .= $chunk;
+}
+ok ($chunks eq $whole, "encoder gives the same MessagePack");
+
+done_testing ();
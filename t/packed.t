@@ -0,0 +1,60 @@
+# Test JSON::Create::Packed.
+
+use FindBin '$Bin';
+use lib "$Bin";
+use JCT;
+use JSON::Create::Packed;
+
+my @doubles = (1.25, -2.5, 100, 0.1);
+my $doubles = JSON::Create::Packed->doubles (pack ('d*', @doubles));
+is (create_json ($doubles), create_json (\@doubles), "doubles");
+is_deeply ([$doubles->numbers ()], \@doubles, "numbers method");
+is (create_json ({a => JSON::Create::Packed->floats (pack ('f*', 0.5, -3))}),
+    '{"a":[0.5,-3]}', "floats");
+is (create_json (JSON::Create::Packed->int32 (pack ('l*', 1, -2147483648))),
+    '[1,-2147483648]', "int32");
+is (create_json (JSON::Create::Packed->uint32 (pack ('L*', 4294967295))),
+    '[4294967295]', "uint32");
+SKIP: {
+    skip "No 64-bit integers", 2 unless eval { pack ('q', 1) };
+    skip "JSON::Create::PP writes big integers as floats", 2
+	if $ENV{JSONCreatePP};
+    my $int64 = pack ('q*', -9007199254740993, 42);
+    is (create_json ([JSON::Create::Packed->int64 ($int64)]),
+	'[[-9007199254740993,42]]', "int64");
+    my $uint64 = pack ('Q', 18446744073709551615);
+    is (create_json (JSON::Create::Packed->uint64 ($uint64)),
+	'[18446744073709551615]', "uint64");
+};
+is (create_json (JSON::Create::Packed->doubles ('')), '[]', "empty");
+
+# Options which apply to arrays and numbers
+
+my $jcs = JSON::Create->new (strict => 1);
+is ($jcs->create ([$doubles]), '[[1.25,-2.5,100,0.1]]', "strict mode");
+my $jci = JSON::Create->new (indent => 1);
+my $ints = JSON::Create::Packed->int32 (pack ('l*', 1, 2));
+is ($jci->create ({a => $ints}), $jci->create ({a => [1, 2]}), "indent");
+my $jcf = JSON::Create->new ();
+$jcf->set_fformat ('%.2f');
+is ($jcf->create ($doubles), '[1.25,-2.50,100.00,0.10]', "set_fformat");
+
+# Non-finite numbers
+
+my $inf = JSON::Create::Packed->doubles (pack ('d', 9**9**9));
+my $warning;
+$SIG{__WARN__} = sub { $warning = "@_"; };
+ok (! defined $jcs->create ($inf), "infinity fails in strict mode");
+like ($warning, qr/non-finite/i, "got a warning");
+my $jcn = JSON::Create->new ();
+$jcn->non_finite_handler (sub { return 'null'; });
+is ($jcn->create ($inf), '[null]', "non_finite_handler");
+
+# Errors
+
+eval {
+    JSON::Create::Packed->doubles ('abc');
+};
+like ($@, qr/multiple of 8/, "bad length");
+
+done_testing ();
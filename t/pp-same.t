@@ -0,0 +1,77 @@
+# Check that JSON::Create::PP makes the same JSON as the XS version
+# for strings, integers, and containers under the escaping options.
+
+use FindBin '$Bin';
+use lib "$Bin";
+use JCT;
+use JSON::Create::PP;
+
+if ($ENV{JSONCreatePP}) {
+    plan skip_all => 'The XS version is switched off';
+}
+
+my @inputs = (
+    'plain',
+    "quo\"te and back\\slash",
+    'a/b/c',
+    "\x00\x01\x08\t\n\f\r\x1f\x7f",
+    "\x{2028} and \x{2029}",
+    "caf\x{e9}\x{100}",
+    "\x{3042}\x{1F600}",
+    "<a href='x'>&amp;</a>",
+    # UTF-8 bytes of U+3042 and U+2028.
+    "\xe3\x81\x82 \xe2\x80\xa8",
+    0, 1, -1, 99, 1000000, -123456789,
+    '007', '', undef,
+    [1, 'two', [3, {four => 4}]],
+    {"key\n" => ["value\"", {'a/b' => "\x{3000}"}]},
+    [[], {}, [{}], {a => []}],
+);
+my @options = (
+    [],
+    [indent => 1],
+    [escape_slash => 1],
+    [no_javascript_safe => 1],
+    [unicode_escape_all => 1],
+    [unicode_escape_all => 1, unicode_upper => 1],
+    [unicode_escape_all => 1, no_javascript_safe => 1, escape_slash => 1],
+    [escape_chars => q{<>&'}],
+    [escape_chars => q{<>&'/"}, escape_slash => 1, unicode_upper => 1],
+    [escape_non_bmp => 1],
+);
+for my $options (@options) {
+    my $xs = JSON::Create->new (@$options, sort => 1);
+    my $pp = JSON::Create::PP->new ();
+    $pp->set (@$options, sort => 1);
+    for my $input (@inputs) {
+	is ($pp->create ($input), $xs->create ($input),
+	    "same output with @$options");
+    }
+}
+
+# Circular references and max_depth give the same errors
+
+my $circle = [];
+push @$circle, [$circle];
+my $warning;
+$SIG{__WARN__} = sub { $warning = "@_"; $warning =~ s/ at .* line .*//s; };
+for my $max_depth (0, 1, 10, 64, 100) {
+    my $xs = JSON::Create->new (max_depth => $max_depth);
+    my $pp = JSON::Create::PP->new ();
+    $pp->set (max_depth => $max_depth);
+    $xs->create ($circle);
+    my $xs_warning = $warning;
+    $pp->create ($circle);
+    is ($warning, $xs_warning,
+	"same error for a circle with max_depth=$max_depth");
+}
+delete $SIG{__WARN__};
+
+# Changing an option after making JSON changes the output
+
+my $pp = JSON::Create::PP->new ();
+is ($pp->create (['a/b']), '["a/b"]', "no slash escape");
+$pp->escape_slash (1);
+is ($pp->create (['a/b']), '["a\/b"]', "slash escape after changing option");
+
+done_testing ();
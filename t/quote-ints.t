@@ -0,0 +1,49 @@
+# Test quote_big_ints and quote_ints, which write integers as strings
+# for JavaScript.
+
+use FindBin '$Bin';
+use lib "$Bin";
+use JCT;
+
+my $jc = JSON::Create->new (quote_big_ints => 1);
+is ($jc->create ([9007199254740991, -9007199254740991]),
+    '[9007199254740991,-9007199254740991]', "safe integers are numbers");
+is ($jc->create ([9007199254740992, -9007199254740992]),
+    '["9007199254740992","-9007199254740992"]',
+    "2**53 and -2**53 are strings");
+is ($jc->create ({id => 1234567890123456789}), '{"id":"1234567890123456789"}',
+    "64-bit ID");
+SKIP: {
+    skip "No 64-bit integers", 2 unless eval { pack ('q', 1) };
+    is ($jc->create ([18446744073709551615]), '["18446744073709551615"]',
+	"largest unsigned integer");
+    is ($jc->create ([-9223372036854775807 - 1]),
+	'["-9223372036854775808"]', "most negative integer");
+};
+is ($jc->create ([1.5, 1e20, '12345678901234567890']),
+    '[1.5,1e+20,"12345678901234567890"]',
+    "floating point numbers and strings are unchanged");
+
+# Integers from the built-in "number" handler
+
+use Math::BigInt;
+use Math::BigFloat;
+$jc->obj ('Math::BigInt' => 'number', 'Math::BigFloat' => 'number');
+is ($jc->create ([map {Math::BigInt->new ($_)}
+		  ('9007199254740991', '-9007199254740992',
+		   '123456789012345678901234567890')]),
+    '[9007199254740991,"-9007199254740992","123456789012345678901234567890"]',
+    "Math::BigInt");
+is ($jc->create ([Math::BigFloat->new ('12345678901234567890.5')]),
+    '[12345678901234567890.5]', "Math::BigFloat is not quoted");
+
+my $jcq = JSON::Create->new (quote_ints => 1);
+is ($jcq->create ([0, 42, -7, 1.5]), '["0","42","-7",1.5]',
+    "quote_ints quotes all integers");
+$jcq->obj ('Math::BigInt' => 'number');
+is ($jcq->create ([Math::BigInt->new (42)]), '["42"]',
+    "quote_ints with Math::BigInt");
+$jcq->quote_ints (0);
+is ($jcq->create ([42]), '[42]', "quote_ints switched off");
+
+done_testing ();
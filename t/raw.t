@@ -0,0 +1,51 @@
+# Test JSON::Create::Raw.
+
+use FindBin '$Bin';
+use lib "$Bin";
+use JCT;
+use JSON::Create::Raw;
+
+my $frag = '{"b":[1,2,3]}';
+my $raw = JSON::Create::Raw->new ($frag);
+is ($raw->json (), $frag, "json method");
+is (create_json ({a => $raw}), '{"a":{"b":[1,2,3]}}', "raw JSON in hash");
+is (create_json ([$raw, $raw]), '[{"b":[1,2,3]},{"b":[1,2,3]}]',
+    "raw JSON in array");
+is (create_json ($raw), $frag, "raw JSON at top level");
+
+# Works in strict mode without any handlers.
+
+my $jcs = JSON::Create->new (strict => 1);
+is ($jcs->create ([$raw]), "[$frag]", "raw JSON with strict");
+
+# Indentation of multi-line JSON
+
+my $jci = JSON::Create->new (indent => 1);
+my $multi = JSON::Create::Raw->new ("{\n\t\"b\":1\n}\n");
+is ($jci->create ({a => $multi}), "{\n\t\"a\":{\n\t\t\"b\":1\n\t}\n}\n",
+    "raw JSON is indented");
+
+# Validation, and trust
+
+my $bad = JSON::Create::Raw->new ('{"b":');
+my $trusted = JSON::Create::Raw->new ('{"b":', trust => 1);
+my $jcv = JSON::Create->new ();
+$jcv->validate (1);
+my $warning;
+$SIG{__WARN__} = sub { $warning = "@_"; };
+my $out = $jcv->create ([$bad]);
+ok (! defined $out, "invalid raw JSON fails with validate");
+ok ($warning, "got a warning for invalid raw JSON");
+$warning = undef;
+is ($jcv->create ([$trusted]), '[{"b":]', "trusted raw JSON not validated");
+ok (! $warning, "no warning with trusted raw JSON");
+is ($jcv->create ([$raw]), "[$frag]", "valid raw JSON passes validate");
+
+# Character strings upgrade the output.
+
+my $chars = JSON::Create::Raw->new ("\"\x{3042}\"");
+my $cout = create_json ([$chars]);
+ok (utf8::is_utf8 ($cout), "character raw JSON gives character output");
+is ($cout, "[\"\x{3042}\"]", "character raw JSON output");
+
+done_testing ();
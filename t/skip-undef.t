@@ -0,0 +1,49 @@
+# Test skip_undef, which leaves out the keys of hashes whose values
+# are undefined.
+
+use FindBin '$Bin';
+use lib "$Bin";
+use JCT;
+
+my $jc = JSON::Create->new (sort => 1, skip_undef => 1);
+my $record = {
+    a => 1,
+    b => undef,
+    c => {d => undef, e => [undef, 2]},
+    f => undef,
+};
+is ($jc->create ($record), '{"a":1,"c":{"e":[null,2]}}',
+    "undefined values are left out, but not in arrays");
+is ($jc->create ({x => undef}), '{}', "all values undefined");
+is ($jc->create ([{x => undef}, {}]), '[{},{}]', "empty hashes");
+
+# Options which write hashes differently
+
+my $jci = JSON::Create->new (indent => 1, sort => 1, skip_undef => 1);
+is ($jci->create ({a => undef, b => {c => undef}, d => 1}),
+    "{\n\t\"b\":{},\n\t\"d\":1\n}\n", "indent");
+my $jcu = JSON::Create->new (skip_undef => 1);
+is ($jcu->create ({a => undef, b => 2}), '{"b":2}', "without sort");
+is ($jcu->create ({a => undef}), '{}', "all values undefined without sort");
+my $jciu = JSON::Create->new (indent => 1, skip_undef => 1);
+is ($jciu->create ([{a => undef}]), "[\n\t{}\n]\n",
+    "all values undefined with indent");
+my $jct = JSON::Create->new (skip_undef => 1, sort => 1, truncate => 1,
+			     max_output_bytes => 12);
+is ($jct->create ([{a => undef, b => 'x' x 20, c => undef}]),
+    '[{"b":"x..."}]', "no marker for undefined values left out");
+my $jck = JSON::Create->new (skip_undef => 1, include_keys => ['b', 'a']);
+is ($jck->create ({a => undef, b => 2, c => 3}), '{"b":2}', "include_keys");
+SKIP: {
+    skip "CBOR is not available in JSON::Create::PP", 1 if $ENV{JSONCreatePP};
+    my $jcc = JSON::Create->new (skip_undef => 1, format => 'cbor');
+    is (unpack ('H*', $jcc->create ({a => undef, b => 2})), 'a1616202',
+	"CBOR map length");
+};
+
+# Switching it off
+
+$jc->skip_undef (0);
+is ($jc->create ({a => undef}), '{"a":null}', "skip_undef switched off");
+
+done_testing ();
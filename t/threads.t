@@ -0,0 +1,63 @@
+# Test that JSON::Create objects work in threads made after them.
+
+use Config;
+BEGIN {
+    if (! $Config{useithreads}) {
+	print "1..0 # SKIP Perl was built without threads\n";
+	exit;
+    }
+}
+use threads;
+use FindBin '$Bin';
+use lib "$Bin";
+use JCT;
+use JSON::Create::Writer;
+
+if ($ENV{JSONCreatePP}) {
+    plan skip_all => 'JSON::Create::PP is a plain hash';
+}
+
+my $jc = JSON::Create->new (sort => 1, indent => 0);
+$jc->set_fformat ('%.2f');
+$jc->obj_handler (sub { return '"object"'; });
+$jc->cmp (sub { $_[1] cmp $_[0] });
+my $input = {a => 1.5, b => bless ({}, 'Some::Object'), c => [1, 2]};
+my $expect = $jc->create ($input);
+is ($expect, '{"c":[1,2],"b":"object","a":1.50}', "output before threads");
+
+# Each thread gets its own copy of the options, including the
+# handlers.
+
+my @threads = map {
+    threads->create (sub {
+	my $out = $jc->create ($input);
+	$jc->set_fformat ('%.1f');
+	$jc->obj_handler (sub { return '"changed"'; });
+	return $out . $jc->create ($input);
+    });
+} 1..4;
+for my $thread (@threads) {
+    is ($thread->join (), $expect . '{"c":[1,2],"b":"changed","a":1.5}',
+	"thread used and changed its own copy");
+}
+is ($jc->create ($input), $expect, "changes in threads don't affect the parent");
+
+# The cache is not copied into threads.
+
+my $cached = JSON::Create->new (cache_readonly => 1);
+my $ro = [1, 2, 3];
+Internals::SvREADONLY (@$ro, 1);
+is ($cached->create ($ro), '[1,2,3]', "cached output");
+my $thread = threads->create (sub { return $cached->create ($ro); });
+is ($thread->join (), '[1,2,3]', "same output in a thread");
+
+# Writers are not copied into threads.
+
+my $w = JSON::Create::Writer->new ();
+$thread = threads->create (sub { return defined $$w ? 1 : 0; });
+is ($thread->join (), 0, "writer is undefined in a thread");
+$w->start_array ();
+$w->end ();
+is ($w->output (), '[]', "writer still works in the parent");
+
+done_testing ();
@@ -0,0 +1,99 @@
+# Test max_array_items, max_string_bytes, max_output_bytes and
+# truncate, which keep the output down to a known size.
+
+use FindBin '$Bin';
+use lib "$Bin";
+use JCT;
+use JSON::Create::Packed;
+use JSON::Create::Raw;
+
+my $warning;
+$SIG{__WARN__} = sub { $warning = "@_"; };
+
+# Without truncate, the limits are errors.
+
+my $jca = JSON::Create->new (max_array_items => 2);
+is ($jca->create ([1, 2]), '[1,2]', "array within max_array_items");
+ok (! defined $jca->create ([1, [2, 3, 4]]), "array too long");
+like ($warning, qr/max_array_items=2/, "got a warning");
+my $jcs = JSON::Create->new (max_string_bytes => 3);
+is ($jcs->create (['abc']), '["abc"]', "string within max_string_bytes");
+ok (! defined $jcs->create ({a => 'abcd'}), "string too long");
+like ($warning, qr/max_string_bytes=3/, "got a warning");
+my $jco = JSON::Create->new (max_output_bytes => 10);
+is ($jco->create ([1, 2, 3]), '[1,2,3]', "output within max_output_bytes");
+ok (! defined $jco->create ([1..100]), "output too long");
+like ($warning, qr/max_output_bytes=10/, "got a warning");
+
+# With truncate, the marker goes in place of what is left out.
+
+my $jc = JSON::Create->new (sort => 1, truncate => 1, max_depth => 2,
+			    max_array_items => 2, max_string_bytes => 5);
+is ($jc->create ({a => [1, 2, 3], b => [1, 2], c => 'abcdefgh', d => 'abc'}),
+    '{"a":[1,2,"..."],"b":[1,2],"c":"abcde...","d":"abc"}',
+    "long arrays and strings");
+is ($jc->create ([[[1]], [{}]]), '[["..."],["..."]]', "max_depth");
+is ($jc->create (["\x{3042}\x{3044}\x{3046}"]), "[\"\x{3042}...\"]",
+    "strings are cut between characters");
+my $bytes = "\xE3\x81\x82\xE3\x81\x84";
+is ($jc->create ([$bytes]), "[\"\xE3\x81\x82...\"]", "UTF-8 bytes");
+is ($jc->create ({abcdefgh => 1}), '{"abcdefgh":1}', "keys are not cut");
+
+my $jct = JSON::Create->new (sort => 1, truncate => 1,
+			     max_output_bytes => 20);
+is ($jct->create ([map {"x$_"} 1..100]),
+    '["x1","x2","x3","x4","..."]', "array cut short");
+is ($jct->create ({a => [1..100], b => {c => 1}}),
+    '{"a":[1,2,3,4,5,6,7,8,"..."],"...":"..."}', "hash cut short");
+is ($jct->create ([1, 2]), '[1,2]', "short output is unchanged");
+
+# Long values are cut short or left out rather than written whole.
+
+my $huge = $jct->create (['x' x 1_000_000]);
+is ($huge, '["' . ('x' x 14) . '..."]', "huge string cut short");
+is ($jct->create ({a => 'x' x 100, b => 1}),
+    '{"a":"' . ('x' x 10) . '..."' . ',"...":"..."}', "string in a hash");
+is ($jct->create ([1, "\x{3042}" x 100]), "[1,\"\x{3042}\x{3042}...\"]",
+    "cut between characters");
+is ($jct->create ([1, '"' x 100]), '[1,"\"\"\"\"\"\"..."]',
+    "escapes are counted");
+is ($jct->create ({'k' x 100 => 1}), '{"...":"..."}', "long key");
+is ($jct->create ([1, JSON::Create::Raw->new ('"' . ('y' x 100) . '"'), 2]),
+    '[1,"..."]', "raw JSON which doesn't fit is left out");
+my $packed = JSON::Create::Packed->int32 (pack ('l*', 1..1000));
+is ($jct->create ($packed), '[1,2,3,4,5,6,7,8,9,10,"..."]',
+    "packed array cut short");
+is ($jct->create ([[1, 2], $packed]), '[[1,2],[1,2,3,4,5,6,7,"..."]]',
+    "packed array inside an array");
+my $jcp = JSON::Create->new (truncate => 1, max_array_items => 2);
+is ($jcp->create (JSON::Create::Packed->int32 (pack ('l*', 1..10))),
+    '[1,2,"..."]', "max_array_items with a packed array");
+$jcp->truncate (0);
+ok (! defined $jcp->create (JSON::Create::Packed->int32 (pack ('l*', 1..10))),
+    "packed array too long");
+like ($warning, qr/max_array_items=2/, "got a warning");
+my $jcx = JSON::Create->new (max_output_bytes => 20);
+ok (! defined $jcx->create (['x' x 1_000_000]), "huge string is an error");
+like ($warning, qr/max_output_bytes=20/, "got a warning");
+$jct->indent (1);
+is ($jct->create ({a => [1..100]}),
+    "{\n\t\"a\":[\n\t\t1,\n\t\t2,\n\t\t3,\n\t\t\"...\"\n\t]\n}\n", "indent");
+
+SKIP: {
+    skip "CBOR is not available in JSON::Create::PP", 2 if $ENV{JSONCreatePP};
+    my $jcc = JSON::Create->new (format => 'cbor', truncate => 1,
+				 max_array_items => 1);
+    is (unpack ('H*', $jcc->create ([1, 2])), '8201632e2e2e',
+	"CBOR array cut short");
+    $jcc->max_array_items (0);
+    $jcc->max_output_bytes (10);
+    ok (! defined $jcc->create ([1..100]),
+	"max_output_bytes is an error for CBOR");
+};
+
+# Switching it off
+
+$jc->truncate (0);
+ok (! defined $jc->create ([1, 2, 3]), "truncate switched off");
+
+done_testing ();
@@ -0,0 +1,109 @@
+# Test JSON::Create::Writer.
+
+use FindBin '$Bin';
+use lib "$Bin";
+use JCT;
+use JSON::Create::Writer;
+use File::Temp 'tempfile';
+
+my $w = JSON::Create::Writer->new ();
+$w->start_object ();
+$w->key ('a');
+$w->number (1);
+$w->key ('b');
+$w->start_array ();
+$w->string ('x"y');
+$w->number (-2);
+$w->bool (1);
+$w->bool (0);
+$w->null ();
+$w->string (3);
+$w->end ();
+$w->key ('c');
+$w->value ({d => [1, 2]});
+$w->end ();
+is ($w->output (), '{"a":1,"b":["x\"y",-2,true,false,null,"3"],"c":{"d":[1,2]}}',
+    "writer output");
+is ($w->output (), '', "output is removed by output");
+
+# Same output as create with indentation
+
+my $thing = {a => [1, {}, []], b => {c => 'd'}};
+my $jc = JSON::Create->new (indent => 1, sort => 1);
+$w = JSON::Create::Writer->new (indent => 1);
+$w->start_object ();
+$w->key ('a');
+$w->start_array ();
+$w->number (1);
+$w->start_object ();
+$w->end ();
+$w->start_array ();
+$w->end ();
+$w->end ();
+$w->key ('b');
+$w->start_object ();
+$w->key ('c');
+$w->string ('d');
+$w->end ();
+$w->end ();
+is ($w->output (), $jc->create ($thing), "same indentation as create");
+
+# Unicode output is bytes
+
+$w = JSON::Create::Writer->new ();
+$w->string ('ばか');
+my $out = $w->output ();
+ok (! utf8::is_utf8 ($out), "output is not a character string");
+no utf8;
+is ($out, '"ばか"', "UTF-8 bytes");
+use utf8;
+
+# Structural errors
+
+my @errors = (
+    [sub {$_[0]->key ('a')}, qr!key outside an object!],
+    [sub {$_[0]->end ()}, qr!end without a start!],
+    [sub {$_[0]->start_object (); $_[0]->number (1)},
+     qr!value in an object without a key!],
+    [sub {$_[0]->start_object (); $_[0]->key ('a'); $_[0]->key ('b')},
+     qr!key after a key!],
+    [sub {$_[0]->start_object (); $_[0]->key ('a'); $_[0]->end ()},
+     qr!end after a key!],
+    [sub {$_[0]->null (); $_[0]->null ()}, qr!more than one value!],
+    [sub {$_[0]->number ('monkey')}, qr!not a number!],
+);
+for my $error (@errors) {
+    my ($code, $re) = @$error;
+    my $ew = JSON::Create::Writer->new ();
+    eval {
+	&$code ($ew);
+    };
+    like ($@, $re, "got error $re");
+}
+
+# Printing to a filehandle
+
+my ($fh, $file) = tempfile ();
+binmode $fh, ':raw';
+$w = JSON::Create::Writer->new (fh => $fh);
+$w->start_array ();
+my $n = 10000;
+for my $i (1..$n) {
+    $w->start_object ();
+    $w->key ('i');
+    $w->number ($i);
+    $w->end ();
+}
+$w->end ();
+ok (tell ($fh) > 0, "output printed as it went");
+$w->flush ();
+close $fh or die $!;
+open my $in, '<:raw', $file or die $!;
+my $json = do { local $/; <$in> };
+close $in or die $!;
+unlink $file;
+my $expect = '[' . join (',', map {"{\"i\":$_}"} 1..$n) . ']';
+ok ($json eq $expect, "output to filehandle");
+is (length ($json), length ($expect), "length of output to filehandle");
+
+done_testing ();
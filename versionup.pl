@@ -16,7 +16,12 @@ my $newversion = '0.36';
 my @pmfiles = qw!
     lib/JSON/Create.pm
     lib/JSON/Create/Bool.pm
+    lib/JSON/Create/Cached.pm
+    lib/JSON/Create/Encoder.pm
+    lib/JSON/Create/Packed.pm
     lib/JSON/Create/PP.pm
+    lib/JSON/Create/Raw.pm
+    lib/JSON/Create/Writer.pm
 !;
 
 for my $file (@pmfiles) {
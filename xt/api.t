@@ -0,0 +1,136 @@
+# Build a small XS module which uses the C interface of JSON::Create
+# in "lib/JSON/Create/json-create-api.h", and test it. This needs
+# JSON::Create to have been built in "blib".
+
+use warnings;
+use strict;
+use utf8;
+use FindBin '$Bin';
+use Test::More;
+use File::Temp 'tempdir';
+use File::Path 'make_path';
+use ExtUtils::ParseXS;
+use ExtUtils::CBuilder;
+use Config;
+use lib "$Bin/../blib/lib", "$Bin/../blib/arch";
+use JSON::Create;
+use JSON::Create::Writer;
+my $builder = Test::More->builder;
+binmode $builder->output,         ":utf8";
+binmode $builder->failure_output, ":utf8";
+binmode $builder->todo_output,    ":utf8";
+
+my $dir = tempdir (CLEANUP => 1);
+my $xs = "$dir/APITest.xs";
+open my $out, ">", $xs or die $!;
+print $out <<'EOF';
+#include "EXTERN.h"
+#include "perl.h"
+#include "XSUB.h"
+#include "json-create-api.h"
+
+static json_create_api_t * api;
+
+MODULE=APITest PACKAGE=APITest
+
+PROTOTYPES: DISABLE
+
+BOOT:
+	api = json_create_api_fetch (aTHX_ JSON_CREATE_API_VERSION);
+	if (! api) {
+	    croak ("No JSON::Create API");
+	}
+
+SV *
+encode (jcsv, input)
+	SV * jcsv;
+	SV * input;
+CODE:
+	RETVAL = api->encode_sv (aTHX_ api->jc_from_sv (aTHX_ jcsv), input, 0);
+OUTPUT:
+	RETVAL
+
+SV *
+encode_default (input)
+	SV * input;
+PREINIT:
+	struct json_create * jc;
+CODE:
+	jc = api->jc_new (aTHX);
+	api->jc_set (aTHX_ jc, sv_2mortal (newSVpvs ("sort")), & PL_sv_yes);
+	RETVAL = api->encode_sv (aTHX_ jc, input, 0);
+	api->jc_free (aTHX_ jc);
+OUTPUT:
+	RETVAL
+
+SV *
+escape (jcsv, string)
+	SV * jcsv;
+	SV * string;
+PREINIT:
+	const char * s;
+	STRLEN len;
+CODE:
+	s = SvPV (string, len);
+	RETVAL = newSVpvs ("x=");
+	api->escape (aTHX_ api->jc_from_sv (aTHX_ jcsv), RETVAL, s, len,
+		     SvUTF8 (string));
+OUTPUT:
+	RETVAL
+
+void
+write (wsv)
+	SV * wsv;
+PREINIT:
+	struct json_create_writer * w;
+CODE:
+	w = api->writer_from_sv (aTHX_ wsv);
+	api->writer_start_object (aTHX_ w);
+	api->writer_key (aTHX_ w, "a/b", 3, 0);
+	api->writer_start_array (aTHX_ w);
+	api->writer_string (aTHX_ w, "\xe3\x81\x82", 3, 1);
+	api->writer_number (aTHX_ w, sv_2mortal (newSViv (-7)));
+	api->writer_bool (aTHX_ w, 1);
+	api->writer_null (aTHX_ w);
+	api->writer_value (aTHX_ w, sv_2mortal (newRV_noinc ((SV *) newAV ())));
+	api->writer_end (aTHX_ w);
+	api->writer_end (aTHX_ w);
+EOF
+close $out or die $!;
+my $c = "$dir/APITest.c";
+ExtUtils::ParseXS->new->process_file (filename => $xs, output => $c);
+my $cb = ExtUtils::CBuilder->new (quiet => 1);
+my $obj = $cb->compile (
+    source => $c,
+    include_dirs => ["$Bin/../lib/JSON/Create"],
+);
+my $auto = "$dir/auto/APITest";
+make_path ($auto);
+my $lib = $cb->link (
+    objects => [$obj],
+    module_name => 'APITest',
+    lib_file => "$auto/APITest.$Config{dlext}",
+);
+ok (-f $lib, "built the test module");
+unshift @INC, $dir;
+package APITest {
+    require XSLoader;
+    XSLoader::load ('APITest');
+}
+
+my $jc = JSON::Create->new (sort => 1, escape_slash => 1);
+my $input = {b => [1, 2.5, "\x{3042}"], a => undef};
+is (APITest::encode ($jc, $input), $jc->create ($input),
+    "encode_sv gives the same as create");
+is (APITest::encode_default ({b => 1, a => 2}), '{"a":2,"b":1}',
+    "jc_new and jc_set");
+is (APITest::escape ($jc, "a/\"\n"), 'x="a\/\"\n"',
+    "escape appends with the options of the object");
+my $w = JSON::Create::Writer->new ();
+APITest::write ($w);
+is ($w->output (), "{\"a/b\":[\"\xe3\x81\x82\",-7,true,null,[]]}", "writer");
+eval {
+    APITest::encode ([], 1);
+};
+like ($@, qr/not a JSON::Create object/, "croak on wrong object");
+done_testing ();
@@ -15,8 +15,23 @@ binmode STDERR, ":encoding(utf8)";
 use JSON::Create;
 use JSON::Create::PP;
 use JSON::Create::Bool;
+use JSON::Create::Cached;
+use JSON::Create::Encoder;
+use JSON::Create::Packed;
+use JSON::Create::Raw;
+use JSON::Create::Writer;
 cmp_ok ($JSON::Create::VERSION, 'eq', $JSON::Create::PP::VERSION,
     "Version numbers same");
 cmp_ok ($JSON::Create::VERSION, 'eq', $JSON::Create::Bool::VERSION,
     "Bool version numbers same");
+cmp_ok ($JSON::Create::VERSION, 'eq', $JSON::Create::Cached::VERSION,
+    "Cached version numbers same");
+cmp_ok ($JSON::Create::VERSION, 'eq', $JSON::Create::Encoder::VERSION,
+    "Encoder version numbers same");
+cmp_ok ($JSON::Create::VERSION, 'eq', $JSON::Create::Packed::VERSION,
+    "Packed version numbers same");
+cmp_ok ($JSON::Create::VERSION, 'eq', $JSON::Create::Raw::VERSION,
+    "Raw version numbers same");
+cmp_ok ($JSON::Create::VERSION, 'eq', $JSON::Create::Writer::VERSION,
+    "Writer version numbers same");
 done_testing ();
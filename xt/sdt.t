@@ -0,0 +1,38 @@
+# Check that the static probes are in the built module when
+# Makefile.PL found <sys/sdt.h>. This needs JSON::Create to have been
+# built in "blib", and readelf.
+
+use warnings;
+use strict;
+use utf8;
+use FindBin '$Bin';
+use Test::More;
+use Config;
+my $builder = Test::More->builder;
+binmode $builder->output,         ":utf8";
+binmode $builder->failure_output, ":utf8";
+binmode $builder->todo_output,    ":utf8";
+binmode STDOUT, ":encoding(utf8)";
+binmode STDERR, ":encoding(utf8)";
+
+my $makefile = "$Bin/../Makefile";
+open my $in, "<", $makefile or plan skip_all => "No Makefile";
+my $have_sdt = grep /-DHAVE_SDT/, <$in>;
+close $in or die $!;
+if (! $have_sdt) {
+    plan skip_all => "Not built with sys/sdt.h";
+}
+my $so = "$Bin/../blib/arch/auto/JSON/Create/Create.$Config{dlext}";
+my $notes = `readelf -n $so 2>&1`;
+if ($? != 0) {
+    plan skip_all => "readelf failed";
+}
+my %probes;
+while ($notes =~ /Provider:\s*(\S+)\s*Name:\s*(\S+)/g) {
+    $probes{$2}++ if $1 eq 'json_create';
+}
+for my $probe (qw/create__start create__done flush handler__start
+		  handler__done sort__start sort__done error/) {
+    ok ($probes{$probe}, "probe $probe");
+}
+done_testing ();
@@ -0,0 +1,291 @@
+/* Test the Perl-independent core by writing a C tree with a
+   visitor. Nothing is printed unless there is a failure. */
+
+#include "../json-create-core.c"
+
+typedef struct node {
+    json_create_value_type_t type;
+    int64_t i;
+    double d;
+    const char * s;
+    /* The keys of an object. */
+    const char ** keys;
+    struct node ** children;
+    size_t n;
+}
+node_t;
+
+static json_create_status_t
+node_value (void * user, void * n, json_create_value_t * value)
+{
+    node_t * node;
+    node = n;
+    value->type = node->type;
+    value->i = node->i;
+    value->u = (uint64_t) node->i;
+    value->d = node->d;
+    value->s = node->s;
+    value->n = node->n;
+    if (node->type == json_create_value_string) {
+	value->n = strlen (node->s);
+    }
+    return json_create_ok;
+}
+
+static json_create_status_t
+node_entry (void * user, void * n, size_t i, json_create_value_t * key,
+	    void ** child_ptr)
+{
+    node_t * node;
+    node = n;
+    if (node->keys) {
+	key->type = json_create_value_string;
+	key->s = node->keys[i];
+	key->n = strlen (node->keys[i]);
+    }
+    * child_ptr = node->children[i];
+    return json_create_ok;
+}
+
+/* The output goes here. */
+
+static char out[0x10000];
+static size_t out_len;
+
+static json_create_status_t
+sink (void * user, const char * s, size_t len)
+{
+    if (out_len + len >= sizeof (out)) {
+	return json_create_no_memory;
+    }
+    memcpy (out + out_len, s, len);
+    out_len += len;
+    return json_create_ok;
+}
+
+static int messages;
+
+static void
+message (void * user, json_create_status_t status, const char * format,
+	 va_list * ap)
+{
+    messages++;
+}
+
+static unsigned char buffer[BUFSIZE];
+
+static json_create_status_t
+visit (json_create_core_t * core, json_create_visitor_t * v, node_t * root)
+{
+    json_create_status_t status;
+    out_len = 0;
+    /* Throw away anything left after an error. */
+    core->length = 0;
+    status = json_create_core_visit (core, v, root);
+    if (status == json_create_ok) {
+	status = json_create_core_fill (core);
+    }
+    out[out_len] = '\0';
+    return status;
+}
+
+static int failures;
+
+static void
+expect (const char * test, const char * want)
+{
+    if (strcmp (out, want) != 0) {
+	printf ("%s: expected '%s', got '%s'.\n", test, want, out);
+	failures++;
+    }
+}
+
+#define DEEP 1000
+
+/* Compare json_create_core_double with snprintf for "fformat" and
+   "fv". */
+
+static void
+compare_double (json_create_core_t * core, const char * fformat, double fv)
+{
+    char want[0x100];
+    json_create_core_fformat (core, fformat);
+    core->length = 0;
+    json_create_core_double (core, fv);
+    core->buffer[core->length] = '\0';
+    if (snprintf (want, sizeof (want), fformat ? fformat : "%g", fv)
+	>= MARGIN) {
+	/* This is json_create_number_too_long. */
+	return;
+    }
+    if (strcmp ((char *) core->buffer, want) != 0) {
+	printf ("%s of %.17g: expected '%s', got '%s'.\n",
+		fformat ? fformat : "default", fv, want, core->buffer);
+	failures++;
+    }
+}
+
+/* Formats which json_create_core_double prints itself, and the
+   numbers to try them with. */
+
+static const char * fformats[] = {
+    0, "%f", "%.0f", "%.1f", "%.2f", "%.6f", "%.10f", "%.18f",
+    "%e", "%.0e", "%.3e", "%.14E", "%g", "%.1g", "%.3g", "%.10G", "%.15g",
+};
+
+static const double doubles[] = {
+    0.0, -0.0, 1.0, -1.0, 0.5, 1.5, 2.5, 0.125, 0.375, 1.005, 2.675,
+    0.1, 0.01, 1e-5, 1e-4, 9.9995, 99.95, 999999.5, 123456789.0,
+    1e15, 1e16, 1e22, 1e23, 1e300, 1e-300, 5e-324, 3.141592653589793,
+    -2.718281828459045, 4503599627370495.5, 9.5, 0.05, 0.0005,
+};
+
+static void
+test_doubles (json_create_core_t * core)
+{
+    size_t i;
+    size_t j;
+    uint64_t x;
+    double fv;
+
+    for (i = 0; i < sizeof (fformats) / sizeof (fformats[0]); i++) {
+	for (j = 0; j < sizeof (doubles) / sizeof (doubles[0]); j++) {
+	    compare_double (core, fformats[i], doubles[j]);
+	}
+	/* Random numbers of all sizes, and random numbers like prices
+	   and coordinates. */
+	x = 12345;
+	for (j = 0; j < 20000; j++) {
+	    x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+	    fv = ldexp ((double) (x >> 11), (int) (x % 120) - 100);
+	    if (x & 1) {
+		fv = -fv;
+	    }
+	    compare_double (core, fformats[i], fv);
+	    compare_double (core, fformats[i],
+			    (double) (int64_t) (x >> 40) / 1000.0);
+	}
+    }
+    /* Not printed by json_create_core_fast_double. */
+    if (json_create_core_fformat (core, "%10.2f") ||
+	json_create_core_fformat (core, "%.20e")) {
+	printf ("fformat: unexpected fast format.\n");
+	failures++;
+    }
+    compare_double (core, "%10.2f", 3.14159);
+    compare_double (core, "%.20e", 3.14159);
+    json_create_core_fformat (core, 0);
+}
+
+int main ()
+{
+    json_create_core_t core = {0};
+    json_create_visitor_t v = {0};
+    node_t null = {json_create_value_null};
+    node_t yes = {json_create_value_true};
+    node_t minus = {json_create_value_int, -1234567890123LL};
+    node_t half = {json_create_value_double, 0, 0.5};
+    node_t str = {json_create_value_string, 0, 0, "a\"b\\c/\n\xe3\x81\x82"};
+    node_t * array_children[] = {& null, & yes, & minus, & half, & str};
+    node_t array = {json_create_value_array, 0, 0, 0, 0, array_children, 5};
+    const char * keys[] = {"k\t", "arr"};
+    node_t * object_children[] = {& half, & array};
+    node_t object = {json_create_value_object, 0, 0, 0, keys,
+		     object_children, 2};
+    node_t empty = {json_create_value_array};
+    node_t bad = {json_create_value_string, 0, 0, "\xff"};
+    const unsigned char emoji[] = "\xf0\x9f\x98\x80";
+    const unsigned char dalet[] = "\xef\xac\xb3";
+    node_t deep[DEEP];
+    node_t * deep_children[DEEP];
+    json_create_status_t status;
+    size_t i;
+
+    json_create_core_init (& core, buffer, sink, 0);
+    core.message = message;
+    v.value = node_value;
+    v.entry = node_entry;
+
+    visit (& core, & v, & object);
+    expect ("object", "{\"k\\t\":0.5,\"arr\":[null,true,-1234567890123,0.5,"
+	    "\"a\\\"b\\\\c/\\n\xe3\x81\x82\"]}");
+    visit (& core, & v, & empty);
+    expect ("empty array", "[]");
+
+    core.unicode_escape_all = 1;
+    json_create_core_escape_slash (& core, 1);
+    visit (& core, & v, & str);
+    expect ("escapes", "\"a\\\"b\\\\c\\/\\n\\u3042\"");
+    core.unicode_escape_all = 0;
+    json_create_core_escape_slash (& core, 0);
+    json_create_core_escape_chars (& core, "ab", 2);
+    visit (& core, & v, & str);
+    expect ("escape_chars", "\"\\u0061\\\"\\u0062\\\\c/\\n\xe3\x81\x82\"");
+    if (json_create_core_escape_chars (& core, "\xe3", 1)) {
+	printf ("escape_chars: non-ASCII accepted.\n");
+	failures++;
+    }
+
+    status = visit (& core, & v, & bad);
+    if (status != json_create_unicode_bad_utf8 || messages != 1) {
+	printf ("bad UTF-8: status %d, %d messages.\n", status, messages);
+	failures++;
+    }
+
+    /* Deeper than the frames on the C stack. */
+
+    for (i = 0; i < DEEP; i++) {
+	deep[i].type = json_create_value_array;
+	deep[i].keys = 0;
+	deep[i].n = 1;
+	deep_children[i] = (i + 1 < DEEP) ? deep + i + 1 : & null;
+	deep[i].children = deep_children + i;
+    }
+    status = visit (& core, & v, deep);
+    if (status != json_create_ok || out_len != 2 * DEEP + 4) {
+	printf ("deep: status %d, length %zu.\n", status, out_len);
+	failures++;
+    }
+    v.max_depth = 10;
+    status = visit (& core, & v, deep);
+    if (status != json_create_too_deep) {
+	printf ("max_depth: status %d.\n", status);
+	failures++;
+    }
+
+    test_doubles (& core);
+
+    /* RFC 8785 numbers and key order. */
+
+    json_create_core_canonical (& core, 1);
+    half.d = 333333333.33333329;
+    visit (& core, & v, & half);
+    expect ("canonical", "333333333.3333333");
+    half.d = 1e21;
+    visit (& core, & v, & half);
+    expect ("canonical 1e21", "1e+21");
+    half.d = 1e-7;
+    visit (& core, & v, & half);
+    expect ("canonical 1e-7", "1e-7");
+    /* U+1F600 is before U+FB33 in UTF-16. */
+    if (json_create_core_utf16_cmp (emoji, 4, dalet, 3) >= 0) {
+	printf ("utf16_cmp: wrong order.\n");
+	failures++;
+    }
+    json_create_core_canonical (& core, 0);
+
+    /* How much of a string fits into the room left for it. */
+
+    if (json_create_core_string_fit (& core, (const unsigned char *) "abcdef",
+				     6, 4) != 4 ||
+	json_create_core_string_fit (& core, (const unsigned char *) "a\"b",
+				     3, 2) != 1 ||
+	json_create_core_string_fit (& core, (const unsigned char *)
+				     "\xE3\x81\x82\xE3\x81\x84", 6, 5) != 3 ||
+	json_create_core_string_fit (& core, (const unsigned char *) "\x01a",
+				     2, 5) != 0) {
+	printf ("string_fit: wrong length.\n");
+	failures++;
+    }
+    return failures;
+}